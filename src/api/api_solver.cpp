@@ -35,6 +35,7 @@ Revision History:
 #include "smt/smt_solver.h"
 #include "smt/smt_implied_equalities.h"
 #include "solver/smt_logics.h"
+#include "solver/string_models.h"
 #include "cmd_context/cmd_context.h"
 #include "parsers/smt2/smt2parser.h"
 #include "sat/dimacs.h"
@@ -495,6 +496,50 @@ extern "C" {
         Z3_CATCH_RETURN(Z3_L_UNDEF);
     }
     
+    Z3_lbool Z3_API Z3_solver_enumerate_string_models(Z3_context c, Z3_solver s, unsigned max_models, unsigned timeout,
+                                                      void* state, Z3_string_model_eh* model_eh) {
+        Z3_TRY;
+        // not logged
+        RESET_ERROR_CODE();
+        init_solver(c, s);
+        if (timeout == 0)
+            timeout = to_solver(s)->m_params.get_uint("timeout", mk_c(c)->get_timeout());
+        unsigned rlimit      = to_solver(s)->m_params.get_uint("rlimit", mk_c(c)->get_rlimit());
+        bool     use_ctrl_c  = to_solver(s)->m_params.get_bool("ctrl_c", true);
+        cancel_eh<reslimit> eh(mk_c(c)->m().limit());
+        api::context::set_interruptable si(*(mk_c(c)), eh);
+        string_model_enumerator enumerate(*to_solver_ref(s));
+        lbool result;
+        {
+            scoped_ctrl_c ctrlc(eh, false, use_ctrl_c);
+            scoped_timer timer(timeout, &eh);
+            scoped_rlimit _rlimit(mk_c(c)->m().limit(), rlimit);
+            try {
+                result = enumerate(max_models, [&](model_ref& mdl) {
+                    if (!model_eh)
+                        return true;
+                    if (mk_c(c)->params().m_model_compress) mdl->compress();
+                    Z3_model_ref * m_ref = alloc(Z3_model_ref, *mk_c(c));
+                    m_ref->m_model = mdl;
+                    mk_c(c)->save_object(m_ref);
+                    return model_eh(state, of_model(m_ref));
+                });
+            }
+            catch (z3_exception & ex) {
+                to_solver_ref(s)->set_reason_unknown(eh);
+                if (!mk_c(c)->m().canceled()) {
+                    mk_c(c)->handle_exception(ex);
+                }
+                return Z3_L_UNDEF;
+            }
+        }
+        if (result == l_undef) {
+            to_solver_ref(s)->set_reason_unknown(eh);
+        }
+        return static_cast<Z3_lbool>(result);
+        Z3_CATCH_RETURN(Z3_L_UNDEF);
+    }
+
     Z3_model Z3_API Z3_solver_get_model(Z3_context c, Z3_solver s) {
         Z3_TRY;
         LOG_Z3_solver_get_model(c, s);
@@ -1412,6 +1412,12 @@ typedef enum
 */
 typedef void Z3_error_handler(Z3_context c, Z3_error_code e);
 
+/**
+   \brief Callback receiving the models found by #Z3_solver_enumerate_string_models.
+   It returns \c false to stop the enumeration.
+*/
+typedef bool Z3_string_model_eh(void* state, Z3_model m);
+
 /**
    \brief A Goal is essentially a set of formulas.
    Z3 provide APIs for building strategies/tactics for solving and transforming Goals.
@@ -6536,6 +6542,25 @@ extern "C" {
 
     Z3_ast_vector Z3_API Z3_solver_cube(Z3_context c, Z3_solver s, Z3_ast_vector vars, unsigned backtrack_level);
 
+    /**
+       \brief Enumerate models of the assertions of \c s that differ on their string constants.
+
+       Each model is passed to \c model_eh, together with \c state, as soon as it is found.
+       It is only valid during the call unless the callback takes a reference with #Z3_model_inc_ref.
+       After each model, a clause requiring some string constant of the assertions to take
+       another length or value is added in a scope of \c s, so the solver keeps its state
+       between models. The scope is popped before returning.
+
+       The enumeration stops after \c max_models models, when \c model_eh returns \c false,
+       or after \c timeout milliseconds (0 uses the timeout of the solver). The result is
+       \c Z3_L_TRUE in the first two cases, \c Z3_L_FALSE when there are no further models,
+       and \c Z3_L_UNDEF otherwise.
+
+       \sa Z3_solver_check
+    */
+    Z3_lbool Z3_API Z3_solver_enumerate_string_models(Z3_context c, Z3_solver s, unsigned max_models, unsigned timeout,
+                                                      void* state, Z3_string_model_eh* model_eh);
+
     /**
        \brief Retrieve the model for the last #Z3_solver_check or #Z3_solver_check_assumptions
 
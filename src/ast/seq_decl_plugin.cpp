@@ -22,6 +22,8 @@ Revision History:
 #include "ast/ast_pp.h"
 #include "ast/bv_decl_plugin.h"
 #include <sstream>
+#include <algorithm>
+#include <cstring>
 
 static bool is_hex_digit(char ch, unsigned& d) {
     if ('0' <= ch && ch <= '9') {
@@ -180,21 +182,14 @@ zstring zstring::replace(zstring const& src, zstring const& dst) const {
     if (src.length() == 0) {
         return dst + zstring(*this);
     }
-    bool found = false;
-    for (unsigned i = 0; i < length(); ++i) {
-        bool eq = !found && i + src.length() <= length();
-        for (unsigned j = 0; eq && j < src.length(); ++j) {
-            eq = m_buffer[i+j] == src[j];
-        }
-        if (eq) {
-            result.m_buffer.append(dst.m_buffer);
-            found = true;
-            i += src.length() - 1;
-        }
-        else {
-            result.m_buffer.push_back(m_buffer[i]);
-        }
+    int i = indexof(src, 0);
+    if (i < 0) {
+        return zstring(*this);
     }
+    result.m_buffer.append(static_cast<unsigned>(i), m_buffer.c_ptr());
+    result.m_buffer.append(dst.m_buffer);
+    unsigned rest = i + src.length();
+    result.m_buffer.append(length() - rest, m_buffer.c_ptr() + rest);
     return result;
 }
 
@@ -235,68 +230,166 @@ std::string zstring::as_string() const {
 }
 
 
+/*
+ * Views of a character array read forwards or backwards, so that the
+ * substring search below also finds last occurrences.
+ */
+namespace {
+    struct forward_view {
+        unsigned const* m_s;
+        forward_view(unsigned const* s, unsigned): m_s(s) {}
+        unsigned operator[](unsigned i) const { return m_s[i]; }
+    };
+
+    struct backward_view {
+        unsigned const* m_last;
+        backward_view(unsigned const* s, unsigned n): m_last(s + n - 1) {}
+        unsigned operator[](unsigned i) const { return *(m_last - i); }
+    };
+}
+
+/*
+ * Maximal suffix of x[0..m) under the character order (or its reverse).
+ * Returns the position before the suffix (possibly -1) and its period.
+ */
+template<class V>
+static int max_suffix(V const& x, unsigned m, bool reverse, unsigned& period) {
+    int ms = -1;
+    unsigned j = 0, k = 1;
+    period = 1;
+    while (j + k < m) {
+        unsigned a = x[j + k], b = x[static_cast<unsigned>(ms + static_cast<int>(k))];
+        if (a == b) {
+            if (k == period) {
+                j += period;
+                k = 1;
+            }
+            else {
+                ++k;
+            }
+        }
+        else if ((a < b) != reverse) {
+            j += k;
+            k = 1;
+            period = j - static_cast<unsigned>(ms);
+        }
+        else {
+            ms = static_cast<int>(j++);
+            k = period = 1;
+        }
+    }
+    return ms;
+}
+
+/*
+ * Crochemore-Perrin two-way search for x[0..m) in y[offset..n).
+ * Linear in n + m with constant extra space.
+ */
+template<class V>
+static int two_way_search(V const& x, unsigned m, V const& y, unsigned n, unsigned offset) {
+    if (m == 0)
+        return offset <= n ? static_cast<int>(offset) : -1;
+    if (offset > n || n - offset < m)
+        return -1;
+    unsigned p1, p2;
+    int ms1 = max_suffix(x, m, false, p1);
+    int ms2 = max_suffix(x, m, true, p2);
+    int ell = ms1 > ms2 ? ms1 : ms2;
+    unsigned per = ms1 > ms2 ? p1 : p2;
+
+    bool periodic = static_cast<unsigned>(ell + 1) + per <= m;
+    for (int i = 0; periodic && i <= ell; ++i)
+        periodic = x[i] == x[i + per];
+
+    unsigned j = offset;
+    if (periodic) {
+        int memory = -1;
+        while (j + m <= n) {
+            unsigned i = static_cast<unsigned>(std::max(ell, memory) + 1);
+            while (i < m && x[i] == y[i + j])
+                ++i;
+            if (i >= m) {
+                int k = ell;
+                while (k > memory && x[k] == y[k + j])
+                    --k;
+                if (k <= memory)
+                    return static_cast<int>(j);
+                j += per;
+                memory = static_cast<int>(m - per) - 1;
+            }
+            else {
+                j += i - static_cast<unsigned>(ell);
+                memory = -1;
+            }
+        }
+    }
+    else {
+        per = std::max(static_cast<unsigned>(ell + 1), m - static_cast<unsigned>(ell) - 1) + 1;
+        while (j + m <= n) {
+            unsigned i = static_cast<unsigned>(ell + 1);
+            while (i < m && x[i] == y[i + j])
+                ++i;
+            if (i >= m) {
+                int k = ell;
+                while (k >= 0 && x[k] == y[k + j])
+                    --k;
+                if (k < 0)
+                    return static_cast<int>(j);
+                j += per;
+            }
+            else {
+                j += i - static_cast<unsigned>(ell);
+            }
+        }
+    }
+    return -1;
+}
+
+/*
+ * Position of the first occurrence of x[0..m) in y[offset..n), or -1.
+ * Single characters and short haystacks are scanned directly.
+ */
+static int find_forward(unsigned const* x, unsigned m, unsigned const* y, unsigned n, unsigned offset) {
+    if (m == 0)
+        return offset <= n ? static_cast<int>(offset) : -1;
+    if (offset > n || n - offset < m)
+        return -1;
+    if (m == 1 || n - offset < 32) {
+        unsigned const* end = y + n - m + 1;
+        for (unsigned const* it = std::find(y + offset, end, x[0]); it != end; it = std::find(it + 1, end, x[0]))
+            if (memcmp(it + 1, x + 1, (m - 1) * sizeof(unsigned)) == 0)
+                return static_cast<int>(it - y);
+        return -1;
+    }
+    return two_way_search(forward_view(x, m), m, forward_view(y, n), n, offset);
+}
+
 bool zstring::suffixof(zstring const& other) const {
     if (length() > other.length()) return false;
-    bool suffix = true;
-    for (unsigned i = 0; suffix && i < length(); ++i) {
-        suffix = m_buffer[length()-i-1] == other[other.length()-i-1];
-    }
-    return suffix;
+    return memcmp(m_buffer.c_ptr(), other.m_buffer.c_ptr() + other.length() - length(), length() * sizeof(unsigned)) == 0;
 }
 
 bool zstring::prefixof(zstring const& other) const {
     if (length() > other.length()) return false;
-    bool prefix = true;
-    for (unsigned i = 0; prefix && i < length(); ++i) {
-        prefix = m_buffer[i] == other[i];
-    }
-    return prefix;
+    return memcmp(m_buffer.c_ptr(), other.m_buffer.c_ptr(), length() * sizeof(unsigned)) == 0;
 }
 
 bool zstring::contains(zstring const& other) const {
-    if (other.length() > length()) return false;
-    unsigned last = length() - other.length();
-    bool cont = false;
-    for (unsigned i = 0; !cont && i <= last; ++i) {
-        cont = true;
-        for (unsigned j = 0; cont && j < other.length(); ++j) {
-            cont = other[j] == m_buffer[j+i];
-        }
-    }
-    return cont;
+    return find_forward(other.m_buffer.c_ptr(), other.length(), m_buffer.c_ptr(), length(), 0) >= 0;
 }
 
 int zstring::indexof(zstring const& other, int offset) const {
     SASSERT(offset >= 0);
-    if (static_cast<unsigned>(offset) <= length() && other.length() == 0) return offset;
-    if (static_cast<unsigned>(offset) == length()) return -1;
-    if (other.length() + offset > length()) return -1;
-    unsigned last = length() - other.length();
-    for (unsigned i = static_cast<unsigned>(offset); i <= last; ++i) {
-        bool prefix = true;
-        for (unsigned j = 0; prefix && j < other.length(); ++j) {
-            prefix = m_buffer[i + j] == other[j];
-        }
-        if (prefix) {
-            return static_cast<int>(i);
-        }
-    }
-    return -1;
+    return find_forward(other.m_buffer.c_ptr(), other.length(), m_buffer.c_ptr(), length(), static_cast<unsigned>(offset));
 }
 
 int zstring::last_indexof(zstring const& other) const {
     if (other.length() == 0) return length();
     if (other.length() > length()) return -1;
-    for (unsigned last = length() - other.length(); last-- > 0; ) {
-        bool suffix = true;
-        for (unsigned j = 0; suffix && j < other.length(); ++j) {
-            suffix = m_buffer[last + j] == other[j];
-        }
-        if (suffix) {
-            return static_cast<int>(last);
-        }
-    }
-    return -1;
+    // the first match of the reversed pattern in the reversed string
+    int r = two_way_search(backward_view(other.m_buffer.c_ptr(), other.length()), other.length(),
+                           backward_view(m_buffer.c_ptr(), length()), length(), 0);
+    return r < 0 ? -1 : static_cast<int>(length() - other.length()) - r;
 }
 
 zstring zstring::extract(int offset, int len) const {
@@ -318,15 +411,8 @@ zstring zstring::operator+(zstring const& other) const {
 
 bool zstring::operator==(const zstring& other) const {
     // two strings are equal iff they have the same length and characters
-    if (length() != other.length()) {
-        return false;
-    }
-    for (unsigned i = 0; i < length(); ++i) {
-        if (m_buffer[i] != other[i]) {
-            return false;
-        }
-    }
-    return true;
+    return length() == other.length() &&
+        memcmp(m_buffer.c_ptr(), other.m_buffer.c_ptr(), length() * sizeof(unsigned)) == 0;
 }
 
 bool zstring::operator!=(const zstring& other) const {
@@ -846,6 +846,38 @@ public:
     void finalize(cmd_context & ctx) override {}
 };
 
+class get_string_models_cmd : public cmd {
+    unsigned m_max_models;
+    unsigned m_timeout;
+    unsigned m_count;
+public:
+    get_string_models_cmd(): cmd("get-string-models"), m_max_models(1), m_timeout(0), m_count(0) {}
+    char const * get_usage() const override { return "<max-models> [<timeout in milliseconds>]"; }
+    char const * get_descr(cmd_context & ctx) const override {
+        return "print models of the assertions that differ on their string constants as they are found.\nThen print sat if the limit was reached, unsat if there are no further models, or unknown";
+    }
+    unsigned get_arity() const override { return VAR_ARITY; }
+    cmd_arg_kind next_arg_kind(cmd_context & ctx) const override { return CPK_UINT; }
+    void set_next_arg(cmd_context & ctx, unsigned val) override {
+        if (m_count == 0)
+            m_max_models = val;
+        else if (m_count == 1)
+            m_timeout = val;
+        else
+            throw cmd_exception("invalid get-string-models command, too many arguments");
+        ++m_count;
+    }
+    void execute(cmd_context & ctx) override {
+        if (ctx.ignore_check())
+            return;
+        ctx.get_string_models(m_max_models, m_timeout);
+    }
+    void prepare(cmd_context & ctx) override { reset(ctx); }
+    void reset(cmd_context& ctx) override {
+        m_max_models = 1; m_timeout = 0; m_count = 0;
+    }
+};
+
 // provides "help" for builtin cmds
 class builtin_cmd : public cmd {
     char const * m_usage;
@@ -871,6 +903,7 @@ void install_basic_cmds(cmd_context & ctx) {
     ctx.insert(alloc(get_info_cmd));
     ctx.insert(alloc(set_info_cmd));
     ctx.insert(alloc(get_consequences_cmd));
+    ctx.insert(alloc(get_string_models_cmd));
     ctx.insert(alloc(builtin_cmd, "assert", "<term>", "assert term."));
     ctx.insert(alloc(builtin_cmd, "check-sat", "<boolean-constants>*", "check if the current context is satisfiable. If a list of boolean constants B is provided, then check if the current context is consistent with assigning every constant in B to true."));
     ctx.insert(alloc(builtin_cmd, "push", "<number>?", "push 1 (or <number>) scopes."));
@@ -49,6 +49,7 @@ Notes:
 #include "tactic/tactic_exception.h"
 #include "tactic/generic_model_converter.h"
 #include "solver/smt_logics.h"
+#include "solver/string_models.h"
 #include "cmd_context/basic_cmds.h"
 #include "cmd_context/cmd_context.h"
 
@@ -1629,6 +1630,41 @@ void cmd_context::get_consequences(expr_ref_vector const& assumptions, expr_ref_
     display_sat_result(r);
 }
 
+/**
+   \brief Enumerate up to max_models models that differ on the string constants of the
+   assertions. timeout bounds the whole enumeration, 0 means the timeout option.
+   The result is sat if the limit was reached and unsat if there are no further models.
+*/
+void cmd_context::get_string_models(unsigned max_models, unsigned timeout) {
+    if (!m_solver)
+        throw cmd_exception("string model enumeration requires a solver");
+    if (timeout == 0)
+        timeout = m_params.m_timeout;
+    unsigned rlimit  = m_params.rlimit();
+    lbool r;
+    m_check_sat_result = m_solver.get(); // solver itself stores the result.
+    m_solver->set_progress_callback(this);
+    cancel_eh<reslimit> eh(m().limit());
+    scoped_ctrl_c ctrlc(eh);
+    scoped_timer timer(timeout, &eh);
+    scoped_rlimit _rlimit(m().limit(), rlimit);
+    string_model_enumerator enumerate(*m_solver);
+    try {
+        r = enumerate(max_models, [&](model_ref& mdl) { display_model(mdl); return true; });
+        if (r == l_undef && m().canceled()) {
+            m_solver->set_reason_unknown(eh);
+        }
+    }
+    catch (z3_error & ex) {
+        throw ex;
+    }
+    catch (z3_exception & ex) {
+        m_solver->set_reason_unknown(ex.msg());
+        r = l_undef;
+    }
+    m_solver->set_status(r);
+    display_sat_result(r);
+}
 
 void cmd_context::reset_assertions() {
     if (!m_global_decls) {
@@ -440,6 +440,8 @@ public:
     void pop(unsigned n);
     void check_sat(unsigned num_assumptions, expr * const * assumptions);
     void get_consequences(expr_ref_vector const& assumptions, expr_ref_vector const& vars, expr_ref_vector & conseq);
+    // print models that differ on the string constants as they are found, then the result of the enumeration
+    void get_string_models(unsigned max_models, unsigned timeout);
     void reset_assertions();
     // display the result produced by a check-sat or check-sat-using commands in the regular stream
     void display_sat_result(lbool r);
@@ -0,0 +1,370 @@
+/*++
+Module Name:
+
+    dense_automaton.cpp
+
+Abstract:
+
+    Minimal deterministic automaton with a dense transition table.
+
+--*/
+
+#include "math/automata/dense_automaton.h"
+#include "util/hash.h"
+
+dense_automaton::dense_automaton(unsigned num_chars):
+    m_num_chars(num_chars),
+    m_num_classes(0),
+    m_num_states(0),
+    m_init(0) {
+}
+
+namespace {
+    /*
+     * Sets of NFA states stored in one pool, looked up by contents.
+     */
+    struct state_set_pool {
+        unsigned_vector m_elems;
+        unsigned_vector m_begin;    // set i is m_elems[m_begin[i] .. m_begin[i+1])
+
+        unsigned size(unsigned i) const { return m_begin[i + 1] - m_begin[i]; }
+        unsigned const* elems(unsigned i) const { return m_elems.c_ptr() + m_begin[i]; }
+    };
+
+    struct state_set_hash {
+        state_set_pool const* p;
+        unsigned operator()(unsigned i) const {
+            unsigned h = 17;
+            for (unsigned k = 0; k < p->size(i); ++k)
+                h = combine_hash(h, p->elems(i)[k]);
+            return h;
+        }
+    };
+
+    struct state_set_eq {
+        state_set_pool const* p;
+        bool operator()(unsigned i, unsigned j) const {
+            if (p->size(i) != p->size(j))
+                return false;
+            for (unsigned k = 0; k < p->size(i); ++k)
+                if (p->elems(i)[k] != p->elems(j)[k])
+                    return false;
+            return true;
+        }
+    };
+
+    typedef hashtable<unsigned, state_set_hash, state_set_eq> state_set_table;
+}
+
+/*
+ * Partition the alphabet at range boundaries, then run the subset construction over classes.
+ */
+dense_automaton* dense_automaton::determinize(unsigned num_chars, unsigned init, svector<bool> const& final,
+                                              vector<unsigned_vector> const& eps,
+                                              vector<svector<std::pair<unsigned, char_range>>> const& mvs,
+                                              unsigned max_states) {
+    dense_automaton* d = alloc(dense_automaton, num_chars);
+
+    svector<bool> cut(num_chars + 1, false);
+    for (auto const& ms : mvs)
+        for (auto const& mv : ms) {
+            cut[mv.second.first] = true;
+            cut[mv.second.second + 1] = true;
+        }
+    d->m_class_of.resize(num_chars, 0);
+    unsigned cls = 0;
+    for (unsigned c = 0; c < num_chars; ++c) {
+        if (c > 0 && cut[c])
+            ++cls;
+        d->m_class_of[c] = cls;
+    }
+    d->m_num_classes = num_chars == 0 ? 0 : cls + 1;
+    unsigned nc = d->m_num_classes;
+    unsigned n = eps.size();
+
+    state_set_pool pool;
+    pool.m_begin.push_back(0);
+    state_set_hash hp;
+    hp.p = &pool;
+    state_set_eq eqp;
+    eqp.p = &pool;
+    state_set_table table(DEFAULT_HASHTABLE_INITIAL_CAPACITY, hp, eqp);
+
+    svector<bool> in_set(n, false);
+    unsigned_vector todo, members;
+
+    // add the epsilon closure of members as a new set unless it exists; returns its index
+    auto intern = [&](unsigned_vector& seeds) -> unsigned {
+        members.reset();
+        todo.reset();
+        for (unsigned s : seeds)
+            if (!in_set[s]) {
+                in_set[s] = true;
+                todo.push_back(s);
+            }
+        while (!todo.empty()) {
+            unsigned s = todo.back();
+            todo.pop_back();
+            members.push_back(s);
+            for (unsigned t : eps[s])
+                if (!in_set[t]) {
+                    in_set[t] = true;
+                    todo.push_back(t);
+                }
+        }
+        std::sort(members.begin(), members.end());
+        for (unsigned s : members)
+            in_set[s] = false;
+        unsigned idx = pool.m_begin.size() - 1;
+        pool.m_elems.append(members);
+        pool.m_begin.push_back(pool.m_elems.size());
+        unsigned found;
+        if (table.find(idx, found)) {
+            pool.m_elems.shrink(pool.m_begin[idx]);
+            pool.m_begin.pop_back();
+            return found;
+        }
+        table.insert(idx);
+        d->m_delta.resize(d->m_delta.size() + nc, UINT_MAX);
+        bool f = false;
+        for (unsigned s : members)
+            f = f || final[s];
+        d->m_final.push_back(f);
+        return idx;
+    };
+
+    unsigned_vector seeds;
+    seeds.push_back(init);
+    d->m_init = intern(seeds);
+
+    vector<unsigned_vector> targets(nc);
+    for (unsigned q = 0; q < pool.m_begin.size() - 1; ++q) {
+        if (pool.m_begin.size() - 1 > max_states) {
+            dealloc(d);
+            return nullptr;
+        }
+        for (auto& t : targets)
+            t.reset();
+        for (unsigned k = 0; k < pool.size(q); ++k) {
+            unsigned s = pool.elems(q)[k];
+            for (auto const& mv : mvs[s])
+                for (unsigned c = d->m_class_of[mv.second.first]; c <= d->m_class_of[mv.second.second]; ++c)
+                    targets[c].push_back(mv.first);
+        }
+        for (unsigned c = 0; c < nc; ++c) {
+            // intern may grow m_delta, so compute the target first
+            unsigned r = intern(targets[c]);
+            d->m_delta[q * nc + c] = r;
+        }
+    }
+    d->m_num_states = pool.m_begin.size() - 1;
+    d->minimize();
+    return d;
+}
+
+/*
+ * Hopcroft's partition refinement on the complete DFA.
+ */
+void dense_automaton::minimize() {
+    unsigned n = m_num_states, nc = m_num_classes;
+    if (n <= 1 || nc == 0)
+        return;
+
+    // inverse transitions per class in compressed rows: pred[(c * n + s)] ranges
+    unsigned_vector pred_begin(nc * n + 1, 0u), pred;
+    for (unsigned s = 0; s < n; ++s)
+        for (unsigned c = 0; c < nc; ++c)
+            pred_begin[c * n + next(s, c) + 1]++;
+    for (unsigned i = 1; i < pred_begin.size(); ++i)
+        pred_begin[i] += pred_begin[i - 1];
+    pred.resize(n * nc, 0u);
+    unsigned_vector fill(pred_begin);
+    for (unsigned s = 0; s < n; ++s)
+        for (unsigned c = 0; c < nc; ++c)
+            pred[fill[c * n + next(s, c)]++] = s;
+
+    // blocks as contiguous slices of elems; pos[s] is the index of s in elems
+    unsigned_vector elems, pos(n, 0u), block(n, 0u), first, last, marked;
+    for (unsigned s = 0; s < n; ++s)
+        if (m_final[s]) elems.push_back(s);
+    unsigned num_final = elems.size();
+    for (unsigned s = 0; s < n; ++s)
+        if (!m_final[s]) elems.push_back(s);
+    for (unsigned i = 0; i < n; ++i)
+        pos[elems[i]] = i;
+    if (num_final > 0) {
+        first.push_back(0);
+        last.push_back(num_final);
+    }
+    if (num_final < n) {
+        first.push_back(num_final);
+        last.push_back(n);
+    }
+    for (unsigned b = 0; b < first.size(); ++b)
+        for (unsigned i = first[b]; i < last[b]; ++i)
+            block[elems[i]] = b;
+    marked.resize(first.size(), 0);
+
+    svector<std::pair<unsigned, unsigned>> work;
+    svector<bool> in_work;
+    auto add_work = [&](unsigned b, unsigned c) {
+        if (in_work.size() < (b + 1) * nc)
+            in_work.resize((b + 1) * nc, false);
+        if (!in_work[b * nc + c]) {
+            in_work[b * nc + c] = true;
+            work.push_back(std::make_pair(b, c));
+        }
+    };
+    unsigned smallest = 0;
+    if (first.size() == 2 && last[1] - first[1] < last[0] - first[0])
+        smallest = 1;
+    for (unsigned c = 0; c < nc; ++c)
+        add_work(smallest, c);
+
+    unsigned_vector splitter, touched;
+    while (!work.empty()) {
+        unsigned a = work.back().first, c = work.back().second;
+        work.pop_back();
+        in_work[a * nc + c] = false;
+
+        splitter.reset();
+        for (unsigned i = first[a]; i < last[a]; ++i) {
+            unsigned t = elems[i];
+            for (unsigned k = pred_begin[c * n + t]; k < pred_begin[c * n + t + 1]; ++k)
+                splitter.push_back(pred[k]);
+        }
+
+        // move marked states to the front of their block
+        touched.reset();
+        for (unsigned s : splitter) {
+            unsigned b = block[s];
+            unsigned i = pos[s];
+            if (i < first[b] + marked[b])
+                continue;
+            if (marked[b] == 0)
+                touched.push_back(b);
+            unsigned j = first[b] + marked[b];
+            unsigned u = elems[j];
+            std::swap(elems[i], elems[j]);
+            pos[u] = i;
+            pos[s] = j;
+            marked[b]++;
+        }
+
+        for (unsigned b : touched) {
+            unsigned m = marked[b];
+            marked[b] = 0;
+            if (m == last[b] - first[b])
+                continue;
+            // split b into [first, first + m) and a new block with the rest
+            unsigned nb = first.size();
+            first.push_back(first[b] + m);
+            last.push_back(last[b]);
+            marked.push_back(0);
+            last[b] = first[b] + m;
+            for (unsigned i = first[nb]; i < last[nb]; ++i)
+                block[elems[i]] = nb;
+            for (unsigned cc = 0; cc < nc; ++cc) {
+                if (b * nc + cc < in_work.size() && in_work[b * nc + cc])
+                    add_work(nb, cc);
+                else if (last[b] - first[b] <= last[nb] - first[nb])
+                    add_work(b, cc);
+                else
+                    add_work(nb, cc);
+            }
+        }
+    }
+
+    unsigned nb = first.size();
+    if (nb == n)
+        return;
+    unsigned_vector delta(nb * nc, 0u);
+    svector<bool> final(nb, false);
+    for (unsigned b = 0; b < nb; ++b) {
+        unsigned s = elems[first[b]];
+        final[b] = m_final[s];
+        for (unsigned c = 0; c < nc; ++c)
+            delta[b * nc + c] = block[next(s, c)];
+    }
+    m_init = block[m_init];
+    m_delta.swap(delta);
+    m_final.swap(final);
+    m_num_states = nb;
+}
+
+bool dense_automaton::accepts(unsigned const* chars, unsigned n) const {
+    unsigned s = m_init;
+    for (unsigned i = 0; i < n; ++i) {
+        if (chars[i] >= m_num_chars)
+            return false;
+        s = next(s, m_class_of[chars[i]]);
+    }
+    return m_final[s];
+}
+
+bool dense_automaton::is_empty() const {
+    svector<bool> seen(m_num_states, false);
+    unsigned_vector todo;
+    todo.push_back(m_init);
+    seen[m_init] = true;
+    while (!todo.empty()) {
+        unsigned s = todo.back();
+        todo.pop_back();
+        if (m_final[s])
+            return false;
+        for (unsigned c = 0; c < m_num_classes; ++c) {
+            unsigned t = next(s, c);
+            if (!seen[t]) {
+                seen[t] = true;
+                todo.push_back(t);
+            }
+        }
+    }
+    return true;
+}
+
+/*
+ * Search the product over the classes of both automata that share a character.
+ */
+bool dense_automaton::intersection_is_empty(dense_automaton const& a, dense_automaton const& b) {
+    SASSERT(a.num_chars() == b.num_chars());
+    svector<std::pair<unsigned, unsigned>> classes;
+    unsigned num_chars = std::min(a.num_chars(), b.num_chars());
+    for (unsigned c = 0; c < num_chars; ++c) {
+        std::pair<unsigned, unsigned> p(a.class_of(c), b.class_of(c));
+        if (classes.empty() || classes.back() != p)
+            classes.push_back(p);
+    }
+    unsigned nb = b.num_states();
+    svector<bool> seen(a.num_states() * nb, false);
+    unsigned_vector todo;
+    unsigned start = a.init() * nb + b.init();
+    seen[start] = true;
+    todo.push_back(start);
+    while (!todo.empty()) {
+        unsigned p = todo.back();
+        todo.pop_back();
+        unsigned sa = p / nb, sb = p % nb;
+        if (a.is_final(sa) && b.is_final(sb))
+            return false;
+        for (auto const& cl : classes) {
+            unsigned q = a.next(sa, cl.first) * nb + b.next(sb, cl.second);
+            if (!seen[q]) {
+                seen[q] = true;
+                todo.push_back(q);
+            }
+        }
+    }
+    return true;
+}
+
+std::ostream& dense_automaton::display(std::ostream& out) const {
+    out << "init: " << m_init << " states: " << m_num_states << " classes: " << m_num_classes << "\n";
+    for (unsigned s = 0; s < m_num_states; ++s) {
+        out << s << (m_final[s] ? "*" : "") << ":";
+        for (unsigned c = 0; c < m_num_classes; ++c)
+            out << " " << next(s, c);
+        out << "\n";
+    }
+    return out;
+}
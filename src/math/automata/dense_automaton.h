@@ -0,0 +1,98 @@
+/*++
+Module Name:
+
+    dense_automaton.h
+
+Abstract:
+
+    Minimal deterministic automaton over a small alphabet [0, num_chars)
+    with a dense state x character-class transition table.
+
+    Characters that no guard of the source automaton distinguishes share
+    a class, so the table has one column per class. The automaton is
+    complete: a dead state absorbs undefined transitions.
+
+    It is compiled from an automaton<T, M> whose guards can be read as
+    character ranges: subset construction followed by Hopcroft's
+    minimization.
+
+--*/
+
+#ifndef DENSE_AUTOMATON_H_
+#define DENSE_AUTOMATON_H_
+
+#include "math/automata/automaton.h"
+#include "util/hashtable.h"
+
+class dense_automaton {
+public:
+    typedef std::pair<unsigned, unsigned> char_range;
+    typedef svector<char_range> char_ranges;
+
+private:
+    unsigned        m_num_chars;
+    unsigned        m_num_classes;
+    unsigned_vector m_class_of;     // char -> class
+    unsigned        m_num_states;
+    unsigned        m_init;
+    unsigned_vector m_delta;        // state * m_num_classes + class -> state
+    svector<bool>   m_final;
+
+    dense_automaton(unsigned num_chars);
+
+    static dense_automaton* determinize(unsigned num_chars, unsigned init, svector<bool> const& final,
+                                        vector<unsigned_vector> const& eps,
+                                        vector<svector<std::pair<unsigned, char_range>>> const& mvs,
+                                        unsigned max_states);
+    void minimize();
+
+public:
+    unsigned num_chars() const { return m_num_chars; }
+    unsigned num_classes() const { return m_num_classes; }
+    unsigned num_states() const { return m_num_states; }
+    unsigned init() const { return m_init; }
+    unsigned class_of(unsigned c) const { return m_class_of[c]; }
+    unsigned next(unsigned s, unsigned cls) const { return m_delta[s * m_num_classes + cls]; }
+    bool is_final(unsigned s) const { return m_final[s]; }
+
+    bool accepts(unsigned const* chars, unsigned n) const;
+    bool is_empty() const;
+    static bool intersection_is_empty(dense_automaton const& a, dense_automaton const& b);
+
+    std::ostream& display(std::ostream& out) const;
+
+    /*
+     * Compile a. get_ranges(t, rs) stores the characters accepted by guard t
+     * as sorted ranges, or returns false if it cannot.
+     * Returns nullptr if a guard is not understood or if the subset
+     * construction exceeds max_states.
+     */
+    template<class T, class M, class R>
+    static dense_automaton* mk(automaton<T, M> const& a, R& get_ranges, unsigned num_chars, unsigned max_states) {
+        unsigned n = a.num_states();
+        vector<unsigned_vector> eps(n);
+        vector<svector<std::pair<unsigned, char_range>>> mvs(n);
+        svector<bool> final(n, false);
+        char_ranges rs;
+        for (unsigned s = 0; s < n; ++s) {
+            final[s] = a.is_final_state(s);
+            for (auto const& mv : a.get_moves_from(s)) {
+                if (mv.is_epsilon()) {
+                    eps[s].push_back(mv.dst());
+                    continue;
+                }
+                if (!get_ranges(mv.t(), rs))
+                    return nullptr;
+                for (auto const& r : rs) {
+                    if (r.first >= num_chars || r.first > r.second)
+                        continue;
+                    unsigned hi = std::min(r.second, num_chars - 1);
+                    mvs[s].push_back(std::make_pair(mv.dst(), char_range(r.first, hi)));
+                }
+            }
+        }
+        return determinize(num_chars, a.init(), final, eps, mvs, max_states);
+    }
+};
+
+#endif /* DENSE_AUTOMATON_H_ */
@@ -236,6 +236,7 @@ struct smt_params : public preprocessor_params,
     //
     // -----------------------------------
     symbol m_string_solver;
+    symbol m_string_portfolio;
 
     smt_params(params_ref const & p = params_ref()):
         m_display_proof(false),
@@ -307,7 +308,8 @@ struct smt_params : public preprocessor_params,
         m_check_at_labels(false),
         m_dump_goal_as_smt(false),
         m_auto_config(true),
-        m_string_solver(symbol("auto")){
+        m_string_solver(symbol("auto")),
+        m_string_portfolio(symbol("trau,seq,z3str3")){
         updt_local_params(p);
     }
 
@@ -37,4 +37,16 @@ void theory_str_params::updt_params(params_ref const & _p) {
     m_RegexAutomata_FailedAutomatonThreshold = p.str_regex_automata_failed_automaton_threshold();
     m_RegexAutomata_FailedIntersectionThreshold = p.str_regex_automata_failed_intersection_threshold();
     m_RegexAutomata_LengthAttemptThreshold = p.str_regex_automata_length_attempt_threshold();
+    m_TrauIncrementalFinalCheck = p.str_trau_incremental_final_check();
+    m_TrauMinimizeConflicts = p.str_trau_minimize_conflicts();
+    m_TrauMinimizeConflictsMaxSize = p.str_trau_minimize_conflicts_max_size();
+    m_TrauMinimizeConflictsRlimit = p.str_trau_minimize_conflicts_rlimit();
+    m_TrauAutomataCacheSize = p.str_trau_automata_cache_size();
+    m_TrauDenseAutomata = p.str_trau_dense_automata();
+    m_TrauBvFlatArrays = p.str_trau_bv_flat_arrays();
+    m_TrauMaxStrIntBound = p.str_trau_max_str_int_bound();
+    m_TrauArrangementTable = p.str_trau_arrangement_table();
+    m_TrauLengthAbstraction = p.str_trau_length_abstraction();
+    m_TrauCharClasses = p.str_trau_char_classes();
+    m_TrauWarmStart = p.str_trau_warm_start();
 }
@@ -117,6 +117,89 @@ struct theory_str_params {
      */
     unsigned m_RegexAutomata_LengthAttemptThreshold;
 
+    /*
+     * If TrauIncrementalFinalCheck is set to true,
+     * Trau only re-runs the final check stages whose inputs (equalities, disequalities,
+     * assignments, lengths) changed since the stage last passed.
+     */
+    bool m_TrauIncrementalFinalCheck;
+
+    /*
+     * If TrauMinimizeConflicts is set to true,
+     * Trau drops guessed literals from a blocking clause as long as a sub-solver
+     * can still refute the remaining ones together with the asserted formulas.
+     */
+    bool m_TrauMinimizeConflicts;
+
+    /*
+     * TrauMinimizeConflictsMaxSize is the largest blocking clause that is minimized.
+     */
+    unsigned m_TrauMinimizeConflictsMaxSize;
+
+    /*
+     * TrauMinimizeConflictsRlimit bounds the resources spent minimizing one blocking clause.
+     */
+    unsigned m_TrauMinimizeConflictsRlimit;
+
+    /*
+     * TrauAutomataCacheSize is the number of regex automata kept by the cache
+     * shared by the Trau solvers of one ast_manager.
+     */
+    unsigned m_TrauAutomataCacheSize;
+
+    /*
+     * If TrauDenseAutomata is true, cached automata whose guards are byte ranges
+     * are also compiled into minimal DFAs with dense transition tables.
+     */
+    bool m_TrauDenseAutomata;
+
+    /*
+     * If TrauBvFlatArrays is true, the content of a flat array is encoded as one
+     * bit-vector character per position up to the connecting size, so character
+     * constraints are bit-blasted instead of going through the array theory.
+     * Characters are 8 bits wide; when some character code does not fit, the
+     * flat arrays keep Int characters.
+     */
+    bool m_TrauBvFlatArrays;
+
+    /*
+     * TrauMaxStrIntBound is the largest number of digits the string-integer
+     * under-approximation grows to. The bound starts at 10 digits and grows
+     * when its literal takes part in a refutation. Once at the maximum, the
+     * bound is asserted and refutations under it are final. A maximum of 10
+     * keeps the fixed bound of earlier versions.
+     * The flattening bounds p and q and the connecting size of the flat
+     * arrays do not adapt; they keep their fixed schedule.
+     */
+    unsigned m_TrauMaxStrIntBound;
+
+    /*
+     * TrauArrangementTable is the name of a file holding precomputed flattening arrangements.
+     * If it is empty, arrangements are built on demand.
+     */
+    std::string m_TrauArrangementTable;
+
+    /*
+     * If TrauLengthAbstraction is true, every regex membership implies that the
+     * length of the string is one of the word lengths of the regex, as a
+     * disjunction of fixed and periodic lengths read off its automaton.
+     */
+    bool m_TrauLengthAbstraction;
+
+    /*
+     * If TrauCharClasses is true, characters that no constant or regex range of
+     * the input tells apart share one value in the flat-array encodings, and the
+     * values are numbered densely from 0.
+     */
+    bool m_TrauCharClasses;
+
+    /*
+     * If TrauWarmStart is true, a check that follows an earlier one on the same
+     * context first decides the string lengths of the last model and keeps the
+     * string-integer bound the earlier searches reached.
+     */
+    bool m_TrauWarmStart;
+
     theory_str_params(params_ref const & p = params_ref()):
         m_StrongArrangements(true),
         m_AggressiveLengthTesting(false),
@@ -134,7 +217,19 @@ struct theory_str_params {
         m_RegexAutomata_IntersectionDifficultyThreshold(1000),
         m_RegexAutomata_FailedAutomatonThreshold(10),
         m_RegexAutomata_FailedIntersectionThreshold(10),
-        m_RegexAutomata_LengthAttemptThreshold(10)
+        m_RegexAutomata_LengthAttemptThreshold(10),
+        m_TrauIncrementalFinalCheck(true),
+        m_TrauMinimizeConflicts(false),
+        m_TrauMinimizeConflictsMaxSize(32),
+        m_TrauMinimizeConflictsRlimit(20000),
+        m_TrauAutomataCacheSize(1024),
+        m_TrauDenseAutomata(true),
+        m_TrauBvFlatArrays(false),
+        m_TrauMaxStrIntBound(40),
+        m_TrauArrangementTable(""),
+        m_TrauLengthAbstraction(true),
+        m_TrauCharClasses(true),
+        m_TrauWarmStart(true)
     {
         updt_params(p);
     }
@@ -19,6 +19,7 @@ Notes:
 #include "cmd_context/cmd_context.h"
 #include "parsers/smt2/smt2parser.h"
 #include "smt/smt2_extra_cmds.h"
+#include "smt/trau_arrangements.h"
 
 class include_cmd : public cmd {
     char const * m_filename;
@@ -42,6 +43,34 @@ public:
     void finalize(cmd_context & ctx) override { reset(ctx); }
 };
 
+class trau_save_arrangements_cmd : public cmd {
+    char const * m_filename;
+    unsigned     m_max[2];
+    unsigned     m_count;
+public:
+    trau_save_arrangements_cmd() : cmd("trau-save-arrangements"), m_filename(nullptr), m_count(0) {}
+    char const * get_usage() const override { return "<string> <max-lhs> <max-rhs>"; }
+    char const * get_descr(cmd_context & ctx) const override {
+        return "write the Trau arrangements up to the given numbers of flats to a file for smt.str.trau_arrangement_table";
+    }
+    unsigned get_arity() const override { return 3; }
+    cmd_arg_kind next_arg_kind(cmd_context & ctx) const override { return m_filename == nullptr ? CPK_STRING : CPK_UINT; }
+    void set_next_arg(cmd_context & ctx, char const * val) override { m_filename = val; }
+    void set_next_arg(cmd_context & ctx, unsigned val) override { m_max[m_count++] = val; }
+    void failure_cleanup(cmd_context & ctx) override {}
+    void execute(cmd_context & ctx) override {
+        if (m_max[0] > smt::trau_arrangements::max_table_side || m_max[1] > smt::trau_arrangements::max_table_side)
+            throw cmd_exception("invalid trau-save-arrangements command, at most " +
+                                std::to_string(smt::trau_arrangements::max_table_side) + " flats per side");
+        if (!smt::trau_arrangements::save(m_filename, m_max[0], m_max[1]))
+            throw cmd_exception(std::string("failed to write file '") + m_filename + "'");
+    }
+    void prepare(cmd_context & ctx) override { reset(ctx); }
+    void reset(cmd_context & ctx) override { m_filename = nullptr; m_count = 0; }
+    void finalize(cmd_context & ctx) override { reset(ctx); }
+};
+
 void install_smt2_extra_cmds(cmd_context & ctx) {
     ctx.insert(alloc(include_cmd));
+    ctx.insert(alloc(trau_save_arrangements_cmd));
 }
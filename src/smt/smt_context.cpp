@@ -38,6 +38,7 @@ Revision History:
 #include "ast/ast_smt2_pp.h"
 #include "ast/ast_translation.h"
 #include "ast/recfun_decl_plugin.h"
+#include "smt/smt_string_portfolio.h"
 
 namespace smt {
 
@@ -3378,6 +3379,11 @@ namespace smt {
         if (!check_preamble(reset_cancel)) return l_undef;
         SASSERT(m_scope_lvl == 0);
         SASSERT(!m_setup.already_configured());
+        if (m_fparams.m_string_solver == "portfolio" && !m_is_auxiliary) {
+            string_portfolio portfolio(*this);
+            if (portfolio.applies())
+                return portfolio(expr_ref_vector(m_manager));
+        }
         setup_context(m_fparams.m_auto_config);
 
 
@@ -3441,6 +3447,12 @@ namespace smt {
     lbool context::check(unsigned num_assumptions, expr * const * assumptions, bool reset_cancel) {
         if (!check_preamble(reset_cancel)) return l_undef;
         SASSERT(at_base_level());
+        if (m_fparams.m_string_solver == "portfolio" && !m_setup.already_configured() && !m_is_auxiliary) {
+            // the racing contexts set up their own string theories
+            string_portfolio portfolio(*this);
+            if (portfolio.applies())
+                return portfolio(expr_ref_vector(m_manager, num_assumptions, assumptions));
+        }
         setup_context(false);
         lbool r;
         do {
@@ -69,6 +69,7 @@ namespace smt {
     class context {
         friend class model_generator;
         friend class lookahead;
+        friend class string_portfolio;
     public:
         statistics                  m_stats;
 
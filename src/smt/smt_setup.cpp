@@ -733,7 +733,7 @@ namespace smt {
         else if (m_params.m_string_solver == "seq") {
             setup_unknown();
         }
-        else if (m_params.m_string_solver == "auto") {
+        else if (m_params.m_string_solver == "auto" || m_params.m_string_solver == "portfolio") {
             setup_unknown();
         }
  
@@ -744,7 +744,7 @@ namespace smt {
             // don't register any solver.
         }
         else {
-            throw default_exception("invalid parameter for smt.string_solver, valid options are 'z3str3', 'trau', seq', 'auto'");
+            throw default_exception("invalid parameter for smt.string_solver, valid options are 'z3str3', 'trau', 'seq', 'auto', 'portfolio'");
         }
     }
 
@@ -917,7 +917,7 @@ namespace smt {
         else if (m_params.m_string_solver == "none") {
             // don't register any solver.
         }
-        else if (m_params.m_string_solver == "auto") {
+        else if (m_params.m_string_solver == "auto" || m_params.m_string_solver == "portfolio") {
             if (st.m_has_seq_non_str) {
                 setup_seq();
             } 
@@ -926,7 +926,7 @@ namespace smt {
             }
         } 
         else {
-            throw default_exception("invalid parameter for smt.string_solver, valid options are 'z3str3', 'trau', 'seq', 'auto'");
+            throw default_exception("invalid parameter for smt.string_solver, valid options are 'z3str3', 'trau', 'seq', 'auto', 'portfolio'");
         }
     }
 
@@ -947,6 +947,8 @@ namespace smt {
     void setup::setup_trau() {      
         setup_arith();      
         setup_arrays();     
+        if (m_params.m_TrauBvFlatArrays)
+            setup_bv();
         m_context.register_plugin(alloc(theory_trau, m_manager, m_params));     
     }
 
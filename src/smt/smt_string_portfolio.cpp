@@ -0,0 +1,186 @@
+/*++
+Module Name:
+
+    smt_string_portfolio.cpp
+
+Abstract:
+
+    Race several string solvers on the assertions of a context.
+
+--*/
+
+#include <mutex>
+#include <thread>
+#include "ast/ast_translation.h"
+#include "ast/for_each_expr.h"
+#include "model/model.h"
+#include "util/scoped_ptr_vector.h"
+#include "smt/smt_context.h"
+#include "smt/smt_string_portfolio.h"
+
+namespace smt {
+
+    string_portfolio::string_portfolio(context& ctx):
+        ctx(ctx), m(ctx.get_manager()) {
+        std::string names = ctx.get_fparams().m_string_portfolio.str();
+        size_t start = 0;
+        while (start <= names.size()) {
+            size_t end = names.find(',', start);
+            if (end == std::string::npos)
+                end = names.size();
+            if (end > start)
+                m_solvers.push_back(symbol(names.substr(start, end - start).c_str()));
+            start = end + 1;
+        }
+    }
+
+    namespace {
+        struct has_seq_proc {
+            struct found {};
+            ast_manager& m;
+            family_id    m_fid;
+            has_seq_proc(ast_manager& m): m(m), m_fid(m.mk_family_id("seq")) {}
+            void operator()(var*) {}
+            void operator()(quantifier*) {}
+            void operator()(app* a) {
+                if (a->get_family_id() == m_fid || m.get_sort(a)->get_family_id() == m_fid)
+                    throw found();
+            }
+        };
+    }
+
+    bool string_portfolio::has_strings() const {
+        has_seq_proc proc(m);
+        expr_fast_mark1 visited;
+        asserted_formulas const& af = ctx.m_asserted_formulas;
+        try {
+            for (unsigned i = 0; i < af.get_num_formulas(); ++i)
+                quick_for_each_expr(proc, visited, af.get_formula(i));
+        }
+        catch (has_seq_proc::found) {
+            return true;
+        }
+        return false;
+    }
+
+    bool string_portfolio::applies() const {
+        return m_solvers.size() > 1 && !m.proofs_enabled() && has_strings();
+    }
+
+    /*
+     * A worker wins with sat only if its model satisfies the input,
+     * otherwise the other workers keep racing.
+     */
+    bool string_portfolio::validate_model(context& c, expr_ref_vector const& fmls, expr_ref_vector const& asms) {
+        model_ref mdl;
+        c.get_model(mdl);
+        if (!mdl)
+            return false;
+        for (expr* f : fmls)
+            if (!has_quantifiers(f) && !mdl->is_true(f))
+                return false;
+        for (expr* a : asms)
+            if (!mdl->is_true(a))
+                return false;
+        return true;
+    }
+
+    lbool string_portfolio::operator()(expr_ref_vector const& asms) {
+        unsigned n = m_solvers.size();
+        asserted_formulas& af = ctx.m_asserted_formulas;
+        scoped_ptr_vector<ast_manager> managers;
+        scoped_ptr_vector<smt_params>  params;
+        scoped_ptr_vector<context>     contexts;
+        vector<expr_ref_vector>        worker_fmls;
+        vector<expr_ref_vector>        worker_asms;
+        scoped_limits scl(m.limit());
+
+        for (unsigned i = 0; i < n; ++i) {
+            ast_manager* new_m = alloc(ast_manager, m, true);
+            managers.push_back(new_m);
+            smt_params* p = alloc(smt_params, ctx.get_fparams());
+            p->m_string_solver = m_solvers[i];
+            params.push_back(p);
+            context* c = alloc(context, *new_m, *p, ctx.get_params());
+            contexts.push_back(c);
+            c->set_logic(ctx.m_setup.get_logic());
+            ast_translation tr(m, *new_m, false);
+            worker_fmls.push_back(expr_ref_vector(*new_m));
+            for (unsigned j = 0; j < af.get_num_formulas(); ++j) {
+                worker_fmls.back().push_back(tr(af.get_formula(j)));
+                c->assert_expr(worker_fmls.back().back());
+            }
+            worker_asms.push_back(expr_ref_vector(*new_m));
+            for (expr* a : asms)
+                worker_asms.back().push_back(tr(a));
+            scl.push_child(&new_m->limit());
+        }
+
+        std::mutex mux;
+        unsigned winner = UINT_MAX;
+        lbool result = l_undef;
+        vector<std::string> reasons(n);
+
+        auto worker_thread = [&](unsigned i) {
+            lbool r = l_undef;
+            try {
+                r = contexts[i]->check(worker_asms[i].size(), worker_asms[i].c_ptr());
+                if (r == l_true && !validate_model(*contexts[i], worker_fmls[i], worker_asms[i])) {
+                    r = l_undef;
+                    reasons[i] = "invalid model";
+                }
+                else if (r == l_undef)
+                    reasons[i] = contexts[i]->last_failure_as_string();
+            }
+            catch (z3_exception& ex) {
+                reasons[i] = ex.msg();
+            }
+            if (r == l_undef)
+                return;
+            std::lock_guard<std::mutex> lock(mux);
+            if (winner != UINT_MAX)
+                return;
+            winner = i;
+            result = r;
+            for (unsigned j = 0; j < n; ++j)
+                if (j != i)
+                    managers[j]->limit().cancel();
+        };
+
+        vector<std::thread> threads(n);
+        for (unsigned i = 0; i < n; ++i)
+            threads[i] = std::thread([&, i]() { worker_thread(i); });
+        for (unsigned i = 0; i < n; ++i)
+            threads[i].join();
+
+        if (winner == UINT_MAX) {
+            std::string reason;
+            for (unsigned i = 0; i < n; ++i) {
+                if (i > 0)
+                    reason += ", ";
+                reason += m_solvers[i].str() + ": " + reasons[i];
+            }
+            ctx.m_last_search_failure = m.limit().get_cancel_flag() ? CANCELED : OK;
+            ctx.set_reason_unknown(reason.c_str());
+            return l_undef;
+        }
+
+        IF_VERBOSE(1, verbose_stream() << "(smt.string-portfolio :winner " << m_solvers[winner] << ")\n";);
+        context& w = *contexts[winner];
+        ast_translation tr(*managers[winner], m, false);
+        if (result == l_true) {
+            model_ref mdl;
+            w.get_model(mdl);
+            if (mdl) {
+                // translation drops the skolem flag, so remove unused auxiliaries first
+                mdl->compress();
+                ctx.m_model = mdl->translate(tr);
+            }
+        }
+        else {
+            for (unsigned i = 0; i < w.get_unsat_core_size(); ++i)
+                ctx.m_unsat_core.push_back(tr(w.get_unsat_core_expr(i)));
+        }
+        return result;
+    }
+}
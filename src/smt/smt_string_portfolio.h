@@ -0,0 +1,46 @@
+/*++
+Module Name:
+
+    smt_string_portfolio.h
+
+Abstract:
+
+    Race several string solvers on the assertions of a context.
+
+    Used when smt.string_solver=portfolio. Each solver listed in
+    smt.string_portfolio gets its own ast_manager and context with
+    smt.string_solver set to it, and runs in its own thread. The first
+    definitive answer is kept, its model or unsat core is translated
+    back, and the other workers are canceled through their resource
+    limits. A sat answer whose model does not satisfy the assertions
+    does not count.
+
+--*/
+
+#pragma once
+
+#include "ast/ast.h"
+#include "util/symbol.h"
+
+namespace smt {
+    class context;
+
+    class string_portfolio {
+        context&      ctx;
+        ast_manager&  m;
+        svector<symbol> m_solvers;
+
+        bool has_strings() const;
+        static bool validate_model(context& c, expr_ref_vector const& fmls, expr_ref_vector const& asms);
+
+    public:
+        string_portfolio(context& ctx);
+
+        /*
+         * true if the assertions use strings and at least two solvers are configured.
+         */
+        bool applies() const;
+
+        lbool operator()(expr_ref_vector const& asms);
+    };
+}
@@ -4,6 +4,7 @@
 #include "ast/ast_ll_pp.h"
 #include "ast/ast_pp.h"
 #include "ast/ast_smt2_pp.h"
+#include "ast/ast_translation.h"
 #include "ast/ast_util.h"
 #include "ast/rewriter/seq_rewriter.h"
 #include "smt_kernel.h"
@@ -58,6 +59,7 @@ namespace smt {
               m_seq_rewrite(m),
               m_autil(m),
               m_arrayUtil(m),
+              m_bv(m),
               u(m),
               m_trail(m),
               m_find(*this),
@@ -69,23 +71,49 @@ namespace smt {
               contains_map(m),
               m_fresh_id(0),
               totalCacheAccessCount(0),
-              m_mk_aut(m),
-              m_res(m),
+              m_aut_cache(trau_automata_cache::acquire(m)),
+              str_int_bound_lit(m),
+              m_warm_vars(m),
               opt_DisableIntegerTheoryIntegration(false),
               opt_ConcatOverlapAvoid(true),
+              generated_equality_terms(m),
               uState(m),
-              implied_facts(m){
+              implied_facts(m),
+              m_fc_trail(m){
         str_int_bound = rational(0);
+        reset_fc_versions();
     }
 
     theory_trau::~theory_trau() {
         m_trail.reset();
+        trau_automata_cache::release(m_aut_cache);
     }
 
     void theory_trau::display(std::ostream& os) const {
         os << "theory_trau display" << std::endl;
     }
 
+    void theory_trau::collect_statistics(::statistics & st) const {
+        m_aut_cache->collect_statistics(st);
+        st.update("trau final checks", m_stats.m_final_checks);
+        st.update("trau underapprox rounds", m_stats.m_underapprox_rounds);
+        st.update("trau arrangements", m_stats.m_arrangements);
+        st.update("trau completed branch hits", m_stats.m_completed_branch_hits);
+        st.update("trau generated equality hits", m_stats.m_generated_eq_hits);
+        st.update("trau models", m_stats.m_models);
+        st.update("trau eq components", m_stats.m_eq_components);
+        st.update("trau char class refinements", m_stats.m_char_class_refinements);
+        st.update("trau warm start hints", m_stats.m_warm_start_hints);
+        st.update("trau str-int bound refutations", m_stats.m_str_int_bound_refutations);
+        st.update("trau time final check", m_final_check_watch.get_seconds());
+        st.update("trau time init chain free", m_chain_free_watch.get_seconds());
+        st.update("trau time parikh", m_parikh_watch.get_seconds());
+        st.update("trau time underapproximation", m_underapprox_watch.get_seconds());
+        st.update("trau time convert equalities", m_convert_watch.get_seconds());
+        st.update("trau time arrange", m_arrange_watch.get_seconds());
+        st.update("trau time model", m_model_watch.get_seconds());
+    }
+
     class seq_expr_solver : public expr_solver {
         kernel m_kernel;
     public:
@@ -102,8 +130,56 @@ namespace smt {
         }
     };
 
+    /*
+     * Same as seq_expr_solver, but the nested string solver does not minimize its own conflicts,
+     * and it runs on its own manager so that its budget never touches the limit of the outer search.
+     * The limit of that manager is a child of the outer one, so cancelling the outer search stops it too.
+     */
+    class conflict_core_solver : public expr_solver {
+        ast_manager&   m;
+        smt_params     m_fparams;
+        ast_manager    m_sub;
+        ast_translation m_tr;
+        kernel         m_kernel;
+        unsigned       m_rlimit;
+    public:
+        conflict_core_solver(ast_manager& m, smt_params const& fp, unsigned rlimit):
+                m(m),
+                m_fparams(fp),
+                m_sub(m, !m.proof_mode()),
+                m_tr(m, m_sub),
+                m_kernel(m_sub, m_fparams),
+                m_rlimit(rlimit)
+        {
+            m_fparams.m_TrauMinimizeConflicts = false;
+        }
+
+        lbool check_sat(expr* e) override {
+            if (m.limit().get_cancel_flag())
+                return l_undef;
+            expr_ref e1(m_tr(e), m_sub);
+            m_sub.limit().reset_cancel();
+            scoped_limits _limits(m.limit());
+            _limits.push_child(&m_sub.limit());
+            scoped_rlimit _rlimit(m_sub.limit(), m_rlimit);
+            m_kernel.push();
+            m_kernel.assert_expr(e1);
+            lbool r = m_kernel.check();
+            m_kernel.pop(1);
+            return r;
+        }
+    };
+
     void theory_trau::init(context *ctx) {
         theory::init(ctx);
+        m_aut_cache->set_max_size(m_params.m_TrauAutomataCacheSize);
+        max_str_int_bound = rational(std::max(m_params.m_TrauMaxStrIntBound, 1u));
+        str_int_start_bound = std::min(rational(10), max_str_int_bound);
+        m_aut_cache->set_dense(m_params.m_TrauDenseAutomata);
+        if (!m_params.m_TrauArrangementTable.empty() &&
+            !trau_arrangements::load(m_params.m_TrauArrangementTable.c_str())) {
+            STRACE("str", tout << __LINE__ << " cannot load arrangement table " << m_params.m_TrauArrangementTable << std::endl;);
+        }
     }
 
     bool theory_trau::internalize_atom(app *const atom, const bool gate_ctx) {
@@ -334,8 +410,10 @@ namespace smt {
             if (non_fresh_var != nullptr) {
                 // add array
                 expr* tmp_arr = get_var_flat_array(non_fresh_var);
-                if (tmp_arr && ctx.e_internalized(tmp_arr))
+                if (tmp_arr && ctx.e_internalized(tmp_arr)) {
                     result->add_entry(ctx.get_enode(get_var_flat_array(non_fresh_var)));
+                    add_bv_flat_entries(result, tmp_arr);
+                }
                 STRACE("str", tout << __LINE__ << "mk_value for: " << mk_ismt2_pp(owner, m) << " (sort " << mk_ismt2_pp(m.get_sort(owner), m) << ")" << std::endl;);
                 expr_ref_vector depImp = get_dependencies(non_fresh_var);
                 STRACE("str", tout << __LINE__ << "mk_value for: " << mk_ismt2_pp(owner, m) << " (sort " << mk_ismt2_pp(m.get_sort(owner), m) << ")" << std::endl;);
@@ -343,21 +421,23 @@ namespace smt {
 
                 // add its ancestors
                 if (dependency_graph.contains(owner))
-                    for (const auto& nn : dependency_graph[owner]) {
-                        result->add_entry(ctx.get_enode(nn));
-                    }
+                    for (const auto& nn : dependency_graph[owner])
+                        if (ctx.e_internalized(nn))
+                            result->add_entry(ctx.get_enode(nn));
             }
             else if (is_internal_regex_var(owner.get(), reg)){
                 // add array
                 expr* tmp_arr = get_var_flat_array(owner.get());
-                if (tmp_arr && ctx.e_internalized(tmp_arr))
+                if (tmp_arr && ctx.e_internalized(tmp_arr)) {
                     result->add_entry(ctx.get_enode(get_var_flat_array(tmp_arr)));
+                    add_bv_flat_entries(result, tmp_arr);
+                }
 
                 // add its ancestors
                 if (dependency_graph.contains(owner))
-                    for (const auto& nn : dependency_graph[owner]) {
-                        result->add_entry(ctx.get_enode(nn));
-                    }
+                    for (const auto& nn : dependency_graph[owner])
+                        if (ctx.e_internalized(nn))
+                            result->add_entry(ctx.get_enode(nn));
             }
             else {
                 // normal node
@@ -398,14 +478,14 @@ namespace smt {
     bool theory_trau::is_non_fresh(expr *n){
         expr_ref_vector eq(m);
         collect_eq_nodes(n, eq);
-        for (const auto& nn : uState.non_fresh_vars)
+        for (const auto& nn : uState.non_fresh_vars())
             if (eq.contains(nn.m_key))
                 return true;
         return false;
     }
 
     bool theory_trau::is_non_fresh(expr *n, int &val){
-        for (const auto& nn : uState.non_fresh_vars)
+        for (const auto& nn : uState.non_fresh_vars())
             if (nn.m_key == n) {
                 val = nn.m_value;
                 if (val < 0)
@@ -416,22 +496,72 @@ namespace smt {
     }
 
     bool theory_trau::is_regex_var(expr* n, expr* &regexExpr){
-        for (const auto& we: membership_memo) {
-            if (we.first == n){
-                regexExpr = we.second;
-                return true;
-            }
-        }
-        return false;
+        update_regex_var_index();
+        unsigned i;
+        if (!m_regex_var_first.find(n, i))
+            return false;
+        regexExpr = membership_memo[i].second;
+        return true;
     }
 
     bool theory_trau::is_regex_var(expr* n){
-        for (const auto& we: membership_memo) {
-            if (we.first == n){
-                return true;
+        update_regex_var_index();
+        return m_regex_var_first.contains(n);
+    }
+
+    void theory_trau::mark_var_kind(expr* e, unsigned kind){
+        unsigned id = e->get_id();
+        if (id >= m_var_kinds.size())
+            m_var_kinds.resize(id + 1, 0);
+        m_var_kinds[id] |= kind;
+    }
+
+    bool theory_trau::has_var_kind(expr* e, unsigned kind) const {
+        unsigned id = e->get_id();
+        return id < m_var_kinds.size() && (m_var_kinds[id] & kind) != 0;
+    }
+
+    expr* theory_trau::get_eqc_root(expr* e){
+        theory_var v = get_var(e);
+        return v == null_theory_var ? e : get_ast(m_find.find(v));
+    }
+
+    /*
+     * Index membership_memo by eq-class root. The classes only change in new_eq_eh and
+     * the memo in assign_eh, both of which move a final-check input version, and
+     * backtracking restores the versions together with the state, so the index is
+     * rebuilt only when one of the versions or the memo size differs.
+     */
+    void theory_trau::update_regex_var_index(){
+        unsigned key[3] = { m_fc_version[FC_IN_EQ], m_fc_version[FC_IN_ASSIGN], membership_memo.size() };
+        if (key[0] == m_regex_var_index_key[0] && key[1] == m_regex_var_index_key[1] && key[2] == m_regex_var_index_key[2])
+            return;
+        for (unsigned k = 0; k < 3; ++k)
+            m_regex_var_index_key[k] = key[k];
+        m_regex_var_index.reset();
+        m_regex_var_first.reset();
+        for (unsigned i = 0; i < membership_memo.size(); ++i) {
+            expr* var = membership_memo[i].first;
+            if (!m_regex_var_first.contains(var))
+                m_regex_var_first.insert(var, i);
+            expr* root = get_eqc_root(var);
+            regex_var_entry* entry = m_regex_var_index.find_core(root) ? &m_regex_var_index.find_core(root)->get_data().m_value : nullptr;
+            if (entry == nullptr) {
+                regex_var_entry fresh;
+                expr_ref_vector eqs(m);
+                collect_eq_nodes(var, eqs);
+                for (expr* n : eqs)
+                    if (!u.str.is_concat(n) && is_internal_var(n)) {
+                        fresh.m_has_internal = true;
+                        break;
+                    }
+                m_regex_var_index.insert(root, fresh);
+                entry = &m_regex_var_index.find_core(root)->get_data().m_value;
             }
+            if (entry->m_first_non_concat == UINT_MAX && !u.re.is_concat(membership_memo[i].second))
+                entry->m_first_non_concat = i;
+            entry->m_last = i;
         }
-        return false;
     }
 
     bool theory_trau::is_regex_concat(expr* n){
@@ -463,8 +593,8 @@ namespace smt {
         }
         STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << " " << mk_pp(n, m) << std::endl;);
         for (unsigned j = 0; j < eq.size(); ++j) {
-            if (uState.eq_combination.contains(eq[j].get())) {
-                for (const auto &nn : uState.eq_combination[eq[j].get()]) {
+            if (uState.eq_combination().contains(eq[j].get())) {
+                for (const auto &nn : uState.eq_combination()[eq[j].get()]) {
                     if (u.str.is_concat(nn)) {
                         ptr_vector<expr> nodes;
                         get_all_nodes_in_concat(nn, nodes);
@@ -504,6 +634,7 @@ namespace smt {
 
         // merge eqc **AFTER** handle_equality
         m_find.merge(x, y);
+        touch_fc_input(FC_IN_EQ);
 
         if (!is_trivial_eq_concat(n1->get_owner(), n2->get_owner())) {
             newConstraintTriggered = true;
@@ -544,7 +675,6 @@ namespace smt {
         }
 
         if (underapproximation_cached()) {
-            need_change = true;
             uState.reassertEQ = true;
             newConstraintTriggered = true;
             int tmpz3State = get_actual_trau_lvl();
@@ -2048,8 +2178,7 @@ namespace smt {
                             }
                         }
                         STRACE("str", tout << __LINE__ << " " << mk_ismt2_pp(nn, m) << " empty " << std::endl;);
-                        eautomaton *au01 = get_automaton(tmp);
-                        bool empty = au01->is_empty();
+                        bool empty = is_regex_empty(tmp);
 
                         if (empty) {
                             expr_ref implyL(mk_and(tmpList), m);
@@ -2132,8 +2261,12 @@ namespace smt {
         //         (9) containPairBoolMap[<eqc(y), eqc(x)>] /\ m = n  ==>  (b1 -> b2)
         // ------------------------------------------
 
-        for (auto varAst1 : willEqClass) {
-            for (auto varAst2 : willEqClass) {
+        expr_ref_vector containEqClass(m);
+        for (auto a : willEqClass)
+            if (in_contain_idx_map(a))
+                containEqClass.push_back(a);
+        for (auto varAst1 : containEqClass) {
+            for (auto varAst2 : containEqClass) {
                 check_contain_by_eq_nodes(varAst1, varAst2);
             }
         }
@@ -2346,10 +2479,50 @@ namespace smt {
         } // varNode in contain_pair_idx_map
     }
 
+    /*
+     * prefix is the part of haystack before needle. Equate it with the prefixes of the
+     * contains atoms over (str.substr haystack 0 _) and the same needle, which are found
+     * through the index of needle instead of a scan of every contains pair.
+     */
+    void theory_trau::sync_substr_contain_prefix(expr* haystack, expr* needle, expr* prefix){
+        auto const* keys = contain_pair_idx_map.find_core(needle);
+        if (!keys)
+            return;
+        ptr_vector<expr> substrs;
+        for (const auto& p : keys->get_data().m_value){
+            if (p.second != needle || !u.str.is_extract(p.first))
+                continue;
+            app* substr = to_app(p.first);
+            rational ra;
+            if (substr->get_arg(0) == haystack &&
+                m_autil.is_numeral(substr->get_arg(1), ra) && ra.get_int64() == 0)
+                substrs.push_back(substr);
+        }
+        // the axioms may register new contains atoms, so they are added after the scan
+        for (expr* substr : substrs) {
+            STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << " found substr contain " << mk_pp(substr, m) << std::endl;);
+            enode* keynode = ensure_enode(mk_contains(substr, needle));
+            SASSERT(contain_split_map.contains(keynode));
+            assert_axiom(createEqualOP(prefix, contain_split_map[keynode].first->get_owner()));
+        }
+    }
+
     bool theory_trau::in_contain_idx_map(expr * n) {
         return contain_pair_idx_map.contains(n);
     }
 
+    /*
+     * The members of the eq-class of n that take part in some contains atom.
+     */
+    void theory_trau::collect_contain_eq_nodes(expr * n, expr_ref_vector & eqcSet) {
+        expr * ex = n;
+        do {
+            if (in_contain_idx_map(ex))
+                eqcSet.push_back(ex);
+            ex = get_eqc_next(ex);
+        } while (ex != n);
+    }
+
     void theory_trau::check_contain_by_eq_nodes(expr * n1, expr * n2) {
         context & ctx = get_context();
         
@@ -2429,10 +2602,10 @@ namespace smt {
                         } else {
                             expr_ref_vector subAst1Eqc(m);
                             expr_ref_vector subAst2Eqc(m);
-                            collect_eq_nodes(subAst1, subAst1Eqc);
-                            collect_eq_nodes(subAst2, subAst2Eqc);
+                            collect_contain_eq_nodes(subAst1, subAst1Eqc);
+                            collect_contain_eq_nodes(subAst2, subAst2Eqc);
 
-                            if (subAst1Eqc.contains(subAst2)) {
+                            if (are_equal_exprs(subAst1, subAst2)) {
                                 // -----------------------------------------------------------
                                 // * key1.first = key2.first /\ key1.second = key2.second
                                 //   -->  containPairBoolMap[key1] = containPairBoolMap[key2]
@@ -2581,10 +2754,10 @@ namespace smt {
                         else {
                             expr_ref_vector str1Eqc(m);
                             expr_ref_vector str2Eqc(m);
-                            collect_eq_nodes(str1, str1Eqc);
-                            collect_eq_nodes(str2, str2Eqc);
+                            collect_contain_eq_nodes(str1, str1Eqc);
+                            collect_contain_eq_nodes(str2, str2Eqc);
 
-                            if (str1Eqc.contains(str2)) {
+                            if (are_equal_exprs(str1, str2)) {
                                 // -----------------------------------------------------------
                                 // * key1.first = key2.first /\ key1.second = key2.second
                                 //   -->  containPairBoolMap[key1] = containPairBoolMap[key2]
@@ -2730,6 +2903,7 @@ namespace smt {
 
         STRACE("str", tout << __FUNCTION__ << ": " << mk_ismt2_pp(n1, m) << " != "
                            << mk_ismt2_pp(n2, m) << " @ lvl " << m_scope_level << std::endl;);
+        touch_fc_input(FC_IN_DISEQ);
         if (is_inconsistent_inequality(n1, n2)){
             return;
         }
@@ -3163,9 +3337,6 @@ namespace smt {
 
     void theory_trau::init_search_eh() {
         context & ctx = get_context();
-        m_re2aut.reset();
-        m_automata.reset();
-        m_res.reset();
         startClock = clock();
 
         /*
@@ -3179,6 +3350,9 @@ namespace smt {
             expr * ex = ctx.get_asserted_formula(i);
             set_up_axioms(ex);
         }
+        setup_char_classes();
+        if (search_started)
+            restart_search();
 
         // this might be cheating but we need to make sure that certain maps are populated
         // before the first call to new_eq_eh()
@@ -3199,6 +3373,7 @@ namespace smt {
         expr *n1 = nullptr, *n2 = nullptr;
         context& ctx = get_context();
         expr* var =  ctx.bool_var2expr(v);
+        touch_fc_input(FC_IN_ASSIGN);
         if (u.str.is_prefix(var)){
         }
         else if (u.str.is_suffix(var)){
@@ -3265,10 +3440,22 @@ namespace smt {
         m_str_eq_todo.reset();
         m_concat_axiom_todo.reset();
         completed_branches.reset();
+        completed_branch_cores.reset();
+        completed_branch_index.reset();
         pop_scope_eh(get_context().get_scope_level());
+        reset_fc_versions();
     }
 
     final_check_status theory_trau::final_check_eh() {
+        final_check_status r = final_check_core();
+        if (r == FC_DONE && bound_char_selects())
+            return FC_CONTINUE;
+        return r;
+    }
+
+    final_check_status theory_trau::final_check_core() {
+        m_stats.m_final_checks++;
+        scoped_watch _fc(m_final_check_watch);
         TRACE("str", tout << __FUNCTION__ << ": at level " << m_scope_level << "/ eqLevel = " << uState.eqLevel << "; bound = " << uState.str_int_bound << std::endl;);
         if (m_we_expr_memo.empty() && m_wi_expr_memo.empty() && membership_memo.size() == 0) {
             STRACE("str", tout << __LINE__ << " DONE" << std::endl;);
@@ -3281,7 +3468,7 @@ namespace smt {
 //            return FC_CONTINUE;
 //        }
 
-        if (!newConstraintTriggered && uState.reassertDisEQ && uState.reassertEQ) {
+        if (!newConstraintTriggered && uState.reassertDisEQ && uState.reassertEQ && str_int_bound_holds()) {
             STRACE("str", tout << __LINE__ << " DONE" << std::endl;);
             return FC_DONE;
         }
@@ -3305,51 +3492,70 @@ namespace smt {
 
         dump_assignments();
         STRACE("str", tout << __LINE__ <<  " current time used: " << ":  " << ((float)(clock() - startClock))/CLOCKS_PER_SEC << std::endl;);
+        update_fc_len_version();
         obj_map<expr, int> non_fresh_vars;
         obj_map<expr, ptr_vector<expr>> eq_combination;
-        if (init_chain_free(non_fresh_vars, eq_combination)){
+        if (cached_init_chain_free(non_fresh_vars, eq_combination)){
             return FC_CONTINUE;
         }
 
         STRACE("str", tout << __LINE__ <<  " current time used: " << ":  " << ((float)(clock() - startClock))/CLOCKS_PER_SEC << std::endl;);
-        if (!review_starting_ending_combination(eq_combination)){
-            negate_equalities();
-            return FC_CONTINUE;
+        if (!is_fc_stage_clean(FC_STARTING_ENDING)) {
+            if (!review_starting_ending_combination(eq_combination)) {
+                negate_equalities();
+                return FC_CONTINUE;
+            }
+            mark_fc_stage_clean(FC_STARTING_ENDING);
         }
         STRACE("str", tout << __LINE__ <<  " current time used: " << ":  " << ((float)(clock() - startClock))/CLOCKS_PER_SEC << std::endl;);
-        if (!review_disequalities_not_contain(eq_combination)){
-            TRACE("str", tout << "Resuming search due to axioms added by review_disequalities_not_contain." << std::endl;);
-            print_eq_combination(eq_combination);
-            negate_context();
-            return FC_CONTINUE;
+        if (!is_fc_stage_clean(FC_DISEQ_NOT_CONTAIN)) {
+            if (!review_disequalities_not_contain(eq_combination)) {
+                TRACE("str", tout << "Resuming search due to axioms added by review_disequalities_not_contain." << std::endl;);
+                print_eq_combination(eq_combination);
+                negate_context();
+                return FC_CONTINUE;
+            }
+            mark_fc_stage_clean(FC_DISEQ_NOT_CONTAIN);
         }
         STRACE("str", tout << __LINE__ <<  " current time used: " << ":  " << ((float)(clock() - startClock))/CLOCKS_PER_SEC << std::endl;);
-        if (!is_notContain_consistent(eq_combination)) {
-            TRACE("str", tout << "Resuming search due to axioms added by is_notContain_consistent check." << std::endl;);
-            update_state();
-            return FC_CONTINUE;
+        if (!is_fc_stage_clean(FC_NOT_CONTAIN_CONSISTENT)) {
+            if (!is_notContain_consistent(eq_combination)) {
+                TRACE("str", tout << "Resuming search due to axioms added by is_notContain_consistent check." << std::endl;);
+                update_state();
+                return FC_CONTINUE;
+            }
+            mark_fc_stage_clean(FC_NOT_CONTAIN_CONSISTENT);
         }
         STRACE("str", tout << __LINE__ <<  " current time used: " << ":  " << ((float)(clock() - startClock))/CLOCKS_PER_SEC << std::endl;);
         print_eq_combination(eq_combination);
 
         STRACE("str", tout << __LINE__ <<  " current time used: " << ":  " << ((float)(clock() - startClock))/CLOCKS_PER_SEC << std::endl;);
-        if (handle_contain_family(eq_combination)){
-            TRACE("str", tout << "Resuming search due to axioms added by handle_contain_family propagation." << std::endl;);
-            update_state();
-            return FC_CONTINUE;
+        if (!is_fc_stage_clean(FC_CONTAIN_FAMILY)) {
+            if (handle_contain_family(eq_combination)) {
+                TRACE("str", tout << "Resuming search due to axioms added by handle_contain_family propagation." << std::endl;);
+                update_state();
+                return FC_CONTINUE;
+            }
+            mark_fc_stage_clean(FC_CONTAIN_FAMILY);
         }
         STRACE("str", tout << __LINE__ <<  " current time used: " << ":  " << ((float)(clock() - startClock))/CLOCKS_PER_SEC << std::endl;);
-        if (handle_charAt_family(eq_combination)) {
-            TRACE("str", tout << "Resuming search due to axioms added by handle_charAt_family propagation." << std::endl;);
-            update_state();
-            return FC_CONTINUE;
+        if (!is_fc_stage_clean(FC_CHARAT_FAMILY)) {
+            if (handle_charAt_family(eq_combination)) {
+                TRACE("str", tout << "Resuming search due to axioms added by handle_charAt_family propagation." << std::endl;);
+                update_state();
+                return FC_CONTINUE;
+            }
+            mark_fc_stage_clean(FC_CHARAT_FAMILY);
         }
         STRACE("str", tout << __LINE__ <<  " current time used: " << ":  " << ((float)(clock() - startClock))/CLOCKS_PER_SEC << std::endl;);
-        if (propagate_eq_combination(eq_combination)) {
-            TRACE("str", tout << "Resuming search due to axioms added by eq_combination propagation." << std::endl;);
-            print_eq_combination(eq_combination);
-            update_state();
-            return FC_CONTINUE;
+        if (!is_fc_stage_clean(FC_EQ_COMBINATION)) {
+            if (propagate_eq_combination(eq_combination)) {
+                TRACE("str", tout << "Resuming search due to axioms added by eq_combination propagation." << std::endl;);
+                print_eq_combination(eq_combination);
+                update_state();
+                return FC_CONTINUE;
+            }
+            mark_fc_stage_clean(FC_EQ_COMBINATION);
         }
         STRACE("str", tout << __LINE__ <<  " current time used: " << ":  " << ((float)(clock() - startClock))/CLOCKS_PER_SEC << std::endl;);
         if (refined_init_chain_free(non_fresh_vars, eq_combination)){
@@ -3362,13 +3568,22 @@ namespace smt {
             return FC_CONTINUE;
         }
 
-        if (!parikh_image_check(eq_combination)){
-            negate_context();
-            return FC_CONTINUE;
+        if (!is_fc_stage_clean(FC_PARIKH)) {
+            m_parikh_watch.start();
+            bool parikh_ok = parikh_image_check(eq_combination);
+            m_parikh_watch.stop();
+            if (!parikh_ok) {
+                negate_context();
+                return FC_CONTINUE;
+            }
+            mark_fc_stage_clean(FC_PARIKH);
         }
 
         STRACE("str", tout << __LINE__ <<  " current time used: " << ":  " << ((float)(clock() - startClock))/CLOCKS_PER_SEC << std::endl;);
-        if (underapproximation(eq_combination, non_fresh_vars, diff)) {
+        m_underapprox_watch.start();
+        bool underapprox_added = underapproximation(eq_combination, non_fresh_vars, diff);
+        m_underapprox_watch.stop();
+        if (underapprox_added) {
             update_state();
             return FC_CONTINUE;
         }
@@ -3377,6 +3592,178 @@ namespace smt {
         return FC_DONE;
     }
 
+    void theory_trau::touch_fc_input(unsigned input){
+        SASSERT(input < FC_IN_NUM);
+        m_trail_stack.push(value_trail<theory_trau, unsigned>(m_fc_version[input], ++m_fc_stamp));
+    }
+
+    /*
+     * lengths are owned by the arithmetic solver, so we cannot be notified about them.
+     * Compare the (enode, root, length) triples with the snapshot of the previous final check
+     * and bump FC_IN_LEN when any of them moved. Unknown lengths are recorded as -1.
+     */
+    void theory_trau::update_fc_len_version(){
+        context & ctx = get_context();
+        sort* string_sort = u.str.mk_string_sort();
+        bool changed = m_fc_version[FC_IN_LEN] == 0;
+        if (changed) {
+            m_fc_len_ids.reset();
+            m_fc_len_values.reset();
+        }
+        unsigned n = 0;
+        for (ptr_vector<enode>::const_iterator it = ctx.begin_enodes(); it != ctx.end_enodes(); ++it) {
+            expr* owner = (*it)->get_owner();
+            if (m.get_sort(owner) != string_sort || u.str.is_concat(owner) || u.str.is_string(owner))
+                continue;
+            rational len;
+            if (!get_len_value(owner, len))
+                len = rational::minus_one();
+            unsigned root_id = (*it)->get_root()->get_owner_id();
+            if (!changed && n < m_fc_len_values.size() &&
+                m_fc_len_ids[2 * n] == owner->get_id() && m_fc_len_ids[2 * n + 1] == root_id && m_fc_len_values[n] == len) {
+                ++n;
+                continue;
+            }
+            if (!changed) {
+                changed = true;
+                m_fc_len_ids.shrink(2 * n);
+                m_fc_len_values.shrink(n);
+            }
+            m_fc_len_ids.push_back(owner->get_id());
+            m_fc_len_ids.push_back(root_id);
+            m_fc_len_values.push_back(len);
+            ++n;
+        }
+        if (n != m_fc_len_values.size()) {
+            changed = true;
+            m_fc_len_ids.shrink(2 * n);
+            m_fc_len_values.shrink(n);
+        }
+        if (changed)
+            m_fc_version[FC_IN_LEN] = ++m_fc_stamp;
+    }
+
+    unsigned theory_trau::fc_stage_inputs(unsigned stage) const {
+        unsigned const all_inputs = (1u << FC_IN_EQ) | (1u << FC_IN_DISEQ) | (1u << FC_IN_ASSIGN) | (1u << FC_IN_LEN);
+        switch (stage) {
+            case FC_INIT_CHAIN_FREE:
+                return all_inputs;
+            case FC_STARTING_ENDING:
+                return (1u << FC_IN_COMB);
+            case FC_DISEQ_NOT_CONTAIN:
+            case FC_NOT_CONTAIN_CONSISTENT:
+                return all_inputs | (1u << FC_IN_COMB);
+            case FC_CONTAIN_FAMILY:
+            case FC_CHARAT_FAMILY:
+                return (1u << FC_IN_COMB) | (1u << FC_IN_EQ);
+            case FC_EQ_COMBINATION:
+                return (1u << FC_IN_COMB) | (1u << FC_IN_EQ) | (1u << FC_IN_LEN);
+            default:
+                // parikh_image_check runs on the refined combination
+                return all_inputs | (1u << FC_IN_COMB);
+        }
+    }
+
+    bool theory_trau::is_fc_stage_clean(unsigned stage) const {
+        if (!m_params.m_TrauIncrementalFinalCheck)
+            return false;
+        unsigned inputs = fc_stage_inputs(stage);
+        for (unsigned i = 0; i < FC_IN_NUM; ++i)
+            if ((inputs & (1u << i)) && m_fc_clean[stage][i] != m_fc_version[i])
+                return false;
+        STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << " skip stage " << stage << std::endl;);
+        return true;
+    }
+
+    void theory_trau::mark_fc_stage_clean(unsigned stage){
+        for (unsigned i = 0; i < FC_IN_NUM; ++i)
+            m_fc_clean[stage][i] = m_fc_version[i];
+    }
+
+    void theory_trau::reset_fc_versions(){
+        m_fc_len_ids.reset();
+        m_fc_len_values.reset();
+        for (unsigned i = 0; i < FC_IN_NUM; ++i)
+            m_fc_version[i] = 0;
+        for (unsigned j = 0; j < FC_NUM_STAGES; ++j)
+            for (unsigned i = 0; i < FC_IN_NUM; ++i)
+                m_fc_clean[j][i] = UINT_MAX;
+        m_fc_non_fresh_vars.reset();
+        m_fc_eq_combination.reset();
+        m_fc_sigma_domain.reset();
+        m_fc_trail.reset();
+        for (unsigned k = 0; k < 3; ++k)
+            m_regex_var_index_key[k] = UINT_MAX;
+    }
+
+    /*
+     * init_chain_free, reusing the previous combination when nothing changed.
+     * FC_IN_COMB only moves when the recomputed combination differs from the cached one.
+     */
+    bool theory_trau::cached_init_chain_free(
+            obj_map<expr, int> &non_fresh_vars,
+            obj_map<expr, ptr_vector<expr>> &eq_combination){
+        if (is_fc_stage_clean(FC_INIT_CHAIN_FREE)) {
+            non_fresh_vars = m_fc_non_fresh_vars;
+            eq_combination = m_fc_eq_combination;
+            sigma_domain = m_fc_sigma_domain;
+            return false;
+        }
+
+        m_chain_free_watch.start();
+        bool added = init_chain_free(non_fresh_vars, eq_combination);
+        m_chain_free_watch.stop();
+        if (added)
+            return true;
+
+        if (m_fc_version[FC_IN_COMB] == 0 ||
+            !same_non_fresh_vars(non_fresh_vars, m_fc_non_fresh_vars) ||
+            !same_eq_combination(eq_combination, m_fc_eq_combination)) {
+            m_fc_version[FC_IN_COMB] = ++m_fc_stamp;
+            m_fc_non_fresh_vars = non_fresh_vars;
+            m_fc_eq_combination = eq_combination;
+            // keep the cached terms alive across backtracking
+            m_fc_trail.reset();
+            for (const auto& v : non_fresh_vars)
+                m_fc_trail.push_back(v.m_key);
+            for (const auto& c : eq_combination) {
+                m_fc_trail.push_back(c.m_key);
+                m_fc_trail.append(c.get_value().size(), c.get_value().c_ptr());
+            }
+        }
+        m_fc_sigma_domain = sigma_domain;
+        mark_fc_stage_clean(FC_INIT_CHAIN_FREE);
+        return false;
+    }
+
+    bool theory_trau::same_eq_combination(obj_map<expr, ptr_vector<expr>> const& lhs, obj_map<expr, ptr_vector<expr>> const& rhs){
+        if (lhs.size() != rhs.size())
+            return false;
+        for (const auto& c : lhs) {
+            auto* other = rhs.find_core(c.m_key);
+            if (other == nullptr)
+                return false;
+            ptr_vector<expr> const& values = other->get_data().m_value;
+            if (values.size() != c.get_value().size())
+                return false;
+            for (unsigned i = 0; i < values.size(); ++i)
+                if (values[i] != c.get_value()[i])
+                    return false;
+        }
+        return true;
+    }
+
+    bool theory_trau::same_non_fresh_vars(obj_map<expr, int> const& lhs, obj_map<expr, int> const& rhs){
+        if (lhs.size() != rhs.size())
+            return false;
+        for (const auto& v : lhs) {
+            int val = 0;
+            if (!rhs.find(v.m_key, val) || val != v.m_value)
+                return false;
+        }
+        return true;
+    }
+
     bool theory_trau::eval_str_int(){
         STRACE("str", tout << __LINE__ <<  " *** " << __FUNCTION__ << std::endl;);
         bool addedAxioms = false;
@@ -3396,26 +3783,137 @@ namespace smt {
         }
 
         if (string_int_conversion_terms.size() > 0 && str_int_bound == rational(0)) {
-            str_int_bound = rational(10);
-            assert_axiom(createEqualOP(get_bound_str_int_control_var(), mk_int(str_int_bound)));
-            if (str_int_bound >= max_str_int_bound)
-                implied_facts.push_back(createEqualOP(get_bound_str_int_control_var(), mk_int(str_int_bound)));
+            str_int_bound = str_int_start_bound;
+            assert_str_int_bound();
+            addedAxioms = true;
+            newConstraintTriggered = true;
+        }
+        else if (string_int_conversion_terms.size() > 0 && str_int_bound_refuted()){
+            grow_str_int_bound();
+            assert_str_int_bound();
             addedAxioms = true;
-            need_change = false;
             newConstraintTriggered = true;
         }
-        else if (string_int_conversion_terms.size() > 0 && need_change && str_int_bound < max_str_int_bound){
-            str_int_bound = str_int_bound * rational(2);
-            assert_axiom(createEqualOP(get_bound_str_int_control_var(), mk_int(str_int_bound)));
-            if (str_int_bound >= max_str_int_bound)
-                implied_facts.push_back(createEqualOP(get_bound_str_int_control_var(), mk_int(str_int_bound)));
+        else if (string_int_conversion_terms.size() > 0 && decide_str_int_bound()){
+            // the bound literal went away with the scopes it was created in
             addedAxioms = true;
-            need_change = false;
             newConstraintTriggered = true;
         }
         return addedAxioms;
     }
 
+    /*
+     * A check follows an earlier one on this context. The string-integer bound asserted in
+     * the earlier search went away with its scopes, so the first final check asserts the
+     * bound again: the one reached so far under warm start, the initial one otherwise.
+     * Under warm start, the lengths of the last model are also decided first, with their
+     * cached phase set to true. A refuted length is flipped by the search as usual.
+     * The length atoms are internalized here, as those of popped scopes are gone.
+     */
+    void theory_trau::restart_search(){
+        context& ctx = get_context();
+        bool warm = m_params.m_TrauWarmStart;
+        if (warm && str_int_bound.is_pos())
+            str_int_start_bound = str_int_bound;
+        str_int_bound = rational(0);
+        str_int_bound_lit = nullptr;
+        if (!warm)
+            return;
+
+        expr_ref_vector hints(m);
+        for (unsigned i = 0; i < m_warm_vars.size(); ++i) {
+            expr* v = m_warm_vars.get(i);
+            // variables of popped scopes are gone
+            if (!ctx.e_internalized(v))
+                continue;
+            hints.push_back(createEqualOP(mk_strlen(v), mk_int(m_warm_lens[i])));
+        }
+        m_stats.m_warm_start_hints += force_decisions(hints);
+    }
+
+    /*
+     * Make the unassigned literals the next decisions, with phase true. Returns their number.
+     */
+    unsigned theory_trau::force_decisions(expr_ref_vector const& lits){
+        context& ctx = get_context();
+        unsigned forced = 0;
+        double max_act = 0.0;
+        for (expr* lit : lits) {
+            if (!ctx.b_internalized(lit))
+                ctx.internalize(lit, false);
+            bool_var bv = ctx.get_bool_var(lit);
+            if (ctx.get_assignment(bv) != l_undef)
+                continue;
+            if (forced++ == 0)
+                for (double act : ctx.get_activity_vector())
+                    max_act = std::max(max_act, act);
+            ctx.mark_as_relevant(lit);
+            add_theory_aware_branching_info(lit, 1.0, l_true);
+            ctx.force_phase(bv, true);
+            ctx.set_activity(bv, max_act);
+            ctx.activity_changed(bv, true);
+        }
+        return forced;
+    }
+
+    /*
+     * Set up the literal of the current string-integer bound. The bounded encodings are
+     * implied by it. Below the maximum it is only decided true, so a refutation that needs
+     * the bound learns a clause with its negation, while lemmas that do not mention it stay
+     * when the bound grows. The maximal bound is asserted, as it cannot grow any more.
+     */
+    void theory_trau::assert_str_int_bound(){
+        str_int_bound_lit = createEqualOP(get_bound_str_int_control_var(), mk_int(str_int_bound));
+        str_int_bound_conflicts = get_context().get_num_conflicts();
+        if (str_int_bound >= max_str_int_bound) {
+            assert_axiom(str_int_bound_lit);
+            implied_facts.push_back(str_int_bound_lit);
+        }
+        else
+            decide_str_int_bound();
+    }
+
+    /*
+     * Make the bound literal the next decision, with phase true. False if it is already assigned.
+     */
+    bool theory_trau::decide_str_int_bound(){
+        if (!str_int_bound_lit || str_int_bound >= max_str_int_bound)
+            return false;
+        expr_ref_vector lits(m);
+        lits.push_back(str_int_bound_lit);
+        return force_decisions(lits) > 0;
+    }
+
+    /*
+     * The bound literal is false: a refutation depended on the current bound.
+     */
+    bool theory_trau::str_int_bound_refuted(){
+        if (!str_int_bound_lit || str_int_bound >= max_str_int_bound)
+            return false;
+        context& ctx = get_context();
+        return ctx.b_internalized(str_int_bound_lit) && ctx.get_assignment(str_int_bound_lit.get()) == l_false;
+    }
+
+    bool theory_trau::str_int_bound_holds(){
+        if (!str_int_bound_lit)
+            return true;
+        context& ctx = get_context();
+        return ctx.b_internalized(str_int_bound_lit) && ctx.get_assignment(str_int_bound_lit.get()) == l_true;
+    }
+
+    /*
+     * A bound refuted within a few conflicts is far from enough, so it grows four times;
+     * otherwise it doubles.
+     */
+    void theory_trau::grow_str_int_bound(){
+        unsigned const cheap_conflicts = 64;
+        unsigned spent = get_context().get_num_conflicts() - str_int_bound_conflicts;
+        rational factor(spent <= cheap_conflicts ? 4 : 2);
+        STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << " bound " << str_int_bound << " refuted after " << spent << " conflicts" << std::endl;);
+        str_int_bound = std::min(str_int_bound * factor, max_str_int_bound);
+        m_stats.m_str_int_bound_refutations++;
+    }
+
     bool theory_trau::eval_disequal_str_int(){
         STRACE("str", tout << __LINE__ <<  " *** " << __FUNCTION__ << std::endl;);
         bool added_axioms = false;
@@ -3782,6 +4280,7 @@ namespace smt {
     bool theory_trau::refined_init_chain_free(
             obj_map<expr, int> &non_fresh_vars,
             obj_map<expr, ptr_vector<expr>> &eq_combination){
+        scoped_watch _sw(m_chain_free_watch);
         sigma_domain = collect_char_domain_from_eqmap(eq_combination);
         STRACE("str", tout << __LINE__ <<  " current time used: " << ":  " << ((float)(clock() - startClock))/CLOCKS_PER_SEC << std::endl;);
         expr_ref_vector notImportant(m);
@@ -3988,7 +4487,9 @@ namespace smt {
     }
 
     /*
-     * two branches are equal if SAT core of a branch is TRUE in the other branch
+     * two branches are equal if SAT core of a branch is TRUE in the other branch;
+     * a branch encoded under another string-integer bound is not reused, as its encodings are off;
+     * completed branches at the same eq_state_hash are compared before the others
      */
     bool theory_trau::is_completed_branch(bool &addAxiom, expr_ref_vector &diff){
         
@@ -3996,7 +4497,7 @@ namespace smt {
         expr_ref_vector guessed_eqs(m), guessed_diseqs(m);
         fetch_guessed_exprs_with_scopes(guessed_eqs, guessed_diseqs);
 
-        if (at_same_eq_state(uState, diff) && at_same_diseq_state(guessed_eqs, guessed_diseqs, uState.disequalities)) {
+        if (uState.str_int_bound == str_int_bound && at_same_eq_state(uState, diff) && at_same_diseq_state(guessed_eqs, guessed_diseqs, uState.disequalities())) {
             if (uState.reassertDisEQ && uState.reassertEQ) {
                 STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << " DONE eqLevel = " << uState.eqLevel << "; diseqLevel = " << uState.diseqLevel << std::endl;);
                 return true;
@@ -4023,18 +4524,118 @@ namespace smt {
         }
         else {
             STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << " completed state " << completed_branches.size() << std::endl;);
-            // check all completed state, skip the last one
-            for (int i = 0; i < (int)completed_branches.size() - 1; ++i){
-                STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << " comparing with completed state " << uState.eqLevel << std::endl;);
-                if (at_same_eq_state(completed_branches[i], diff) && at_same_diseq_state(guessed_eqs, guessed_diseqs, completed_branches[i].disequalities)){
-                    STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << " eq with completed state " << uState.eqLevel << std::endl;);
-                    return true;
+            // completed states reached at the same eq state are the likely hits, compare them first
+            u_map<unsigned> compared;   // branch -> first entry of its diff in compared_diff
+            expr_ref_vector compared_diff(m);
+            unsigned_vector compared_diff_end;
+            auto const* same_state = completed_branch_index.find_core(eq_state_hash(guessed_eqs, guessed_diseqs));
+            if (same_state != nullptr) {
+                for (unsigned i : same_state->get_data().m_value) {
+                    if (i + 1 >= completed_branches.size() || completed_branches[i].str_int_bound != str_int_bound)
+                        continue;
+                    compared.insert(i, compared_diff_end.size());
+                    if (is_same_completed_branch(i, guessed_eqs, guessed_diseqs, compared_diff))
+                        return true;
+                    compared_diff_end.push_back(compared_diff.size());
+                }
+            }
+
+            // check all completed state, skip the last one; a branch compared above only replays its diff
+            for (unsigned i = 0; i + 1 < completed_branches.size(); ++i) {
+                if (completed_branches[i].str_int_bound != str_int_bound)
+                    continue;
+                unsigned k;
+                if (compared.find(i, k)) {
+                    for (unsigned j = k == 0 ? 0 : compared_diff_end[k - 1]; j < compared_diff_end[k]; ++j)
+                        diff.push_back(compared_diff.get(j));
+                    continue;
                 }
+                if (is_same_completed_branch(i, guessed_eqs, guessed_diseqs, diff))
+                    return true;
             }
         }
         return false;
     }
 
+    bool theory_trau::is_same_completed_branch(unsigned i, expr_ref_vector const& guessed_eqs, expr_ref_vector const& guessed_diseqs, expr_ref_vector &diff){
+        STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << " comparing with completed state " << uState.eqLevel << std::endl;);
+        expr_ref_vector prev_guessed_eqs(m);
+        fetch_guessed_exprs_from_cache(i, prev_guessed_eqs);
+        if (at_same_eq_state(completed_branches[i], prev_guessed_eqs, diff) && at_same_diseq_state(guessed_eqs, guessed_diseqs, completed_branches[i].disequalities())){
+            STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << " eq with completed state " << uState.eqLevel << std::endl;);
+            m_stats.m_completed_branch_hits++;
+            return true;
+        }
+        return false;
+    }
+
+    /*
+     * The equality part of the core of a branch only depends on the branch, so it is computed once here
+     * instead of on every comparison with the branch.
+     */
+    void theory_trau::add_completed_branch(UnderApproxState const& state){
+        expr_ref_vector guessed_eqs(m), guessed_diseqs(m);
+        fetch_guessed_exprs_with_scopes(guessed_eqs, guessed_diseqs);
+        unsigned h = eq_state_hash(guessed_eqs, guessed_diseqs);
+        completed_branch_index.insert_if_not_there2(h, unsigned_vector())->get_data().m_value.push_back(completed_branches.size());
+        completed_branches.push_back(state);
+        completed_branch_core* c = alloc(completed_branch_core, m);
+        c->m_vars.append(collect_all_vars_in_eq_combination(state.eq_combination()));
+        add_equalities_to_core(state.equalities(), c->m_vars, c->m_eqs);
+        completed_branch_cores.push_back(c);
+    }
+
+    /*
+     * Index of is_completed_branch: a hash of the eq classes of the sides of the guessed equalities,
+     * each side with the least member of its class, and of the guessed disequalities, both sorted.
+     * Branches completed at the same hash are compared first; the others are still compared after them,
+     * so the hash only orders the comparisons.
+     */
+    unsigned theory_trau::eq_state_hash(expr_ref_vector const& guessed_eqs, expr_ref_vector const& guessed_diseqs){
+        svector<std::pair<unsigned, unsigned>> members;
+        for (expr* e : guessed_eqs) {
+            expr *lhs = nullptr, *rhs = nullptr;
+            if (!m.is_eq(e, lhs, rhs))
+                continue;
+            members.push_back(std::make_pair(eq_class_min(lhs)->get_id(), lhs->get_id()));
+            members.push_back(std::make_pair(eq_class_min(rhs)->get_id(), rhs->get_id()));
+        }
+        std::sort(members.begin(), members.end());
+
+        unsigned_vector diseqs;
+        for (expr* e : guessed_diseqs)
+            diseqs.push_back(e->get_id());
+        std::sort(diseqs.begin(), diseqs.end());
+
+        unsigned h = members.size();
+        for (unsigned i = 0; i < members.size(); ++i)
+            if (i == 0 || members[i] != members[i - 1])
+                h = combine_hash(h, hash_u_u(members[i].first, members[i].second));
+        h = combine_hash(h, diseqs.size());
+        for (unsigned i = 0; i < diseqs.size(); ++i)
+            if (i == 0 || diseqs[i] != diseqs[i - 1])
+                h = combine_hash(h, diseqs[i]);
+        return h;
+    }
+
+    /*
+     * the member of the eq class of e with the least id, which does not depend on the merge order
+     */
+    expr* theory_trau::eq_class_min(expr* e){
+        context& ctx = get_context();
+        if (!ctx.e_internalized(e))
+            return e;
+        enode* n = ctx.get_enode(e);
+        expr* ret = e;
+        enode* curr = n;
+        do {
+            if (curr->get_owner()->get_id() < ret->get_id())
+                ret = curr->get_owner();
+            curr = curr->get_next();
+        } while (curr != n);
+        return ret;
+    }
+
     /*
      *
      */
@@ -4569,16 +5170,19 @@ namespace smt {
      * In such cases, we are still the same "core" branch.
      */
     bool theory_trau::at_same_eq_state(UnderApproxState const& state, expr_ref_vector &diff) {
+        expr_ref_vector prev_guessed_eqs(m);
+        fetch_guessed_exprs_from_cache(state, prev_guessed_eqs);
+        return at_same_eq_state(state, prev_guessed_eqs, diff);
+    }
+
+    bool theory_trau::at_same_eq_state(UnderApproxState const& state, expr_ref_vector const& prev_guessed_eqs, expr_ref_vector &diff) {
         STRACE("str", tout << __LINE__ <<  " " << __FUNCTION__ << std::endl;);
         
         expr_ref_vector guessed_eqs(m),  guessed_diseqs(m);
         fetch_guessed_exprs_with_scopes(guessed_eqs, guessed_diseqs);
         guessed_eqs.append(guessed_diseqs);
 
-        expr_ref_vector prev_guessed_eqs(m);
-        fetch_guessed_exprs_from_cache(state, prev_guessed_eqs);
-
-        if (state.equalities.size() == 0 && state.disequalities.size() == 0)
+        if (state.equalities().size() == 0 && state.disequalities().size() == 0)
             return false;
 
         // compare all eq
@@ -4818,12 +5422,31 @@ namespace smt {
         STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << std::endl;);
         
         expr_ref_vector ands(m);
+        vector<ptr_vector<expr>> nodes;
+        svector<bool> has_contain_var;
         for (const auto &v : eq_combination)
             if (v.get_value().size() > 1) {
-                ptr_vector<expr> tmpVector = v.get_value();
+                ptr_vector<expr> const& tmpVector = v.get_value();
+                // split each concat once; only pairs with a contains prefix var can give an equation
+                nodes.reset();
+                has_contain_var.reset();
+                bool any_contain_var = false;
+                for (expr* e : tmpVector) {
+                    nodes.push_back(ptr_vector<expr>());
+                    get_nodes_in_concat(e, nodes.back());
+                    bool found = false;
+                    for (expr* n : nodes.back())
+                        found |= has_var_kind(n, VAR_CONTAIN);
+                    has_contain_var.push_back(found);
+                    any_contain_var |= found;
+                }
+                if (!any_contain_var)
+                    continue;
                 for (unsigned i = 0; i < tmpVector.size(); ++i)
                     for (unsigned j = i + 1; j < tmpVector.size(); ++j) {
-                        expr* tmp = create_equations_over_contain_vars(tmpVector[i], tmpVector[j]);
+                        if (!has_contain_var[i] && !has_contain_var[j])
+                            continue;
+                        expr* tmp = create_equations_over_contain_vars(tmpVector[i], tmpVector[j], nodes[i], nodes[j]);
                         if (tmp != nullptr)
                             ands.push_back(tmp);
                     }
@@ -4848,13 +5471,8 @@ namespace smt {
      * x = y . replace1 . "A" . ...
      * --> indexOf1 = replace1
      */
-    expr* theory_trau::create_equations_over_contain_vars(expr* x, expr* y){
+    expr* theory_trau::create_equations_over_contain_vars(expr* x, expr* y, ptr_vector<expr> const& nodes_x, ptr_vector<expr> const& nodes_y){
         STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << std::endl;);
-        ptr_vector<expr> nodes_x;
-        get_nodes_in_concat(x, nodes_x);
-
-        ptr_vector<expr> nodes_y;
-        get_nodes_in_concat(y, nodes_y);
 
         // remove all prefixes
         unsigned pos = 0;
@@ -4866,10 +5484,8 @@ namespace smt {
         if (pos >= std::min(nodes_x.size(), nodes_y.size()) - 1)
             return nullptr;
         else {
-            std::string name_x = expr2str(nodes_x[pos]);
-            std::string name_y = expr2str(nodes_y[pos]);
-            bool is_pre_contain_x = (name_x.find("indexOf1") == 0 || name_x.find("replace1") == 0 || name_x.find("pre_contain") == 0 );
-            bool is_pre_contain_y = (name_y.find("indexOf1") == 0 || name_y.find("replace1") == 0 || name_y.find("pre_contain") == 0 );
+            bool is_pre_contain_x = has_var_kind(nodes_x[pos], VAR_CONTAIN);
+            bool is_pre_contain_y = has_var_kind(nodes_y[pos], VAR_CONTAIN);
 
             zstring tmp01;
             zstring tmp02;
@@ -4985,11 +5601,7 @@ namespace smt {
     }
 
     bool theory_trau::are_equal_exprs(expr* x, expr* y){
-        expr_ref_vector eqs(m);
-        collect_eq_nodes(x, eqs);
-        if (eqs.contains(y))
-            return true;
-        return false;
+        return get_eqc_root(x) == get_eqc_root(y);
     }
 
     obj_hashtable<expr> theory_trau::get_eqc_roots(){
@@ -5579,6 +6191,7 @@ namespace smt {
             uState.str_int_bound = str_int_bound;
         }
 
+        m_stats.m_underapprox_rounds++;
         init_underapprox(eq_combination, non_fresh_vars);
         for (const auto& n : non_fresh_vars)
             STRACE("str", tout << __LINE__ <<  " *** " << __FUNCTION__ << " " << mk_pp(n.m_key, m) << " " << n.m_value << std::endl;);
@@ -5587,9 +6200,11 @@ namespace smt {
 
         bool axiomAdded = handle_str_int();
         guessed_eqs.append(diff);
-        axiomAdded = convert_equalities(eq_combination, non_fresh_vars, createAndOP(guessed_eqs)) || axiomAdded;
+        m_convert_watch.start();
+        axiomAdded = convert_equalities(eq_combination, non_fresh_vars, guessed_eqs) || axiomAdded;
+        m_convert_watch.stop();
         STRACE("str", tout << __LINE__ <<  " current time used: " << ":  " << ((float)(clock() - startClock))/CLOCKS_PER_SEC << std::endl;);
-        completed_branches.push_back(uState);
+        add_completed_branch(uState);
         return axiomAdded;
     }
 
@@ -5598,11 +6213,8 @@ namespace smt {
         fetch_guessed_exprs_from_cache(uState, corePrev);
 
         // update guessed exprs
-        uState.equalities.reset();
-        uState.equalities.append(guessed_eqs);
-
-        uState.disequalities.reset();
-        uState.disequalities.append(guessed_diseqs);
+        uState.set_equalities(guessed_eqs);
+        uState.set_disequalities(guessed_diseqs);
 
         bool axiomAdded = false;
         if (is_equal(corePrev, guessed_eqs)) {
@@ -5687,6 +6299,8 @@ namespace smt {
             return;
         }
 
+        expr* conversion = createEqualOP(num, u.str.mk_stoi(str));
+        assert_str_int_exact_lens(conversion, num, str);
         expr* unrollConstraint = unroll_str_int(num, str);
 //        expr* lenConstraint = lower_bound_str_int(num, str);
         expr* boundConstraint = createEqualOP(get_bound_str_int_control_var(), mk_int(str_int_bound));
@@ -5701,7 +6315,7 @@ namespace smt {
 
         expr_ref_vector premises(m);
         premises.push_back(boundConstraint);
-        premises.push_back(createEqualOP(num, u.str.mk_stoi(str)));
+        premises.push_back(conversion);
 
         expr* to_assert = rewrite_implication(createAndOP(premises), createAndOP(conclusions));
         assert_axiom(to_assert);
@@ -5765,6 +6379,8 @@ namespace smt {
             return;
         }
 
+        expr* conversion = createEqualOP(str, u.str.mk_itos(num));
+        assert_str_int_exact_lens(conversion, num, str);
         expr* unrollConstraint = unroll_str_int(num, str);
         expr* lenConstraint = lower_bound_int_str(num, str);
         expr* boundConstraint = createEqualOP(get_bound_str_int_control_var(), mk_int(str_int_bound));
@@ -5781,7 +6397,7 @@ namespace smt {
 
         expr_ref_vector premises(m);
         premises.push_back(boundConstraint);
-        premises.push_back(createEqualOP(str, u.str.mk_itos(num)));
+        premises.push_back(conversion);
 
         expr* to_assert = rewrite_implication(createAndOP(premises), createAndOP(conclusions));
         assert_axiom(to_assert);
@@ -5827,7 +6443,7 @@ namespace smt {
         STRACE("str", tout << __LINE__ <<  " *** " << __FUNCTION__ << " " << mk_pp(n, m) << std::endl;);
         rational ten(10);
         rational zero(0);
-        rational zeroChar(48);
+        rational zeroChar(char_code('0'));
         rational coeff(1);
         expr_ref_vector adds(m);
         rational pos = str_int_bound - rational(1);
@@ -5843,64 +6459,119 @@ namespace smt {
         return createAddOP(adds);
     }
 
+    /*
+     * num for strings of at least str_int_bound characters, read from their last
+     * str_int_bound positions. Shorter strings are handled by assert_str_int_exact_lens,
+     * whose axioms do not depend on the bound and survive when it grows.
+     */
     expr* theory_trau::unroll_str_int(expr* num, expr* str){
         
         STRACE("str", tout << __LINE__ <<  " *** " << __FUNCTION__ << " " << mk_pp(str, m) << std::endl;);
+        if (is_char_at(str))
+            return m.mk_true();
+
         rational ten(10);
         rational one(1);
         rational zero(0);
-        rational zeroChar(48);
+        rational zeroChar(char_code('0'));
         rational pos = str_int_bound - one;
         expr* arr = get_var_flat_array(str);
         SASSERT(arr);
         expr* strLen = mk_strlen(str);
-        expr_ref_vector ands(m);
-        ands.push_back(rewrite_implication(createEqualOP(strLen, mk_int(0)), createEqualOP(num, mk_int(- 1))));
-
-
-        expr_ref_vector ands_tmp(m);
-        rational consider_len = str_int_bound;
 
-        if (is_char_at(str))
-            consider_len = one;
-
-        for (rational len = one; len <= consider_len; len = len + one) {
-            expr_ref_vector adds(m);
-            rational pos = len - one;
-            rational coeff(1);
-            while (pos >= zero) {
-                expr* at_pos = nullptr;
-                if (len == str_int_bound) {
-                    expr_ref_vector adds_tmp(m);
-                    adds_tmp.push_back(strLen);
-                    rational tmp = rational(-1) * str_int_bound + pos;
-                    adds_tmp.push_back(mk_int(tmp));
-                    at_pos = createSelectOP(arr, createAddOP(adds_tmp));
-                }
-                else
-                    at_pos = createSelectOP(arr, mk_int(pos));
-                adds.push_back(createMulOP(at_pos, mk_int(coeff)));
-                rational base = zeroChar * coeff * rational(-1);
-                adds.push_back(mk_int(base));
-                pos = pos - 1;
-                coeff = coeff * ten;
-            }
-
-            expr* premise = nullptr;
-            if (len == str_int_bound)
-                premise = createGreaterEqOP(strLen, mk_int(len));
-            else
-                premise = createEqualOP(strLen, mk_int(len));
-            expr* conclusion = createEqualOP(num, createAddOP(adds));
-            ands_tmp.push_back(rewrite_implication(premise, conclusion));
+        expr_ref_vector adds(m);
+        rational coeff(1);
+        while (pos >= zero) {
+            expr_ref_vector adds_tmp(m);
+            adds_tmp.push_back(strLen);
+            rational tmp = rational(-1) * str_int_bound + pos;
+            adds_tmp.push_back(mk_int(tmp));
+            expr* at_pos = createSelectOP(arr, createAddOP(adds_tmp));
+            adds.push_back(createMulOP(at_pos, mk_int(coeff)));
+            rational base = zeroChar * coeff * rational(-1);
+            adds.push_back(mk_int(base));
+            pos = pos - 1;
+            coeff = coeff * ten;
         }
 
-        // if !valid --> value = -1, else ands_tmp
+        // if !valid --> value = -1, else the sum
         expr* valid_s2i = valid_str_int(str);
         STRACE("str", tout << __LINE__ <<  " *** " << __FUNCTION__ << " valid_s2i: " << mk_pp(valid_s2i, m) << std::endl;);
-        ands.push_back(rewrite_implication(valid_s2i, createAndOP(ands_tmp)));
+        expr_ref_vector ands(m);
+        ands.push_back(rewrite_implication(valid_s2i, createEqualOP(num, createAddOP(adds))));
         ands.push_back(rewrite_implication(mk_not(m, valid_s2i), createEqualOP(num, mk_int(- 1))));
-        return createAndOP(ands);
+        return rewrite_implication(createGreaterEqOP(strLen, mk_int(str_int_bound)), createAndOP(ands));
+    }
+
+    /*
+     * Value and digit terms of the first len positions of arr. Each position adds
+     * one step, value(l) = 10 * value(l - 1) + digit(l - 1), to the terms already built.
+     */
+    theory_trau::str_int_unrolling& theory_trau::get_str_int_unrolling(expr* arr, unsigned len){
+        str_int_unrolling* u_arr = nullptr;
+        if (!str_int_unrollings.find(arr, u_arr)) {
+            u_arr = alloc(str_int_unrolling, m);
+            str_int_unrolling_store.push_back(u_arr);
+            m_trail.push_back(arr);
+            str_int_unrollings.insert(arr, u_arr);
+        }
+        rational zeroChar(char_code('0'));
+        for (unsigned l = u_arr->m_values.size() + 1; l <= len; ++l) {
+            expr* at_pos = createSelectOP(arr, mk_int(l - 1));
+            expr_ref_vector adds(m);
+            if (l > 1)
+                adds.push_back(createMulOP(u_arr->m_values.get(l - 2), mk_int(10)));
+            adds.push_back(at_pos);
+            rational base = -zeroChar;
+            adds.push_back(mk_int(base));
+            u_arr->m_values.push_back(createAddOP(adds));
+
+            expr_ref_vector digit(m);
+            if (l > 1)
+                digit.push_back(u_arr->m_valid.get(l - 2));
+            digit.push_back(createGreaterEqOP(at_pos, mk_char('0')));
+            digit.push_back(createLessEqOP(at_pos, mk_char('9')));
+            u_arr->m_valid.push_back(createAndOP(digit));
+        }
+        return *u_arr;
+    }
+
+    /*
+     * conversion /\ len(str) = l --> num is the value of the l characters of str, or -1,
+     * for the lengths below str_int_bound that were not asserted before. The axioms hold
+     * for every bound, so a larger bound only adds the lengths it uncovers.
+     */
+    void theory_trau::assert_str_int_exact_lens(expr* conversion, expr* num, expr* str){
+        unsigned limit = is_char_at(str) ? 2 : static_cast<unsigned>(str_int_bound.get_int64());
+        expr* arr = get_var_flat_array(str);
+        SASSERT(arr);
+        unsigned done = 0;
+        str_int_exact_lens.find(conversion, arr, done);
+        if (done >= limit)
+            return;
+        expr* strLen = mk_strlen(str);
+        str_int_unrolling& digits = get_str_int_unrolling(arr, limit - 1);
+        for (unsigned l = done; l < limit; ++l) {
+            expr_ref_vector premises(m);
+            premises.push_back(conversion);
+            premises.push_back(createEqualOP(strLen, mk_int(l)));
+            expr* conclusion = nullptr;
+            if (l == 0)
+                conclusion = createEqualOP(num, mk_int(-1));
+            else {
+                expr_ref_vector ands(m);
+                expr* valid = digits.m_valid.get(l - 1);
+                ands.push_back(rewrite_implication(valid, createEqualOP(num, digits.m_values.get(l - 1))));
+                ands.push_back(rewrite_implication(mk_not(m, valid), createEqualOP(num, mk_int(-1))));
+                conclusion = createAndOP(ands);
+            }
+            expr* to_assert = rewrite_implication(createAndOP(premises), conclusion);
+            assert_axiom(to_assert);
+            implied_facts.push_back(to_assert);
+        }
+        if (done == 0)
+            m_trail.push_back(conversion);
+        str_int_exact_lens.insert(conversion, arr, limit);
     }
 
     expr* theory_trau::valid_str_int(expr* str){
@@ -5910,10 +6581,10 @@ namespace smt {
             expr_ref_vector conclusions(m);
             conclusions.push_back(createGreaterEqOP(
                     createSelectOP(arr, mk_int(0)),
-                    mk_int('0')));
+                    mk_char('0')));
             conclusions.push_back(createLessEqOP(
                     createSelectOP(arr, mk_int(0)),
-                    mk_int('9')));
+                    mk_char('9')));
             return createAndOP(conclusions);
         }
         else {
@@ -5927,10 +6598,10 @@ namespace smt {
                 expr_ref_vector conclusions(m);
                 conclusions.push_back(createGreaterEqOP(
                         createSelectOP(arr, mk_int(i)),
-                        mk_int('0')));
+                        mk_char('0')));
                 conclusions.push_back(createLessEqOP(
                         createSelectOP(arr, mk_int(i)),
-                        mk_int('9')));
+                        mk_char('9')));
                 ands.push_back(rewrite_implication(premise, createAndOP(conclusions)));
             }
 
@@ -5942,10 +6613,10 @@ namespace smt {
                 expr_ref_vector conclusions(m);
                 conclusions.push_back(createGreaterEqOP(
                         createSelectOP(arr, pos),
-                        mk_int('0')));
+                        mk_char('0')));
                 conclusions.push_back(createLessEqOP(
                         createSelectOP(arr, pos),
-                        mk_int('9')));
+                        mk_char('9')));
                 ands.push_back(rewrite_implication(premise, createAndOP(conclusions)));
             }
             return createAndOP(ands);
@@ -6041,7 +6712,7 @@ namespace smt {
 
         rational one(1);
         rational len = str_int_bound;
-        rational zero_char(48);
+        rational zero_char(char_code('0'));
         expr* zero_e = mk_int(zero_char);
         expr* arr = get_var_flat_array(str);
         expr* len_n = mk_strlen(str);
@@ -6088,21 +6759,21 @@ namespace smt {
     bool theory_trau::is_equal(UnderApproxState const& preState, UnderApproxState const& currState){
         return false;
 
-        obj_map<expr, ptr_vector<expr>> _eq_combination = preState.eq_combination;
+        obj_map<expr, ptr_vector<expr>> const& _eq_combination = preState.eq_combination();
 
-        if (_eq_combination.size() != currState.eq_combination.size()) {
-            STRACE("str", tout << __LINE__ <<  " *** " << __FUNCTION__ << ": " << _eq_combination.size() << " vs " << currState.eq_combination.size() <<  std::endl;);
+        if (_eq_combination.size() != currState.eq_combination().size()) {
+            STRACE("str", tout << __LINE__ <<  " *** " << __FUNCTION__ << ": " << _eq_combination.size() << " vs " << currState.eq_combination().size() <<  std::endl;);
             return false;
         }
 
-        for (const auto& v : currState.non_fresh_vars)
-            if (!preState.non_fresh_vars.contains(v.m_key)) {
+        for (const auto& v : currState.non_fresh_vars())
+            if (!preState.non_fresh_vars().contains(v.m_key)) {
                 expr_ref_vector eqs(m);
                 collect_eq_nodes(v.m_key, eqs);
                 bool found = false;
                 for (const auto& eq : eqs)
                     // check if there are any equivalent variables
-                    if (preState.non_fresh_vars.contains(eq)) {
+                    if (preState.non_fresh_vars().contains(eq)) {
                         found = true;
                         break;
                     }
@@ -6115,7 +6786,7 @@ namespace smt {
 
         expr_ref_vector checked(m);
 
-        for (const auto& n : currState.eq_combination) {
+        for (const auto& n : currState.eq_combination()) {
             ptr_vector <expr> comb;
             if (_eq_combination.contains(n.m_key)) {
                 comb.append(_eq_combination[n.m_key]);
@@ -6149,12 +6820,12 @@ namespace smt {
             }
         }
 
-        if (currState.eq_combination.size() < preState.eq_combination.size()) {
+        if (currState.eq_combination().size() < preState.eq_combination().size()) {
             // check if all missing combinations are trivial
-            for (const auto& n : preState.eq_combination)
+            for (const auto& n : preState.eq_combination())
                 if (!checked.contains(n.m_key)) {
                     // it is not in curr_state.eq_combination
-                    if (!is_trivial_combination(n.m_key, n.get_value(), currState.non_fresh_vars))
+                    if (!is_trivial_combination(n.m_key, n.get_value(), currState.non_fresh_vars()))
                         return false;
                 }
         }
@@ -6219,11 +6890,11 @@ namespace smt {
         expr* causexpr = createAndOP(guessed_exprs);
 
         STRACE("str", tout << __LINE__ <<  " *** " << __FUNCTION__ << " *** eqLevel = " << uState.eqLevel << "; bound = " << uState.str_int_bound << " @lvl " << m_scope_level << std::endl;);
-        if (uState.asserting_constraints.size() > 0)
+        if (uState.asserting_constraints().size() > 0)
             init_underapprox_cached();
         bool axiomAdded = false;
 
-//        for (const auto& a : uState.asserting_constraints){
+//        for (const auto& a : uState.asserting_constraints()){
 //            axiomAdded = true;
 //            ensure_enode(a);
 //
@@ -6235,11 +6906,12 @@ namespace smt {
 //        }
 
         STRACE("str", tout << __LINE__ <<  " *** " << __FUNCTION__ << " *** completed_branches" << completed_branches.size() << std::endl;);
-        for (const auto& b : completed_branches){
+        for (unsigned i = 0; i < completed_branches.size(); ++i){
+            UnderApproxState const& b = completed_branches[i];
             expr_ref_vector b_guessed_exprs(m);
-            fetch_guessed_exprs_from_cache(b, b_guessed_exprs);
+            fetch_guessed_exprs_from_cache(i, b_guessed_exprs);
             causexpr = createAndOP(b_guessed_exprs);
-            for (const auto& a : b.asserting_constraints){
+            for (const auto& a : b.asserting_constraints()){
                 axiomAdded = true;
                 ensure_enode(a);
 
@@ -6281,7 +6953,7 @@ namespace smt {
 
     void theory_trau::handle_disequalities_cached(){
         for (const auto& b : completed_branches) {
-            for (const auto &wi : b.disequalities) {
+            for (const auto &wi : b.disequalities()) {
                 SASSERT(to_app(wi)->get_num_args() == 1);
                 expr *equality = to_app(wi)->get_arg(0);
 
@@ -6538,7 +7210,7 @@ namespace smt {
             for (unsigned i = 0; i < rhs.length(); ++i) {
                 expr_ref_vector subcases(m);
                 subcases.push_back(createGreaterEqOP(lenLhs.get(), m_autil.mk_int(i + 1)));
-                expr_ref tmp(createEqualOP(createSelectOP(arrLhs, m_autil.mk_int(i)), m_autil.mk_int(rhs[i])), m);
+                expr_ref tmp(createEqualOP(createSelectOP(arrLhs, m_autil.mk_int(i)), mk_char(rhs[i])), m);
                 subcases.push_back(mk_not(m, tmp));
                 cases.push_back(createAndOP(subcases));
             }
@@ -6565,7 +7237,7 @@ namespace smt {
     }
 
     void theory_trau::handle_not_contain_cached(){
-        for (const auto &wi : uState.disequalities) {
+        for (const auto &wi : uState.disequalities()) {
             expr* equality = to_app(wi)->get_arg(0);
 
             expr* lhs = to_app(equality)->get_arg(0);
@@ -6638,7 +7310,7 @@ namespace smt {
                     unsigned pos = k + i - rhs.length();
                     subcases.push_back(mk_not(m, createEqualOP(
                             createSelectOP(arr, mk_int(pos)),
-                            mk_int(rhs[k]))));
+                            mk_char(rhs[k]))));
                 }
                 cases.push_back(createOrOP(subcases));
             }
@@ -6852,16 +7524,16 @@ namespace smt {
             all_str_exprs.push_back(we.m_key);
         }
 
-        // create all tmp vars
-        for(const auto& v : all_str_exprs){
-            mk_and_setup_arr(v, non_fresh_vars);
-        }
-
         create_notcontain_map();
         create_const_set();
 
         init_connecting_size(eq_combination, non_fresh_vars, false);
         init_connecting_size(eq_combination, non_fresh_vars);
+
+        // create all tmp vars, after the connecting size bounds the regex variables
+        for(const auto& v : all_str_exprs){
+            mk_and_setup_arr(v, non_fresh_vars);
+        }
         create_appearance_map(eq_combination);
     }
 
@@ -6892,12 +7564,19 @@ namespace smt {
             else {
                 STRACE("str", tout << __LINE__ <<  " *** " << __FUNCTION__ << " *** reuse existing array " << mk_pp(v, m) << " " << mk_pp(arr_var, m) << " " << std::endl;);
                 zstring val;
+                expr* rexpr = nullptr;
                 if (u.str.is_string(v, val)) {
                     if (v != arr_linker[arr_var])
                         setup_str_const(val, arr_var, createEqualOP(v, arr_linker[arr_var]));
                     else
                         setup_str_const(val, arr_var);
                 }
+                else if (non_fresh_vars.contains(v) && is_internal_regex_var(v, rexpr)) {
+                    // the axioms of the round that made the array may have been backtracked
+                    expr *to_assert = setup_regex_var(v, rexpr, arr_var, rational(non_fresh_vars[v]), mk_int(0));
+                    assert_axiom(to_assert);
+                    implied_facts.push_back(to_assert);
+                }
                 return;
             }
         }
@@ -6938,6 +7617,7 @@ namespace smt {
                 }
                 expr *to_assert = setup_regex_var(v, rexpr, v1, rational(non_fresh_vars[v]), mk_int(0));
                 assert_axiom(to_assert);
+                implied_facts.push_back(to_assert);
             }
             else if (is_str_int_var(v)){
                 // setup_str_int_arr
@@ -6951,11 +7631,9 @@ namespace smt {
         STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << mk_pp(v, m) << std::endl;);
         expr_ref_vector ands(m);
         rational one(1);
-        rational zero((int)('0'));
-        rational nine((int)('9'));
         expr* arr = get_var_flat_array(v);
-        expr* zero_e(mk_int(zero));
-        expr* nine_e(mk_int(nine));
+        expr* zero_e(mk_char('0'));
+        expr* nine_e(mk_char('9'));
         for (rational i = one - one; i < str_int_bound; i = i + one){
             expr* rhs = leng_prefix_rhs(std::make_pair(v, start + 1), true);
             ands.push_back(createGreaterEqOP(createSelectOP(arr, createAddOP(rhs, mk_int(i))), zero_e));
@@ -6982,7 +7660,7 @@ namespace smt {
         STRACE("str", tout << __LINE__ << " " << mk_pp(arr, m) << " = " << val << std::endl;);
         expr_ref_vector ands(m);
         for (unsigned i = 0; i < val.length(); ++i){
-            ands.push_back(createEqualOP(createSelectOP(arr, mk_int(i)), mk_int(val[i])));
+            ands.push_back(createEqualOP(createSelectOP(arr, mk_int(i)), mk_char(val[i])));
         }
 
         expr* to_assert = createAndOP(ands);
@@ -7010,7 +7688,7 @@ namespace smt {
                 expr_ref_vector ands(m);
                 for (int j = 0; j < bound.get_int64(); ++j) {
                     int pos = j % elements[i].length();
-                    ands.push_back(createEqualOP(createSelectOP(arr, createAddOP(prefix, mk_int(j))), mk_int(elements[i][pos])));
+                    ands.push_back(createEqualOP(createSelectOP(arr, createAddOP(prefix, mk_int(j))), mk_char(elements[i][pos])));
                 }
 
                 expr_ref tmp01(m_autil.mk_mod(mk_strlen(var), mk_int(elements[i].length())), m);
@@ -7038,10 +7716,10 @@ namespace smt {
                     expr_ref_vector ands(m);
                     ands.push_back(createGreaterEqOP(
                             createSelectOP(arr, createAddOP(prefix, m_autil.mk_int(i))),
-                            m_autil.mk_int(charRange[j].first)));
+                            mk_char(charRange[j].first)));
                     ands.push_back(createLessEqOP(
                             createSelectOP(arr, createAddOP(prefix, m_autil.mk_int(i))),
-                            m_autil.mk_int(charRange[j].second)));
+                            mk_char(charRange[j].second)));
                     ors_range.push_back(createAndOP(ands));
                 }
                 ret.push_back(createOrOP(ors_range));
@@ -7089,7 +7767,7 @@ namespace smt {
         context & ctx = get_context();
         expr_ref_vector all_str_exprs(m);
         flat_var_counter = 0;
-        for (const auto& v : uState.eq_combination){
+        for (const auto& v : uState.eq_combination()){
             if (v.get_value().size() == 0)
                 continue;
             ensure_enode(v.m_key);
@@ -7247,7 +7925,7 @@ namespace smt {
 
     void theory_trau::create_const_set(){
         const_set.reset();
-        for (const auto _eq : uState.eq_combination) {
+        for (const auto _eq : uState.eq_combination()) {
             zstring value;
             if (u.str.is_string(_eq.m_key, value)) {
                 const_set.insert(value);
@@ -7342,52 +8020,74 @@ namespace smt {
         STRACE("str", tout << __LINE__ <<  " *** " << __FUNCTION__ << " *** " << connectingSize << std::endl;);
     }
 
+    /*
+     * Encode the equalities of eq_combination under the guessed equalities, one component at a time.
+     * The components only decide how small the clause blocking a component without arrangement is.
+     * The encodings of all components are asserted in this context and solved by one search.
+     */
     bool theory_trau::convert_equalities(obj_map<expr, ptr_vector<expr>> const& eq_combination,
                                          obj_map<expr, int> & non_fresh_vars,
-                                       expr* premise){
+                                         expr_ref_vector const& guessed_eqs){
         STRACE("str", tout << __LINE__ <<  " *** " << __FUNCTION__ << " *** " << std::endl;);
          
         curr_var_pieces_counter.reset();
         generated_equalities.reset();
+        generated_equality_terms.reset();
 
         for (const auto& n : non_fresh_vars)
             STRACE("str", tout << __LINE__ <<  " *** " << __FUNCTION__ << " " << mk_pp(n.m_key, m) << " " << n.m_value << std::endl;);
 
+        expr_ref premise(createAndOP(guessed_eqs), m);
+        vector<ptr_vector<expr>> keys, premises, vars;
+        split_eq_combination(eq_combination, guessed_eqs, keys, premises, vars);
+        m_stats.m_eq_components += keys.size();
+
         expr_ref_vector asserted_constraints(m);
         bool axiomAdded = false;
-        for (const auto& vareq : eq_combination) {
-            if (vareq.get_value().size() == 0)
-                continue;
-
-            expr* reg = nullptr;
-            if ((is_internal_regex_var(vareq.m_key, reg)) || is_non_fresh(vareq.m_key) || u.str.is_string(vareq.m_key)){
-                STRACE("str", tout << __LINE__ <<  " *** " << __FUNCTION__ << " *** " << mk_pp(vareq.m_key, m) << std::endl;);
-                expr *result = convert_const_nonfresh_equalities(vareq.m_key, vareq.get_value(), non_fresh_vars);
+        for (unsigned g = 0; g < keys.size(); ++g) {
+            auto assert_result = [&](expr* result) {
+                if (result == nullptr) {
+                    asserted_constraints.reset();
+                    // the guesses of the component only suffice if its encoding read nothing the other components decide
+                    if (is_local_component(keys[g], vars[g], eq_combination, non_fresh_vars)) {
+                        expr_ref_vector component_eqs(m);
+                        component_eqs.append(premises[g].size(), premises[g].c_ptr());
+                        expr_ref component_premise(createAndOP(component_eqs), m);
+                        negate_context(component_premise);
+                    }
+                    else
+                        negate_context(premise);
+                    return false;
+                }
                 assert_breakdown_combination(result, premise, asserted_constraints, axiomAdded);
-                if (result == nullptr)
-                    return true;
+                return true;
+            };
+
+            for (expr* key : keys[g]) {
+                ptr_vector<expr> const& value = eq_combination.find_core(key)->get_data().m_value;
+                expr* reg = nullptr;
+                if ((is_internal_regex_var(key, reg)) || is_non_fresh(key) || u.str.is_string(key)){
+                    STRACE("str", tout << __LINE__ <<  " *** " << __FUNCTION__ << " *** " << mk_pp(key, m) << std::endl;);
+                    if (!assert_result(convert_const_nonfresh_equalities(key, value, non_fresh_vars)))
+                        return true;
 
-                expr* regexExpr;
-                if (is_regex_var(vareq.m_key, regexExpr) && !is_internal_var(vareq.m_key)){
-                    STRACE("str", tout << __LINE__ <<  "  " << mk_pp(vareq.m_key, m) << " = " << mk_pp(regexExpr, m) << " " << getStdRegexStr(regexExpr) << std::endl;);
-                    convert_regex_equalities(regexExpr, vareq.m_key, non_fresh_vars, asserted_constraints, axiomAdded);
+                    expr* regexExpr;
+                    if (is_regex_var(key, regexExpr) && !is_internal_var(key)){
+                        STRACE("str", tout << __LINE__ <<  "  " << mk_pp(key, m) << " = " << mk_pp(regexExpr, m) << " " << getStdRegexStr(regexExpr) << std::endl;);
+                        convert_regex_equalities(regexExpr, key, non_fresh_vars, asserted_constraints, axiomAdded);
+                    }
+                }
+                else if (is_long_equality(value)) {
+                    /* add an eq = flat . flat . flat, then other equalities will compare with it */
+                    if (!assert_result(convert_long_equalities(key, value, non_fresh_vars)))
+                        return true;
+                }
+                else {
+                    STRACE("str", tout << __LINE__ <<  " work as usual " << std::endl;);
+                    if (!assert_result(convert_other_equalities(value, non_fresh_vars)))
+                        return true;
                 }
             }
-            else if (is_long_equality(vareq.get_value())) {
-                /* add an eq = flat . flat . flat, then other equalities will compare with it */
-                expr *result = convert_long_equalities(vareq.m_key, vareq.get_value(), non_fresh_vars);
-                assert_breakdown_combination(result, premise, asserted_constraints, axiomAdded);
-                if (result == nullptr)
-                    return true;
-            }
-            else {
-                STRACE("str", tout << __LINE__ <<  " work as usual " << std::endl;);
-                expr* result = convert_other_equalities(vareq.get_value(), non_fresh_vars);
-                assert_breakdown_combination(result, premise, asserted_constraints, axiomAdded);
-                if (result == nullptr)
-                    return true;
-            }
-
         }
 
         if (asserted_constraints.size() > 0) {
@@ -7397,6 +8097,148 @@ namespace smt {
         return axiomAdded;
     }
 
+    /*
+     * Split the non-empty entries of eq_combination into components that share no string variable.
+     * Variables are linked by the equalities of the combination, by the guessed equalities, by
+     * length relations, and all str-int variables form one component.
+     * keys[i] lists the entries of component i, premises[i] the guessed equalities over it and
+     * vars[i] its variables; guessed equalities that cannot be attributed to a component are added
+     * to every component, and a component without guessed equalities gets all of them.
+     * Components are ordered by size, so that small ones without arrangement are found first.
+     */
+    void theory_trau::split_eq_combination(obj_map<expr, ptr_vector<expr>> const& eq_combination,
+                                           expr_ref_vector const& guessed_eqs,
+                                           vector<ptr_vector<expr>> &keys,
+                                           vector<ptr_vector<expr>> &premises,
+                                           vector<ptr_vector<expr>> &vars){
+        basic_union_find uf;
+        obj_map<expr, unsigned> ids;
+        ptr_vector<expr> leaves;
+        auto mk_id = [&](expr* e) {
+            unsigned id;
+            if (!ids.find(e, id)) {
+                id = uf.mk_var();
+                ids.insert(e, id);
+            }
+            return id;
+        };
+        // merge the variables of e into the component of id, returns the id of the first one
+        auto link = [&](expr* e, unsigned id) {
+            leaves.reset();
+            get_nodes_in_concat(e, leaves);
+            for (expr* l : leaves)
+                if (!u.str.is_string(l)) {
+                    unsigned lid = mk_id(l);
+                    if (id == UINT_MAX)
+                        id = lid;
+                    else
+                        uf.merge(id, lid);
+                }
+            return id;
+        };
+
+        for (const auto& vareq : eq_combination) {
+            if (vareq.get_value().size() == 0)
+                continue;
+            unsigned id = mk_id(vareq.m_key);
+            for (expr* e : vareq.get_value())
+                link(e, id);
+        }
+
+        unsigned_vector eq_ids;
+        for (expr* e : guessed_eqs) {
+            expr *lhs = nullptr, *rhs = nullptr;
+            unsigned id = UINT_MAX;
+            if (m.is_eq(e, lhs, rhs) && m.get_sort(lhs) == u.str.mk_string_sort())
+                id = link(rhs, link(lhs, UINT_MAX));
+            eq_ids.push_back(id);
+        }
+
+        for (const auto& p : length_relation)
+            uf.merge(mk_id(p.first), mk_id(p.second));
+
+        obj_map<expr, int> str_int_vars;
+        collect_non_fresh_vars_str_int(str_int_vars);
+        unsigned str_int_id = UINT_MAX;
+        for (const auto& v : str_int_vars)
+            str_int_id = link(v.m_key, str_int_id);
+
+        // number the components in the order of eq_combination
+        u_map<unsigned> comp_of;
+        unsigned_vector sizes;
+        for (const auto& vareq : eq_combination) {
+            if (vareq.get_value().size() == 0)
+                continue;
+            unsigned root = uf.find(ids.find(vareq.m_key));
+            unsigned c;
+            if (!comp_of.find(root, c)) {
+                c = keys.size();
+                comp_of.insert(root, c);
+                keys.push_back(ptr_vector<expr>());
+                premises.push_back(ptr_vector<expr>());
+                vars.push_back(ptr_vector<expr>());
+                sizes.push_back(0);
+            }
+            keys[c].push_back(vareq.m_key);
+            sizes[c] += vareq.get_value().size();
+        }
+        for (const auto& v : ids) {
+            unsigned c;
+            if (comp_of.find(uf.find(v.m_value), c))
+                vars[c].push_back(v.m_key);
+        }
+        for (unsigned i = 0; i < guessed_eqs.size(); ++i) {
+            unsigned c;
+            if (eq_ids[i] != UINT_MAX && comp_of.find(uf.find(eq_ids[i]), c))
+                premises[c].push_back(guessed_eqs[i]);
+            else
+                for (auto& pr : premises)
+                    pr.push_back(guessed_eqs[i]);
+        }
+        // without guesses of its own, a component is only refuted together with all the guesses
+        for (auto& pr : premises)
+            if (pr.empty())
+                pr.append(guessed_eqs.size(), guessed_eqs.c_ptr());
+
+        unsigned_vector order;
+        for (unsigned c = 0; c < keys.size(); ++c)
+            order.push_back(c);
+        std::stable_sort(order.begin(), order.end(), [&](unsigned a, unsigned b) { return sizes[a] < sizes[b]; });
+        vector<ptr_vector<expr>> sorted_keys, sorted_premises, sorted_vars;
+        for (unsigned c : order) {
+            sorted_keys.push_back(keys[c]);
+            sorted_premises.push_back(premises[c]);
+            sorted_vars.push_back(vars[c]);
+        }
+        keys.swap(sorted_keys);
+        premises.swap(sorted_premises);
+        vars.swap(sorted_vars);
+        STRACE("str", tout << __LINE__ <<  " " << __FUNCTION__ << ": " << keys.size() << " components" << std::endl;);
+    }
+
+    /*
+     * Whether a component without arrangement is refuted by its own guesses alone.
+     * Non-fresh variables take their bounds from connectingSize and from the lengths of the
+     * whole combination, regex and str-int variables from bounds shared by all components,
+     * and contains keys from the current length assignment; an encoding that reads any of
+     * them is only refuted together with every guess.
+     */
+    bool theory_trau::is_local_component(ptr_vector<expr> const& keys, ptr_vector<expr> const& vars,
+                                         obj_map<expr, ptr_vector<expr>> const& eq_combination,
+                                         obj_map<expr, int> const& non_fresh_vars){
+        for (expr* v : vars)
+            if (is_non_fresh(v, non_fresh_vars) || is_regex_var(v) || is_internal_regex_var(v) || string_int_vars.contains(v))
+                return false;
+        for (expr* k : keys) {
+            if (is_non_fresh(k, non_fresh_vars))
+                return false;
+            for (expr* e : eq_combination.find_core(k)->get_data().m_value)
+                if (is_contain_equality(e))
+                    return false;
+        }
+        return true;
+    }
+
     bool theory_trau::is_long_equality(ptr_vector<expr> const& eqs){
         return findMaxP(eqs) > 6;
     }
@@ -7438,7 +8280,7 @@ namespace smt {
         STRACE("str", tout << __LINE__ <<  " *** " << __FUNCTION__ << " *** " << mk_pp(var, m) << std::endl;);
         expr_ref_vector ands(m);
         pair_expr_vector lhs_elements = create_equality(var, false);
-        uState.non_fresh_vars.insert(var, connectingSize);
+        uState.add_non_fresh_var(var, connectingSize);
         non_fresh_vars.insert(var, connectingSize);
         mk_and_setup_arr(var, non_fresh_vars);
 
@@ -7495,7 +8337,7 @@ namespace smt {
 
     void theory_trau::convert_regex_equalities(expr* regexExpr, expr* var, obj_map<expr, int> const& non_fresh_vars, expr_ref_vector &assertedConstraints, bool &axiomAdded){
 
-        expr_ref_vector regex_elements = combine_const_str(parse_regex_components(remove_star_in_star(regexExpr)));
+        expr_ref_vector regex_elements = this->regex_elements(regexExpr);
         expr_ref_vector ors(m);
         for (const auto& v : regex_elements){
             STRACE("str", tout << __LINE__ <<  " *** " << __FUNCTION__ << " *** " << mk_pp(v, m) << std::endl;);
@@ -7546,7 +8388,7 @@ namespace smt {
 
                 // arr = ?
                 for (int j = 0; j < lenInt; ++j) {
-                    ands.push_back(createEqualOP(createSelectOP(arr, mk_int(j)), mk_int(c[i + j])));
+                    ands.push_back(createEqualOP(createSelectOP(arr, mk_int(j)), mk_char(c[i + j])));
                 }
                 ors.push_back(createAndOP(ands));
             }
@@ -7581,6 +8423,7 @@ namespace smt {
         
         expr_ref_vector guessed_eqs(m), guessed_diseqs(m);
         fetch_guessed_exprs_with_scopes(guessed_eqs, guessed_diseqs);
+        minimize_conflict(guessed_eqs);
 
         expr_ref tmp(mk_not(m, createAndOP(guessed_eqs)), m);
         assert_axiom(tmp.get());
@@ -7593,6 +8436,7 @@ namespace smt {
         expr_ref_vector guessed_eqs(m), guessed_diseqs(m);
         fetch_guessed_exprs_with_scopes(guessed_eqs, guessed_diseqs);
         guessed_eqs.append(guessed_diseqs);
+        minimize_conflict(guessed_eqs);
 
         expr_ref tmp(mk_not(m, createAndOP(guessed_eqs)), m);
         assert_axiom(tmp.get());
@@ -7614,10 +8458,52 @@ namespace smt {
         fetch_guessed_exprs_with_scopes(guessed_eqs, guessed_diseqs);
         guessed_eqs.append(v);
         guessed_eqs.append(guessed_diseqs);
+        minimize_conflict(guessed_eqs);
         expr_ref tmp(mk_not(m, createAndOP(guessed_eqs)), m);
         assert_axiom(tmp.get());
     }
 
+    /*
+     * Deletion-based minimization of a conflicting conjunction.
+     * A literal is dropped only if the sub-solver shows the remaining ones are still unsat together with the asserted formulas,
+     * so the result is kept as it is when the whole core cannot be refuted within the budget.
+     */
+    void theory_trau::minimize_conflict(expr_ref_vector &core){
+        if (!m_params.m_TrauMinimizeConflicts || core.size() <= 1 || core.size() > m_params.m_TrauMinimizeConflictsMaxSize)
+            return;
+
+        if (!m_core_solver)
+            m_core_solver = alloc(conflict_core_solver, m, get_context().get_fparams(), m_params.m_TrauMinimizeConflictsRlimit);
+
+        // the guessed literals alone are rarely unsat, they are refuted together with the input
+        context& ctx = get_context();
+        expr_ref_vector background(m);
+        for (unsigned i = 0; i < ctx.get_num_asserted_formulas(); ++i)
+            background.push_back(ctx.get_asserted_formula(i));
+
+        expr_ref_vector fmls(background);
+        fmls.append(core);
+        if (m_core_solver->check_sat(createAndOP(fmls)) != l_false)
+            return;
+
+        STRACE("str", tout << __LINE__ <<  " " << __FUNCTION__ << ": " << core.size(););
+        for (unsigned i = core.size(); i-- > 0 && core.size() > 1; ) {
+            expr_ref_vector candidate(m);
+            for (unsigned j = 0; j < core.size(); ++j)
+                if (j != i)
+                    candidate.push_back(core.get(j));
+            fmls.reset();
+            fmls.append(background);
+            fmls.append(candidate);
+            lbool r = m_core_solver->check_sat(createAndOP(fmls));
+            if (r == l_false)
+                core.swap(candidate);
+            else if (r == l_undef)
+                break;
+        }
+        STRACE("str", tout << " -> " << core.size() << std::endl;);
+    }
+
     expr* theory_trau::find_equivalent_variable(expr* e){
         if (u.str.is_concat(e)) {
             // change from concat to variable if it is possible
@@ -7631,42 +8517,41 @@ namespace smt {
         return e;
     }
 
+    /*
+     * true if e is or contains a variable made by mk_fresh_const
+     */
     bool theory_trau::is_internal_var(expr* e){
-        std::string tmp = expr2str(e);
-        return tmp.find("!tmp") != std::string::npos;
+        if (has_var_kind(e, VAR_INTERNAL))
+            return true;
+        if (!is_app(e))
+            return false;
+        for (expr* arg : *to_app(e))
+            if (is_internal_var(arg))
+                return true;
+        return false;
     }
 
+    /*
+     * true if the eq-class of e has an internal member that is not a concatenation and
+     * a membership in a regex that is not a concatenation; regex is the first such regex.
+     * Otherwise regex is the last regex of the class, if any.
+     */
     bool theory_trau::is_internal_regex_var(expr* e, expr* &regex){
-        expr_ref_vector eqs(m);
-        collect_eq_nodes(e, eqs);
-        for (const auto& we: membership_memo) {
-            if (eqs.contains(we.first)){
-                regex = we.second;
-                for (const auto& n : eqs)
-                    if (!u.str.is_concat(n)){
-                        std::string tmp = expr2str(n);
-                        if (tmp.find("!tmp") != std::string::npos && !u.re.is_concat(we.second))
-                            return true;
-                    }
-            }
+        update_regex_var_index();
+        regex_var_entry entry;
+        if (!m_regex_var_index.find(get_eqc_root(e), entry))
+            return false;
+        if (entry.m_has_internal && entry.m_first_non_concat != UINT_MAX) {
+            regex = membership_memo[entry.m_first_non_concat].second;
+            return true;
         }
+        regex = membership_memo[entry.m_last].second;
         return false;
     }
 
     bool theory_trau::is_internal_regex_var(expr* e){
-        expr_ref_vector eqs(m);
-        collect_eq_nodes(e, eqs);
-        for (const auto& we: membership_memo) {
-            if (eqs.contains(we.first)){
-                for (const auto& n : eqs)
-                    if (!u.str.is_concat(n)){
-                        std::string tmp = expr2str(n);
-                        if (tmp.find("!tmp") != std::string::npos && !u.re.is_concat(we.second))
-                            return true;
-                    }
-            }
-        }
-        return false;
+        expr* regex = nullptr;
+        return is_internal_regex_var(e, regex);
     }
 
     bool theory_trau::is_splitable_regex(expr* e){
@@ -7702,20 +8587,244 @@ namespace smt {
         }
 
         SASSERT (u.re.is_star(e) || u.re.is_plus(e) || u.re.is_union(e));
+        return get_regex_info(e).m_content;
+    }
+
+    theory_trau::regex_info& theory_trau::get_regex_info(expr* re){
+        regex_info* info = nullptr;
+        if (regex_infos.find(re, info))
+            return *info;
+        info = alloc(regex_info);
+        regex_info_store.push_back(info);
+        m_trail.push_back(re);
+        regex_infos.insert(re, info);
+
+        expr *arg0 = nullptr, *arg00 = nullptr;
+        info->m_is_star = u.re.is_star(re, arg0);
+        info->m_is_plus = !info->m_is_star && u.re.is_plus(re, arg0);
+        info->m_body = arg0;
+        if (u.re.is_union(re))
+            info->m_content = zstring("");
+        else if (!(is_app(re) && to_app(re)->get_num_args() > 0 &&
+                   u.re.is_to_re(to_app(re)->get_arg(0), arg00) && u.str.is_string(arg00, info->m_content)))
+            info->m_content = zstring("uNkNoWn");
+        regex_length_bounds(re, info->m_min_len, info->m_max_len);
+        return *info;
+    }
 
-        if (u.re.is_union(e)) {
-            return "";
+    /*
+     * Bounds on the length of the words of re, hi is UINT_MAX if unbounded.
+     * Operators without a rule get [0, UINT_MAX].
+     */
+    void theory_trau::regex_length_bounds(expr* re, unsigned& lo, unsigned& hi){
+        auto add = [](unsigned a, unsigned b) {
+            return (a == UINT_MAX || b == UINT_MAX || a + b < a) ? UINT_MAX : a + b;
+        };
+        auto mul = [](unsigned a, unsigned n) {
+            return (a == UINT_MAX || (n > 0 && a > (UINT_MAX - 1) / n)) ? UINT_MAX : a * n;
+        };
+        expr *arg0 = nullptr, *arg1 = nullptr;
+        unsigned lo0 = 0, hi0 = UINT_MAX, lo1 = 0, hi1 = UINT_MAX, n0 = 0, n1 = 0;
+        zstring value;
+        if (u.re.is_to_re(re, arg0) && u.str.is_string(arg0, value)) {
+            lo = hi = value.length();
+        }
+        else if (u.re.is_concat(re, arg0, arg1)) {
+            regex_length_bounds(arg0, lo0, hi0);
+            regex_length_bounds(arg1, lo1, hi1);
+            lo = add(lo0, lo1);
+            hi = add(hi0, hi1);
+        }
+        else if (u.re.is_union(re, arg0, arg1)) {
+            regex_length_bounds(arg0, lo0, hi0);
+            regex_length_bounds(arg1, lo1, hi1);
+            lo = std::min(lo0, lo1);
+            hi = std::max(hi0, hi1);
+        }
+        else if (u.re.is_star(re, arg0) || u.re.is_plus(re, arg1)) {
+            if (arg0 == nullptr)
+                arg0 = arg1;
+            regex_length_bounds(arg0, lo0, hi0);
+            lo = u.re.is_star(re) ? 0 : lo0;
+            hi = hi0 == 0 ? 0 : UINT_MAX;
+        }
+        else if (u.re.is_opt(re, arg0)) {
+            regex_length_bounds(arg0, lo0, hi0);
+            lo = 0;
+            hi = hi0;
+        }
+        else if (u.re.is_loop(re, arg0, n0, n1)) {
+            regex_length_bounds(arg0, lo0, hi0);
+            lo = mul(lo0, n0);
+            hi = mul(hi0, n1);
+        }
+        else if (u.re.is_loop(re, arg0, n0)) {
+            regex_length_bounds(arg0, lo0, hi0);
+            lo = mul(lo0, n0);
+            hi = hi0 == 0 ? 0 : UINT_MAX;
+        }
+        else if (u.re.is_range(re) || u.re.is_full_char(re)) {
+            lo = hi = 1;
+        }
+        else if (is_internal_regex_var(re, arg0)) {
+            regex_length_bounds(arg0, lo, hi);
         }
         else {
-            expr *arg0 = to_app(e)->get_arg(0);
-            expr *arg00 = nullptr;
-            if (u.re.is_to_re(arg0, arg00)) { 
-                zstring value;
-                SASSERT (u.str.is_string(arg00, value));
-                return value;
+            lo = 0;
+            hi = UINT_MAX;
+        }
+    }
+
+    /*
+     * Word lengths of re as fixed lengths plus the lengths l + k * period, k >= 0.
+     * The sets of automaton states reached by the words of each length, guards
+     * ignored, are eventually periodic; the first set that repeats closes the cycle.
+     * Fails if the automaton cannot be built or no set repeats within a few steps.
+     */
+    bool theory_trau::regex_length_set(expr* re, regex_info& info){
+        if (info.m_has_lengths)
+            return info.m_lengths_ok;
+        info.m_has_lengths = true;
+        scoped_ptr<eautomaton> owned;
+        eautomaton* aut = m_aut_cache->get(re, owned);
+        if (!aut)
+            return false;
+        unsigned const max_steps = 128;
+        vector<unsigned_vector> sets;
+        svector<bool> accepting;
+        svector<bool> in_set(aut->num_states(), false);
+        unsigned_vector curr, next, closure;
+
+        auto add = [&](unsigned s, unsigned_vector& set) {
+            closure.reset();
+            aut->get_epsilon_closure(s, closure);
+            for (unsigned t : closure)
+                if (!in_set[t]) {
+                    in_set[t] = true;
+                    set.push_back(t);
+                }
+        };
+        auto same = [](unsigned_vector const& a, unsigned_vector const& b) {
+            if (a.size() != b.size())
+                return false;
+            for (unsigned i = 0; i < a.size(); ++i)
+                if (a[i] != b[i])
+                    return false;
+            return true;
+        };
+
+        add(aut->init(), curr);
+        unsigned start = UINT_MAX;
+        while (true) {
+            for (unsigned t : curr)
+                in_set[t] = false;
+            std::sort(curr.begin(), curr.end());
+            for (unsigned k = 0; k < sets.size() && start == UINT_MAX; ++k)
+                if (same(sets[k], curr))
+                    start = k;
+            if (start != UINT_MAX)
+                break;
+            if (sets.size() >= max_steps)
+                return false;
+            bool f = false;
+            for (unsigned s : curr)
+                f = f || aut->is_final_state(s);
+            sets.push_back(curr);
+            accepting.push_back(f);
+            next.reset();
+            for (unsigned s : curr)
+                for (auto const& mv : aut->get_moves_from(s))
+                    if (!mv.is_epsilon())
+                        add(mv.dst(), next);
+            curr.swap(next);
+        }
+
+        // shrink the cycle to the smallest period of its acceptance pattern
+        unsigned period = sets.size() - start;
+        for (unsigned d = 1; d < period; ++d) {
+            if (period % d != 0)
+                continue;
+            bool ok = true;
+            for (unsigned i = start; ok && i + d < sets.size(); ++i)
+                ok = accepting[i] == accepting[i + d];
+            if (ok) {
+                period = d;
+                break;
             }
-            return zstring("uNkNoWn");
         }
+        while (start > 0 && accepting[start - 1] == accepting[start - 1 + period])
+            --start;
+
+        for (unsigned i = 0; i < start; ++i)
+            if (accepting[i])
+                info.m_fixed_lens.push_back(i);
+        for (unsigned i = start; i < start + period; ++i)
+            if (accepting[i])
+                info.m_periodic_lens.push_back(i);
+        info.m_len_period = period;
+        info.m_lengths_ok = true;
+        return true;
+    }
+
+    /*
+     * The word lengths of re as a constraint on len, or null if every length is possible.
+     * Falls back to the length bounds of re if its length set is unknown or has too many parts.
+     */
+    expr_ref theory_trau::mk_regex_length_constraint(expr* len, expr* re){
+        unsigned const max_disjuncts = 32;
+        expr_ref result(m);
+        regex_info& info = get_regex_info(re);
+        if (!regex_length_set(re, info) || info.m_fixed_lens.size() + info.m_periodic_lens.size() > max_disjuncts) {
+            expr_ref_vector ands(m);
+            if (info.m_min_len > 0)
+                ands.push_back(createGreaterEqOP(len, mk_int(info.m_min_len)));
+            if (info.m_max_len != UINT_MAX)
+                ands.push_back(createLessEqOP(len, mk_int(info.m_max_len)));
+            if (!ands.empty())
+                result = createAndOP(ands);
+            return result;
+        }
+
+        unsigned period = info.m_len_period;
+        if (info.m_fixed_lens.empty() && period == 1 && info.m_periodic_lens.size() == 1 && info.m_periodic_lens[0] == 0)
+            return result;
+        expr_ref_vector ors(m);
+        for (unsigned l : info.m_fixed_lens)
+            ors.push_back(createEqualOP(len, mk_int(l)));
+        for (unsigned l : info.m_periodic_lens) {
+            if (period == 1) {
+                ors.push_back(createGreaterEqOP(len, mk_int(l)));
+                continue;
+            }
+            expr_ref_vector ands(m);
+            ands.push_back(createGreaterEqOP(len, mk_int(l)));
+            ands.push_back(createEqualOP(m_autil.mk_mod(len, mk_int(period)), mk_int(l % period)));
+            ors.push_back(createAndOP(ands));
+        }
+        result = createOrOP(ors);
+        return result;
+    }
+
+    /*
+     * combine_const_str(parse_regex_components(remove_star_in_star(re))), built once per regex.
+     */
+    expr_ref_vector theory_trau::regex_elements(expr* re){
+        regex_info& info = get_regex_info(re);
+        if (!info.m_has_elements) {
+            expr_ref_vector elements = combine_const_str(parse_regex_components(remove_star_in_star(re)));
+            for (expr* e : elements) {
+                m_trail.push_back(e);
+                info.m_elements.push_back(e);
+            }
+            info.m_has_elements = true;
+        }
+        expr_ref_vector result(m);
+        for (expr* e : info.m_elements) {
+            // enodes do not survive backtracking
+            ensure_enode(e);
+            result.push_back(e);
+        }
+        return result;
     }
 
     /*
@@ -7871,15 +8980,40 @@ namespace smt {
     }
 
     bool theory_trau::collect_alternative_components(expr* v, expr_ref_vector& ret){
+        regex_info& info = get_regex_info(v);
+        if (!info.m_has_alts) {
+            expr_ref_vector alts(m);
+            info.m_alts_ok = compile_alternatives(v, alts);
+            for (expr* a : alts) {
+                m_trail.push_back(a);
+                info.m_alts.push_back(a);
+            }
+            info.m_has_alts = true;
+        }
+        ret.append(info.m_alts.size(), info.m_alts.c_ptr());
+        return info.m_alts_ok;
+    }
+
+    bool theory_trau::collect_alternative_components(expr* v, vector<zstring>& ret){
+        regex_info& info = get_regex_info(v);
+        if (!info.m_has_strs) {
+            info.m_strs_ok = compile_alternatives(v, info.m_strs);
+            info.m_has_strs = true;
+        }
+        ret.append(info.m_strs);
+        return info.m_strs_ok;
+    }
+
+    bool theory_trau::compile_alternatives(expr* v, expr_ref_vector& ret){
         STRACE("str", tout << __LINE__ <<  " " << __FUNCTION__ << " " << mk_pp(v, m) << std::endl;);
         expr *arg0 = nullptr, *arg1 = nullptr;
         if (u.re.is_to_re(v)){
             ret.push_back(v);
         }
         else if (u.re.is_union(v, arg0, arg1)){
-            if (!collect_alternative_components(arg0, ret))
+            if (!compile_alternatives(arg0, ret))
                 return false;
-            if (!collect_alternative_components(arg1, ret))
+            if (!compile_alternatives(arg1, ret))
                 return false;
         }
         else if (u.re.is_star(v) || u.re.is_plus(v)) {
@@ -7888,13 +9022,13 @@ namespace smt {
         else if (u.re.is_concat(v, arg0, arg1)){
             expr* tmp = is_regex_plus_breakdown(v);
             if (tmp) {
-                collect_alternative_components(tmp, ret);
+                compile_alternatives(tmp, ret);
             }
             else {
                 expr_ref_vector lhs(m);
                 expr_ref_vector rhs(m);
-                collect_alternative_components(arg0, lhs);
-                collect_alternative_components(arg1, rhs);
+                compile_alternatives(arg0, lhs);
+                compile_alternatives(arg1, rhs);
 
                 for (const auto &l : lhs) {
                     for (const auto &r: rhs) {
@@ -7920,7 +9054,7 @@ namespace smt {
         return true;
     }
 
-    bool theory_trau::collect_alternative_components(expr* v, vector<zstring>& ret){
+    bool theory_trau::compile_alternatives(expr* v, vector<zstring>& ret){
         expr *arg0 = nullptr, *arg1 = nullptr;
         if (u.re.is_to_re(v, arg0)){
             zstring tmpStr;
@@ -7928,18 +9062,18 @@ namespace smt {
             ret.push_back(tmpStr);
         }
         else if (u.re.is_union(v, arg0, arg1)){
-            if (!collect_alternative_components(arg0, ret))
+            if (!compile_alternatives(arg0, ret))
                 return false;
-            if (!collect_alternative_components(arg1, ret))
+            if (!compile_alternatives(arg1, ret))
                 return false;
         }
         else if (u.re.is_star(v, arg0) || u.re.is_plus(v, arg0)) {
-            return collect_alternative_components(arg0, ret);
+            return compile_alternatives(arg0, ret);
         }
         else if (u.re.is_concat(v, arg0, arg1)){
             expr* tmp = is_regex_plus_breakdown(v);
             if (tmp != nullptr){
-                return collect_alternative_components(tmp, ret);
+                return compile_alternatives(tmp, ret);
             }
             else
                 return false;
@@ -8201,16 +9335,23 @@ namespace smt {
             pair_expr_vector const& rhs_elements,
             obj_map<expr, int> const& non_fresh_variables,
             int p){
-        zstring rep = create_string_representation(lhs_elements, rhs_elements);
+        eq_key rep(lhs_elements, rhs_elements);
 
         if (!generated_equalities.contains(rep) &&
             lhs_elements.size() != 0 && rhs_elements.size() != 0){
+            m_arrange_watch.start();
             expr_ref_vector cases = arrange(
                     lhs_elements,
                     rhs_elements,
                     non_fresh_variables,
                     p);
+            m_arrange_watch.stop();
+            m_stats.m_arrangements += cases.size();
             generated_equalities.insert(rep);
+            for (auto const& e : lhs_elements)
+                generated_equality_terms.push_back(e.first);
+            for (auto const& e : rhs_elements)
+                generated_equality_terms.push_back(e.first);
             if (cases.size() > 0) {
                 expr_ref tmp(createOrOP(cases), m);
                 return tmp.get();
@@ -8219,20 +9360,13 @@ namespace smt {
                 return nullptr;
             }
         }
-        else
+        else {
+            if (generated_equalities.contains(rep))
+                m_stats.m_generated_eq_hits++;
             return m.mk_true();
+        }
     }
 
-    zstring theory_trau::create_string_representation(pair_expr_vector const& lhs_elements, pair_expr_vector const& rhs_elements){
-        std::string ret = "";
-        for (unsigned i = 0; i < lhs_elements.size(); ++i)
-            ret = ret + "-" + expr2str(lhs_elements[i].first);
-        for (unsigned i = 0; i < rhs_elements.size(); ++i)
-            ret = ret + "+" + expr2str(rhs_elements[i].first);
-        return zstring(ret.c_str());
-    }
-
-
     /*
      * lhs: size of the lhs
      * rhs: size of the rhs
@@ -8247,18 +9381,7 @@ namespace smt {
             pair_expr_vector const& rhs_elements,
             obj_map<expr, int> const& non_fresh_variables,
             int p){
-        /* first base case */
-        
-
-        /* because arrangements are reusable, we use "general" functions */
-        setup_0_0_general();
-        /* second base case : first row and first column */
-        setup_0_n_general(lhs_elements.size(), rhs_elements.size());
-        setup_n_0_general(lhs_elements.size(), rhs_elements.size());
-        /* general cases */
-        setup_n_n_general(lhs_elements.size(), rhs_elements.size());
-
-        /* because of "general" functions, we need to refine arrangements */
+        /* arrangements come from the shared table, we need to refine them */
         vector<Arrangment> possibleCases;
         get_arrangements(lhs_elements, rhs_elements, non_fresh_variables, possibleCases);
 
@@ -8275,12 +9398,12 @@ namespace smt {
         /* 1 vs n, 1 vs 1, n vs 1 */
         for (unsigned i = 0; i < possibleCases.size(); ++i) {
 
-            arrangements[std::make_pair(lhs_elements.size() - 1, rhs_elements.size() - 1)][i].print("Checking case");
+            possibleCases[i].print("Checking case");
             expr* tmp = to_arith(p, possibleCases[i].left_arr, possibleCases[i].right_arr, lhs_elements, rhs_elements, non_fresh_variables);
 
             if (tmp != nullptr) {
                 cases.push_back(tmp);
-                arrangements[std::make_pair(lhs_elements.size() - 1, rhs_elements.size() - 1)][i].print("Correct case");
+                possibleCases[i].print("Correct case");
             }
             else {
             }
@@ -8293,8 +9416,7 @@ namespace smt {
                                         pair_expr_vector const& rhs_elements,
                                         obj_map<expr, int> const& non_fresh_variables,
                                         vector<Arrangment> &possibleCases) {
-        std::string firstVar = expr2str(lhs_elements[0].first);
-        if ((firstVar.find(FLATPREFIX) != std::string::npos && lhs_elements.size() == p_bound.get_int64()) ||
+        if ((has_var_kind(lhs_elements[0].first, VAR_FLAT) && lhs_elements.size() == p_bound.get_int64()) ||
             (lhs_elements.size() == 2 &&
              ((non_fresh_variables.contains(lhs_elements[0].first) && lhs_elements[1].second % p_bound.get_int64() == 1) ||
               (lhs_elements[0].second % p_bound.get_int64() == -1 && lhs_elements[1].first == lhs_elements[0].first)))) {
@@ -8303,7 +9425,7 @@ namespace smt {
             possibleCases.push_back(create_arrangments_manually(lhs_elements, rhs_elements));
         } else {
             update_possible_arrangements(lhs_elements, rhs_elements,
-                                         arrangements[std::make_pair(lhs_elements.size() - 1, rhs_elements.size() - 1)],
+                                         trau_arrangements::get(lhs_elements.size() - 1, rhs_elements.size() - 1),
                                          possibleCases);
         }
     }
@@ -8311,11 +9433,15 @@ namespace smt {
     void theory_trau::update_possible_arrangements(
             pair_expr_vector const& lhs_elements,
             pair_expr_vector const& rhs_elements,
-            vector<Arrangment> const& tmp,
+            trau_arrangements::entry const& tmp,
             vector<Arrangment> &possibleCases) {
-        for (const auto& a : tmp)
+        int_vector left_arr, right_arr;
+        for (unsigned i = 0; i < tmp.size(); ++i) {
+            tmp.get(i, left_arr, right_arr);
+            Arrangment a(left_arr, right_arr);
             if (a.is_possible_arrangement(lhs_elements, rhs_elements))
                 possibleCases.push_back(a);
+        }
     }
 
     /*
@@ -9147,7 +10273,7 @@ namespace smt {
                 zstring val;
                 expr* arr_b = nullptr;
                 if (pre_rhs == mk_int(0) && u.str.is_string(elements[pos].first, val))
-                    arr_b = mk_int(val[i_1.get_int64()]);
+                    arr_b = mk_char(val[i_1.get_int64()]);
                 else
                     arr_b = createSelectOP(arrB, createAddOP(pre_rhs, at_i_1));
                 expr *conclusion = createEqualOP(
@@ -9200,9 +10326,7 @@ namespace smt {
     bool theory_trau::match_regex(expr* a, expr* b) {
         if (u.re.is_full_seq(a) || u.re.is_full_seq(b))
             return true;
-        expr* intersection = u.re.mk_inter(a, b);
-        eautomaton *au01 = get_automaton(intersection);
-        return !au01->is_empty();
+        return !is_regex_intersection_empty(a, b);
     }
 
     /*
@@ -9963,6 +11087,10 @@ namespace smt {
         /* (and ...) */
 
         expr_ref_vector ands(m);
+        /* the array of a regex variable only follows the regex up to its bound, see setup_regex_var */
+        expr* reg = nullptr;
+        if (is_internal_regex_var(a.first, reg) && non_fresh_variables[a.first] >= 0)
+            ands.push_back(createLessEqOP(mk_strlen(a.first), mk_int(non_fresh_variables[a.first])));
 
         for (unsigned i = 0 ; i < elements.size(); ++i){
             STRACE("str", tout << __LINE__ << " *** " << __FUNCTION__ << " *** " << mk_pp(elements[i].first, m) << ", " << elements[i].second << " " << elements[i].second % p_bound.get_int64() << std::endl;);
@@ -10102,7 +11230,7 @@ namespace smt {
                             locationConstraint.push_back(
                                     createEqualOP(
                                             createSelectOP(flatArrayName, createAddOP(m_autil.mk_int(i - 1), startPos)),
-                                            m_autil.mk_int(v[i - 1]))) /* arr value */
+                                            mk_char(v[i - 1]))) /* arr value */
                                        :
                             locationConstraint.push_back(
                                     createEqualOP(
@@ -10110,7 +11238,7 @@ namespace smt {
                                                                    createModOP(
                                                                            createAddOP(m_autil.mk_int(i - 1), startPos),
                                                                            m_autil.mk_int(pMax))),
-                                            m_autil.mk_int(v[i - 1])));
+                                            mk_char(v[i - 1])));
                             oneCase.push_back(createOrOP(locationConstraint));
                         }
                     else
@@ -10128,7 +11256,7 @@ namespace smt {
                             locationConstraint.push_back(
                                     createEqualOP(
                                             createSelectOP(flatArrayName, createAddOP(m_autil.mk_int(i - 1), startPos)),
-                                            m_autil.mk_int(v[i - 1]))) /* direct value */
+                                            mk_char(v[i - 1]))) /* direct value */
                                        :
                             locationConstraint.push_back(
                                     createEqualOP(
@@ -10136,7 +11264,7 @@ namespace smt {
                                                                    createModOP(
                                                                            createAddOP(m_autil.mk_int(i - 1), startPos),
                                                                            m_autil.mk_int(pMax))),
-                                            m_autil.mk_int(v[i - 1]))) /* direct value */;
+                                            mk_char(v[i - 1]))) /* direct value */;
 
                             oneCase.push_back(createOrOP(locationConstraint));
                         }
@@ -10346,10 +11474,10 @@ namespace smt {
                         expr_ref_vector ands(m);
                         ands.push_back(createGreaterEqOP(
                                 createSelectOP(lhs_array, createAddOP(m_autil.mk_int(i), pre_lhs)),
-                                m_autil.mk_int(charRange[j].first)));
+                                mk_char(charRange[j].first)));
                         ands.push_back(createLessEqOP(
                                 createSelectOP(lhs_array, createAddOP(m_autil.mk_int(i), pre_lhs)),
-                                m_autil.mk_int(charRange[j].second)));
+                                mk_char(charRange[j].second)));
                         ors_range.push_back(createAndOP(ands));
                     }
 
@@ -10370,10 +11498,10 @@ namespace smt {
                         expr_ref_vector ands(m);
                         ands.push_back(createGreaterEqOP(
                                 createSelectOP(lhs_array, createAddOP(m_autil.mk_int(i), pre_lhs)),
-                                m_autil.mk_int(charRange[j].first)));
+                                mk_char(charRange[j].first)));
                         ands.push_back(createLessEqOP(
                                 createSelectOP(lhs_array, createAddOP(m_autil.mk_int(i), pre_lhs)),
-                                m_autil.mk_int(charRange[j].second)));
+                                mk_char(charRange[j].second)));
                         ors_range.push_back(createAndOP(ands));
                     }
                     ors.push_back(createOrOP(ors_range));
@@ -10394,7 +11522,7 @@ namespace smt {
                 for (int i = 0; i < pMax; ++i) {
                     expr_ref_vector ors(m);
                     ors.push_back(createEqualOP(createSelectOP(lhs_array, createAddOP(m_autil.mk_int(i), pre_lhs)),
-                                                      mk_int(strTmp[i % tmpNum])));
+                                                      mk_char(strTmp[i % tmpNum])));
                     ors.push_back(createGreaterOP(m_autil.mk_int(i + 1), get_var_flat_size(elements[regexPos])));
                     andConstraints.push_back(createOrOP(ors));
                 }
@@ -10404,7 +11532,7 @@ namespace smt {
                 for (int i = 0; i < std::min(connectingSize, 50); ++i) {
                     expr_ref_vector ors(m);
                     ors.push_back(createEqualOP(createSelectOP(lhs_array, createAddOP(m_autil.mk_int(i), pre_lhs)),
-                            mk_int(strTmp[i % tmpNum])));
+                            mk_char(strTmp[i % tmpNum])));
                     ors.push_back(createGreaterOP(m_autil.mk_int(i + 1), get_var_flat_size(elements[regexPos])));
                     andConstraints.push_back(createOrOP(ors));
                 }
@@ -10482,13 +11610,13 @@ namespace smt {
                     locationConstraint.push_back(createEqualOP(
                             createSelectOP(tmp01,
                                                  createAddOP(m_autil.mk_int(i - start), startPos)),
-                            m_autil.mk_int(v[i]))) :
+                            mk_char(v[i]))) :
                     locationConstraint.push_back(createEqualOP(
                             createSelectOP(tmp01,
                                                  createModOP(
                                                          createAddOP(m_autil.mk_int(i - start), startPos),
                                                          m_autil.mk_int(pMax))),
-                            m_autil.mk_int(v[i])));
+                            mk_char(v[i])));
                 }
             orConstraints.push_back(createAndOP(locationConstraint));
         }
@@ -10713,7 +11841,7 @@ namespace smt {
                         ands.reset();
                         break;
                     }
-                    lhsExpr = mk_int(content[atValue.get_int64()]);
+                    lhsExpr = mk_char(content[atValue.get_int64()]);
                 }
 
                 ands.push_back(createEqualOP(
@@ -10722,7 +11850,7 @@ namespace smt {
                                        createAddOP(m_autil.mk_int(k), prefix_rhs))));
                 ands.push_back(createEqualOP(
                         lhsExpr,
-                        mk_int('0')));
+                        mk_char('0')));
             }
             if (ands.size() == 0)
                 break;
@@ -10749,7 +11877,7 @@ namespace smt {
                         break;
                     }
                     STRACE("str", tout << __LINE__ << " " << content << " " << atValue.get_int64() << std::endl;);
-                    lhsExpr = mk_int(content[atValue.get_int64()]);
+                    lhsExpr = mk_char(content[atValue.get_int64()]);
                 }
 
                 ands.push_back(createEqualOP(
@@ -10795,7 +11923,7 @@ namespace smt {
                         ands.reset();
                         break;
                     }
-                    lhsExpr = mk_int(content[atValue.get_int64()]);
+                    lhsExpr = mk_char(content[atValue.get_int64()]);
                 }
 
                 ands.push_back(createEqualOP(
@@ -10860,8 +11988,7 @@ namespace smt {
                                                                                    prefix,
                                                                                    m_autil.mk_int(
                                                                                            j))),
-                                                            m_autil.mk_int(
-                                                                    content[j % content.length()])));
+                                                            mk_char(content[j % content.length()])));
                         }
                         cases.push_back(createAndOP(subcase));
                     }
@@ -10893,7 +12020,7 @@ namespace smt {
                                                                               m_autil.mk_int(j +
                                                                                              iter *
                                                                                              content.length())),
-                                                               m_autil.mk_int(content[j])));
+                                                               mk_char(content[j])));
                     }
                     ret.push_back(createAndOP(conditions));
                 }
@@ -11591,11 +12718,15 @@ namespace smt {
 	 * (a|b|c)*_xxx --> range <a, c>
 	 */
     vector<std::pair<int, int>> theory_trau::collect_char_range(expr* a){
+        regex_info& info = get_regex_info(a);
+        if (info.m_has_ranges)
+            return info.m_ranges;
         vector<bool> chars;
         for (int i = 0; i <= 256; ++i)
             chars.push_back(false);
         collect_char_range(a, chars);
-        vector<std::pair<int, int>> ret;
+        vector<std::pair<int, int>>& ret = info.m_ranges;
+        info.m_has_ranges = true;
         if (chars[255]) {
             ret.push_back(std::make_pair(-1, -1));
             return ret;
@@ -11969,6 +13100,21 @@ namespace smt {
         context & ctx = get_context();
         if (x == y)
             return m.mk_true();
+        expr *cx = nullptr, *cy = nullptr;
+        if (is_bv_char(x, cx) || is_bv_char(y, cy)) {
+            // compare characters as bit-vectors when both sides have a bit-vector form;
+            // use_bv_chars guarantees that a code without one is no character of the arrays
+            if (!cx) cx = mk_bv_char(x);
+            if (!cy) cy = mk_bv_char(y);
+            rational v;
+            if ((!cx && m_autil.is_numeral(x, v)) || (!cy && m_autil.is_numeral(y, v)))
+                return m.mk_false();
+            if (cx && cy) {
+                app* tmp = ctx.mk_eq_atom(cx, cy);
+                ctx.internalize(tmp, false);
+                return tmp;
+            }
+        }
         app* tmp = ctx.mk_eq_atom(x, y);
         ctx.internalize(tmp, false);
         return tmp;
@@ -12084,6 +13230,17 @@ namespace smt {
      *
      */
     app* theory_trau::createLessEqOP(expr* x, expr* y){
+        expr *cx = nullptr, *cy = nullptr;
+        bool bx = is_bv_char(x, cx), by = is_bv_char(y, cy);
+        if (bx || by) {
+            rational v;
+            if (!cx && m_autil.is_numeral(x, v))
+                return v.is_neg() ? m.mk_true() : v >= rational::power_of_two(BVCHARSIZE) ? m.mk_false() : m_bv.mk_ule(m_bv.mk_numeral(v, BVCHARSIZE), cy);
+            if (!cy && m_autil.is_numeral(y, v))
+                return v.is_neg() ? m.mk_false() : v >= rational::power_of_two(BVCHARSIZE) ? m.mk_true() : m_bv.mk_ule(cx, m_bv.mk_numeral(v, BVCHARSIZE));
+            if (cx && cy)
+                return m_bv.mk_ule(cx, cy);
+        }
         rational val_y;
         if (!m_autil.is_numeral(y, val_y))
             return m_autil.mk_ge(y, x);
@@ -12126,6 +13283,9 @@ namespace smt {
      *
      */
     app* theory_trau::createGreaterEqOP(expr* x, expr* y){
+        expr *c = nullptr;
+        if (is_bv_char(x, c) || is_bv_char(y, c))
+            return createLessEqOP(y, x);
         if (!m_autil.is_numeral(y))
             return m_autil.mk_le(y, x);
         else
@@ -12175,16 +13335,284 @@ namespace smt {
      *
      */
     app* theory_trau::createSelectOP(expr* x, expr* y){
+        context & ctx   = get_context();
+        bv_flat_array* flat = nullptr;
+        if (bv_flat_arrays.find(x, flat)) {
+            app* tmp = m_bv.mk_bv2int(mk_bv_char_select(*flat, y));
+            ctx.internalize(tmp, false);
+            ctx.mark_as_relevant(tmp);
+            record_char_select(tmp);
+            return tmp;
+        }
         ptr_vector<expr> sel_args;
         sel_args.push_back(x);
         sel_args.push_back(y);
-        context & ctx   = get_context();
         app* tmp = m_arrayUtil.mk_select(sel_args.size(), sel_args.c_ptr());
         ctx.internalize(tmp, false);
         ctx.mark_as_relevant(tmp);
+        record_char_select(tmp);
         return tmp;
     }
 
+    /*
+     * With character classes, a flat-array character is one of the class codes.
+     * Remember it so that final_check_eh can bound it once its value leaves them.
+     */
+    void theory_trau::record_char_select(expr* sel){
+        if (char_class_lo.empty() || char_selects.contains(sel))
+            return;
+        char_classes_used = true;
+        char_selects.insert(sel);
+        m_trail.push_back(sel);
+        m_trail_stack.push(insert_obj_trail<theory_trau, expr>(char_selects, sel));
+    }
+
+    /*
+     * A code outside the classes satisfies every disequality and decodes to an arbitrary character.
+     * Bounding every character eagerly perturbs the arithmetic search, so only the ones whose
+     * current value is out of range, or which have no value yet, are bounded.
+     */
+    bool theory_trau::bound_char_selects(){
+        if (char_selects.empty())
+            return false;
+        context & ctx = get_context();
+        arith_value v(m);
+        v.init(&ctx);
+        rational n(char_class_lo.size());
+        rational hi = n - 1;
+        bool added = false;
+        for (expr* sel : char_selects) {
+            rational val;
+            if (!ctx.e_internalized(sel))
+                continue;
+            // a class without an arithmetic value gets an arbitrary one in the model
+            if (v.get_value_equiv(sel, val) && val.is_nonneg() && val < n)
+                continue;
+            expr_ref bound(m.mk_and(createGreaterEqOP(sel, mk_int(0)),
+                                    createLessEqOP(sel, mk_int(hi))), m);
+            if (ctx.b_internalized(bound) && ctx.get_assignment(bound.get()) == l_true)
+                continue;
+            STRACE("str", tout << __LINE__ << " unbounded character " << mk_pp(sel, m) << std::endl;);
+            assert_axiom(bound);
+            added = true;
+        }
+        return added;
+    }
+
+    /*
+     * Bit-vector characters are BVCHARSIZE wide, so they are only used while every code of the
+     * encodings fits: the class numbers, or the characters of the input without classes.
+     * Otherwise new flat arrays fall back to Int characters; bv2int keeps both kinds comparable.
+     */
+    bool theory_trau::use_bv_chars() const {
+        if (!m_params.m_TrauBvFlatArrays)
+            return false;
+        if (m_params.m_TrauCharClasses)
+            return !char_class_lo.empty() && char_class_lo.size() <= (1u << BVCHARSIZE);
+        return max_input_char < (1u << BVCHARSIZE);
+    }
+
+    /*
+     * e is bv2int of a character of a bit-vector flat array
+     */
+    bool theory_trau::is_bv_char(expr* e, expr*& c) const {
+        return m_bv.is_bv2int(e, c) && m_bv.get_bv_size(c) == BVCHARSIZE;
+    }
+
+    /*
+     * bit-vector form of a character term, or nullptr
+     */
+    expr* theory_trau::mk_bv_char(expr* e) {
+        expr* c = nullptr;
+        if (is_bv_char(e, c))
+            return c;
+        rational v;
+        if (m_autil.is_numeral(e, v) && !v.is_neg() && v < rational::power_of_two(BVCHARSIZE))
+            return m_bv.mk_numeral(v, BVCHARSIZE);
+        return nullptr;
+    }
+
+    /*
+     * Split the characters into intervals that no string constant, regex range or
+     * string-integer conversion of the input tells apart, numbered in order.
+     * Encodings refer to a character by its interval, so regex ranges stay intervals
+     * and the digits stay consecutive. Once an encoding used the partition, it is only
+     * replaced when new assertions tell apart characters of one class; the encodings of
+     * the new partition start over on fresh flat arrays, so the facts already asserted
+     * keep the codes they were made with.
+     */
+    void theory_trau::setup_char_classes(){
+        if (!m_params.m_TrauCharClasses && !m_params.m_TrauBvFlatArrays)
+            return;
+        context& ctx = get_context();
+        unsigned_vector cuts;
+        cuts.push_back(0);
+        unsigned max_char = 0;
+        auto add_char = [&](unsigned c) {
+            cuts.push_back(c);
+            cuts.push_back(c + 1);
+            max_char = std::max(max_char, c);
+        };
+
+        ptr_vector<expr> todo;
+        expr_mark visited;
+        for (unsigned i = 0; i < ctx.get_num_asserted_formulas(); ++i)
+            todo.push_back(ctx.get_asserted_formula(i));
+        while (!todo.empty()) {
+            expr* e = todo.back();
+            todo.pop_back();
+            if (visited.is_marked(e))
+                continue;
+            visited.mark(e);
+            if (is_quantifier(e)) {
+                todo.push_back(to_quantifier(e)->get_expr());
+                continue;
+            }
+            if (!is_app(e))
+                continue;
+            zstring value, lo, hi;
+            expr *arg0 = nullptr, *arg1 = nullptr;
+            if (u.str.is_string(e, value)) {
+                for (unsigned i = 0; i < value.length(); ++i)
+                    add_char(value[i]);
+            }
+            else if (u.re.is_range(e, arg0, arg1) && u.str.is_string(arg0, lo) && u.str.is_string(arg1, hi) &&
+                     lo.length() == 1 && hi.length() == 1) {
+                cuts.push_back(lo[0]);
+                cuts.push_back(hi[0] + 1);
+                max_char = std::max(max_char, hi[0]);
+            }
+            else if (u.str.is_stoi(e) || u.str.is_itos(e)) {
+                add_char('-');
+                for (unsigned d = 0; d < 10; ++d)
+                    add_char('0' + d);
+            }
+            for (expr* arg : *to_app(e))
+                todo.push_back(arg);
+        }
+
+        if (!m_params.m_TrauCharClasses) {
+            // codes are characters; arrays with bit-vector characters cannot hold the new ones
+            if (bv_chars_used && max_char >= (1u << BVCHARSIZE) && max_input_char < (1u << BVCHARSIZE)) {
+                array_map.reset();
+                array_map_reverse.reset();
+                completed_branches.reset();
+                completed_branch_cores.reset();
+                completed_branch_index.reset();
+                reset_fc_versions();
+            }
+            max_input_char = std::max(max_input_char, max_char);
+            return;
+        }
+
+        if (char_classes_used) {
+            bool refines = false;
+            for (unsigned c : cuts)
+                if (!std::binary_search(char_class_lo.begin(), char_class_lo.end(), c)) {
+                    refines = true;
+                    break;
+                }
+            if (!refines)
+                return;
+            // keep the old cuts, the facts over the old arrays still refer to them
+            cuts.append(char_class_lo);
+            array_map.reset();
+            array_map_reverse.reset();
+            completed_branches.reset();
+            completed_branch_cores.reset();
+            completed_branch_index.reset();
+            reset_fc_versions();
+            char_classes_used = false;
+            m_stats.m_char_class_refinements++;
+        }
+
+        std::sort(cuts.begin(), cuts.end());
+        char_class_lo.reset();
+        char_class_rep.reset();
+        unsigned_set encoded;
+        setup_encoded_chars(encoded);
+        for (unsigned i = 0; i < cuts.size(); ++i) {
+            if (i > 0 && cuts[i] == cuts[i - 1])
+                continue;
+            char_class_lo.push_back(cuts[i]);
+        }
+        for (unsigned k = 0; k < char_class_lo.size(); ++k) {
+            unsigned lo = char_class_lo[k];
+            unsigned hi = k + 1 < char_class_lo.size() ? char_class_lo[k + 1] - 1 : UINT_MAX;
+            // prefer a printable character that is not a regex operator of the string encodings
+            unsigned rep = lo == 0 && hi > 0 ? 1 : lo;
+            for (unsigned c = std::max(lo, 32u); c <= std::min(hi, 126u); ++c)
+                if (!encoded.contains(c)) {
+                    rep = c;
+                    break;
+                }
+            char_class_rep.push_back(rep);
+        }
+        STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << ": " << char_class_lo.size() << " classes" << std::endl;);
+    }
+
+    unsigned theory_trau::char_code(unsigned ch) const {
+        if (char_class_lo.empty())
+            return ch;
+        return static_cast<unsigned>(std::upper_bound(char_class_lo.begin(), char_class_lo.end(), ch) - char_class_lo.begin()) - 1;
+    }
+
+    /*
+     * the value of character ch in the flat-array encodings
+     */
+    app* theory_trau::mk_char(unsigned ch) {
+        if (!char_class_lo.empty())
+            char_classes_used = true;
+        return mk_int(static_cast<int>(char_code(ch)));
+    }
+
+    /*
+     * the character for value code of a flat array; without classes the code is the character
+     */
+    int theory_trau::decode_char(int code) const {
+        if (char_class_lo.empty() || code < 0 || code >= static_cast<int>(char_class_rep.size()))
+            return code;
+        return static_cast<int>(char_class_rep[code]);
+    }
+
+    /*
+     * Character at idx: a position constant for numerals, otherwise an ite over the
+     * positions that falls back to the backing array. The ite has one case per position,
+     * so it is built once per array and index.
+     */
+    expr* theory_trau::mk_bv_char_select(bv_flat_array const& a, expr* idx) {
+        rational k;
+        expr* sel_args[2] = { a.m_rest, idx };
+        if (m_autil.is_numeral(idx, k)) {
+            if (!k.is_neg() && k < rational(a.m_chars.size()))
+                return a.m_chars.get(k.get_unsigned());
+            return m_arrayUtil.mk_select(2, sel_args);
+        }
+        expr* cached = nullptr;
+        if (bv_select_cache.find(a.m_rest, idx, cached))
+            return cached;
+        expr_ref result(m_arrayUtil.mk_select(2, sel_args), m);
+        for (unsigned i = a.m_chars.size(); i-- > 0; )
+            result = m.mk_ite(m.mk_eq(idx, mk_int(i)), a.m_chars.get(i), result);
+        m_trail.push_back(result);
+        m_trail.push_back(idx);
+        bv_select_cache.insert(a.m_rest, idx, result);
+        return result;
+    }
+
+    /*
+     * make the model of a bit-vector flat array depend on its characters
+     */
+    void theory_trau::add_bv_flat_entries(string_value_proc* proc, expr* arr) {
+        context& ctx = get_context();
+        bv_flat_array* flat = nullptr;
+        if (!bv_flat_arrays.find(arr, flat))
+            return;
+        for (expr* c : flat->m_chars)
+            if (ctx.e_internalized(c))
+                proc->add_entry(ctx.get_enode(c));
+    }
+
 
 
     int theory_trau::optimized_lhs(
@@ -12296,228 +13724,49 @@ namespace smt {
                     }
                     else if (right_arr[j - 1] == SUMFLAT)
                         return LEFT_SUM;
-                    else if (startPos > 0){
-                        if (left_arr[startPos - 1] == j - 1 &&
-                            right_arr[j - 1] == startPos - 1 &&
-                            rhs_elements[j - 1].first.compare(rhs_elements[j].first) == 0){
-                            return LEFT_EQUAL;
-                        }
-                    }
-            }
-        }
-        else if (left_arr[i] == j && right_arr[j] == i){
-            /* check forward */
-            if (i < (int)lhs_elements.size() - 1 &&
-                left_arr[i + 1] != SUMFLAT &&
-                lhs_elements[i + 1].first.compare(lhs_elements[i].first) == 0) {
-                if (left_arr[i + 1] == EMPTYFLAT){
-                    return RIGHT_EMPTY;
-                }
-                else if (j + 1 < (int)rhs_elements.size()){
-                    if (left_arr[i + 1] == j + 1 &&
-                        right_arr[j + 1] == i + 1 &&
-                        rhs_elements[j + 1].first.compare(rhs_elements[j].first) == 0){
-                        return RIGHT_EQUAL;
-                    }
-                }
-            }
-            /* check backward */
-            if (i > 0 &&
-                left_arr[i - 1] != SUMFLAT &&
-                lhs_elements[i - 1].first.compare(lhs_elements[i].first) == 0) {
-                if (left_arr[i - 1] == EMPTYFLAT){
-                    return LEFT_EMPTY;
-                }
-                else if (startPos > 0){
-                    if (left_arr[startPos - 1] == j - 1 &&
-                        right_arr[j - 1] == startPos - 1 &&
-                        rhs_elements[startPos - 1].first.compare(rhs_elements[startPos].first) == 0){
-                        return LEFT_EQUAL;
-                    }
-                }
-            }
-        }
-        return NONE;
-    }
-    /*
-     * First base case
-     */
-    void theory_trau::setup_0_0_general(){
-        int_vector tmpLeft;
-        int_vector tmpRight;
-
-        if (!arrangements.contains(std::make_pair(0, 0)) || arrangements[std::make_pair(0, 0)].size() == 0) {
-            /* left = right */
-            tmpLeft.push_back(0);
-            tmpRight.push_back(0);
-            vector<Arrangment> tmp;
-            tmp.push_back(Arrangment(tmpLeft, tmpRight));
-            arrangements.insert(std::make_pair(0, 0), tmp);
-        }
-    }
-
-    /*
-     * 2nd base case [0] = (sum rhs...)
-     */
-    void theory_trau::setup_0_n_general(int lhs, int rhs){
-
-        /* left always has SUMFLAT */
-        int_vector tmpLeft;
-        tmpLeft.push_back(SUMFLAT);
-
-        /* right has i number of 0 */
-        int_vector tmpRight;
-        tmpRight.push_back(0);
-
-        for (int i = 1 ; i < rhs; ++i){
-            tmpRight.push_back(0);
-
-            vector<Arrangment> tmp04;
-            tmp04.push_back(Arrangment(tmpLeft, tmpRight));
-
-            /* update */
-            /* add directly without checking */
-            if (!arrangements.contains(std::make_pair(0, i)) || arrangements[std::make_pair(0, i)].size() == 0) {
-                arrangements.insert(std::make_pair(0, i), tmp04);
-            }
-        }
-    }
-
-    /*
-     * 2nd base case (sum lhs...) = [0]
-     */
-    void theory_trau::setup_n_0_general(int lhs, int rhs){
-
-        /* right always has SUMFLAT */
-        int_vector tmpRight;
-        tmpRight.push_back(SUMFLAT);
-
-        /* left has i number of 0 */
-        int_vector tmpLeft;
-        tmpLeft.push_back(0);
-
-        for (int i = 1; i < lhs; ++i) {
-            tmpLeft.push_back(0);
-
-            vector<Arrangment> tmp04;
-            tmp04.push_back(Arrangment(tmpLeft, tmpRight));
-
-            /* add directly without checking */
-            if (!arrangements.contains(std::make_pair(i, 0)) || arrangements[std::make_pair(i, 0)].size() == 0) {
-                arrangements.insert(std::make_pair(i, 0), tmp04);
-            }
-        }
-    }
-
-    /*
-     * general case
-     */
-    void theory_trau::setup_n_n_general(
-            int lhs,
-            int rhs){
-
-        for (int i = 0 ; i < lhs; ++i)
-            for (int j = 0; j < rhs; ++j)
-                if (!arrangements.contains(std::make_pair(i,j))){
-                    /* 2.0 [i] = empty */
-                    vector<Arrangment> tmp01_ext = arrangements[std::make_pair(i - 1, j)];
-                    for (unsigned int t = 0 ; t < tmp01_ext.size(); ++t) {
-                        tmp01_ext[t].add_left(EMPTYFLAT);
-                    }
-
-                    /* 2.1 [j] = empty */
-                    vector<Arrangment> tmp02_ext = arrangements[std::make_pair(i, j - 1)];
-                    for (unsigned int t = 0 ; t < tmp02_ext.size(); ++t) {
-                        tmp02_ext[t].add_right(EMPTYFLAT);
-                    }
-
-                    /* 3.1 [i] = sum(k...j) */
-                    vector<Arrangment> tmp03;
-
-                    {
-                        /* [i] = sum (0..j) */
-                        int_vector tmpLeft;
-                        for (int k = 0; k < i; ++k)
-                            tmpLeft.push_back(EMPTYFLAT);
-                        tmpLeft.push_back(SUMFLAT);
-
-                        int_vector tmpRight;
-                        for (int k = 0 ; k <= j; ++k)
-                            tmpRight.push_back(i);
-
-                        SASSERT ((int)tmpLeft.size() == i + 1);
-                        SASSERT ((int)tmpRight.size() == j + 1);
-                        tmp03.push_back(Arrangment(tmpLeft, tmpRight));
-                    }
-
-                    /* [i] = sum (k..j) */
-                    for (int k = 1; k < j; ++k) {
-                        vector<Arrangment> tmp03_ext = arrangements[std::make_pair(i - 1, k - 1)];
-                        for (unsigned int t = 0; t < tmp03_ext.size(); ++t) {
-
-                            tmp03_ext[t].add_left(SUMFLAT);
-                            for (int tt = k; tt <= j; ++tt)
-                                tmp03_ext[t].add_right(i);
-
-
-                            SASSERT ((int)tmp03_ext[t].left_arr.size() == i + 1);
-                            SASSERT ((int)tmp03_ext[t].right_arr.size() == j + 1);
-                        }
-
-                        tmp03.append(tmp03_ext);
-                    }
-
-                    /* 3.2 right = sum(...left) */
-                    vector<Arrangment> tmp04;
-
-                    /* sum (k..i)  = [j] */
-                    for (int k = 1; k < i; ++k) {
-                        vector<Arrangment> tmp04_ext = arrangements[std::make_pair(k - 1, j - 1)];
-                        for (unsigned int t = 0; t < tmp04_ext.size(); ++t) {
-                            tmp04_ext[t].add_right(SUMFLAT);
-                            for (int tt = k; tt <= i; ++tt)
-                                tmp04_ext[t].add_left(j);
-
-                            SASSERT ((int)tmp04_ext[t].left_arr.size() == i + 1);
-                            SASSERT ((int)tmp04_ext[t].right_arr.size() == j + 1);
+                    else if (startPos > 0){
+                        if (left_arr[startPos - 1] == j - 1 &&
+                            right_arr[j - 1] == startPos - 1 &&
+                            rhs_elements[j - 1].first.compare(rhs_elements[j].first) == 0){
+                            return LEFT_EQUAL;
                         }
-
-                        tmp04.append(tmp04_ext);
                     }
-
-                    {
-                        /* sum (0..i)  = [j] */
-                        int_vector tmpLeft;
-                        for (int k = 0 ; k <= i; ++k)
-                            tmpLeft.push_back(j);
-
-                        int_vector tmpRight;
-                        for (int k = 0; k < j; ++k)
-                            tmpRight.push_back(EMPTYFLAT);
-                        tmpRight.push_back(SUMFLAT);
-
-                        SASSERT ((int)tmpLeft.size() == i + 1);
-                        SASSERT ((int)tmpRight.size() == j + 1);
-                        tmp04.push_back(Arrangment(tmpLeft, tmpRight));
+            }
+        }
+        else if (left_arr[i] == j && right_arr[j] == i){
+            /* check forward */
+            if (i < (int)lhs_elements.size() - 1 &&
+                left_arr[i + 1] != SUMFLAT &&
+                lhs_elements[i + 1].first.compare(lhs_elements[i].first) == 0) {
+                if (left_arr[i + 1] == EMPTYFLAT){
+                    return RIGHT_EMPTY;
+                }
+                else if (j + 1 < (int)rhs_elements.size()){
+                    if (left_arr[i + 1] == j + 1 &&
+                        right_arr[j + 1] == i + 1 &&
+                        rhs_elements[j + 1].first.compare(rhs_elements[j].first) == 0){
+                        return RIGHT_EQUAL;
                     }
-
-                    /* fourth case: left = right */
-                    vector<Arrangment> tmp05 = arrangements[std::make_pair(i - 1, j - 1)];
-                    for (unsigned int k = 0; k < tmp05.size(); ++k) {
-                        tmp05[k].add_right(i);
-                        tmp05[k].add_left(j);
+                }
+            }
+            /* check backward */
+            if (i > 0 &&
+                left_arr[i - 1] != SUMFLAT &&
+                lhs_elements[i - 1].first.compare(lhs_elements[i].first) == 0) {
+                if (left_arr[i - 1] == EMPTYFLAT){
+                    return LEFT_EMPTY;
+                }
+                else if (startPos > 0){
+                    if (left_arr[startPos - 1] == j - 1 &&
+                        right_arr[j - 1] == startPos - 1 &&
+                        rhs_elements[startPos - 1].first.compare(rhs_elements[startPos].first) == 0){
+                        return LEFT_EQUAL;
                     }
-
-                    /* update */
-                    /* add directly */
-                    vector<Arrangment> possibleCases;
-                    possibleCases.append(tmp03);
-                    possibleCases.append(tmp04);
-                    possibleCases.append(tmp05);
-                    arrangements.insert(std::make_pair(i, j), possibleCases);
                 }
+            }
+        }
+        return NONE;
     }
-
     vector<std::pair<std::string, int>> theory_trau::vectorExpr2vectorStr(pair_expr_vector const& v){
         vector<std::pair<std::string, int>> ret;
         for (unsigned i = 0; i < v.size(); ++i)
@@ -12694,7 +13943,7 @@ namespace smt {
                     expr_ref_vector constraints(m);
 
 
-                    if (u.re.is_star(v)) {
+                    if (u.re.is_star(regex)) {
                         constraints.push_back(createGreaterEqOP(v1, mk_int(0)));
                         constraints.push_back(createGreaterEqOP(v2, mk_int(0)));
                     } else {
@@ -12774,9 +14023,12 @@ namespace smt {
 //        assert_axiom(to_assert);
 //        implied_facts.push_back(to_assert);
 
-        // len >= bound --> part 2 = bound
+        // bound = k /\ len >= k + 1 --> part 2 = k
         rational bound_1 = str_int_bound + rational(1);
-        premise = createGreaterEqOP(len, mk_int(bound_1));
+        expr_ref_vector premises(m);
+        premises.push_back(createEqualOP(get_bound_str_int_control_var(), mk_int(str_int_bound)));
+        premises.push_back(createGreaterEqOP(len, mk_int(bound_1)));
+        premise = createAndOP(premises);
         conclusion = createEqualOP(part2, mk_int(str_int_bound));
         to_assert = rewrite_implication(premise, conclusion);
         assert_axiom(to_assert);
@@ -12825,7 +14077,7 @@ namespace smt {
 
                     expr_ref v1(get_var_flat_size(std::make_pair(v, start)), m);
                     expr_ref v2(get_flat_iter(std::make_pair(v, start)), m);
-                    if (u.re.is_star(v)) {
+                    if (u.re.is_star(regex)) {
                         constraints.push_back(createGreaterEqOP(v1, mk_int(0)));
                         constraints.push_back(createGreaterEqOP(v2, mk_int(0)));
                     } else {
@@ -15449,6 +16701,7 @@ namespace smt {
         }
 
         std::pair<app*, app*> value = std::make_pair<app*, app*>(mk_str_var("pre_contain"), mk_str_var("post_contain"));
+        mark_var_kind(value.first, VAR_CONTAIN);
         expr_ref haystack(ex->get_arg(0), m), needle(ex->get_arg(1), m);
 
         app* a = mk_contains(haystack, needle);
@@ -15477,19 +16730,7 @@ namespace smt {
             }
         }
 
-        for (const auto& p : contain_pair_bool_map){
-            if (u.str.is_extract(p.get_key1()) && p.get_key2() == needle.get()){
-                app* substr = to_app(p.get_key1());
-                rational ra;
-                if (substr->get_arg(0) == haystack.get() &&
-                    m_autil.is_numeral(substr->get_arg(1), ra) && ra.get_int64() == 0){
-                    app *rootContain = mk_contains(p.get_key1(), needle.get());
-                    enode* keynode = ensure_enode(rootContain);
-                    SASSERT(contain_split_map.contains(keynode));
-                    assert_axiom(createEqualOP(value.first, contain_split_map[keynode].first->get_owner()));
-                }
-            }
-        }
+        sync_substr_contain_prefix(haystack, needle, value.first);
 
         expr_ref breakdownAssert(ctx.mk_eq_atom(ex, ctx.mk_eq_atom(ex->get_arg(0), mk_concat(ts0, mk_concat(ex->get_arg(1), ts1)))), m);
         SASSERT(breakdownAssert);
@@ -15594,6 +16835,7 @@ namespace smt {
         }
         else {
             value = std::make_pair<app*, app*>(mk_str_var("indexOf1"), mk_str_var("indexOf2"));
+            mark_var_kind(value.first, VAR_CONTAIN);
             contain_split_map.insert(key, std::make_pair(ctx.get_enode(value.first), ctx.get_enode(value.second)));
         }
 
@@ -15611,20 +16853,7 @@ namespace smt {
             }
         }
 
-        for (const auto& p : contain_pair_bool_map){
-            if (u.str.is_extract(p.get_key1()) && p.get_key2() == needle.get()){
-                app* substr = to_app(p.get_key1());
-                STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << " found substr contain " << mk_pp(haystack.get(), m) << std::endl;);
-                rational ra;
-                if (substr->get_arg(0) == haystack.get() &&
-                    m_autil.is_numeral(substr->get_arg(1), ra) && ra.get_int64() == 0){
-                    app *rootContain = mk_contains(p.get_key1(), needle.get());
-                    enode* keynode = ensure_enode(rootContain);
-                    SASSERT(contain_split_map.contains(keynode));
-                    assert_axiom(createEqualOP(value.first, contain_split_map[keynode].first->get_owner()));
-                }
-            }
-        }
+        sync_substr_contain_prefix(haystack, needle, value.first);
 
         expr_ref x1(value.first, m);
         expr_ref x2(value.second, m);
@@ -16139,6 +17368,7 @@ namespace smt {
         }
         else {
             value = std::make_pair<app*, app*>(mk_str_var("replace1"), mk_str_var("replace2"));
+            mark_var_kind(value.first, VAR_CONTAIN);
             contain_split_map.insert(key, std::make_pair(ctx.get_enode(value.first), ctx.get_enode(value.second)));
         }
 
@@ -16157,21 +17387,7 @@ namespace smt {
             }
         }
 
-        for (const auto& p : contain_pair_bool_map){
-            if (u.str.is_extract(p.get_key1()) && p.get_key2() == needle.get()){
-                app* substr = to_app(p.get_key1());
-                rational ra;
-                if (substr->get_arg(0) == haystack.get() &&
-                    m_autil.is_numeral(substr->get_arg(1), ra) && ra.get_int64() == 0){
-                    STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << " found substr contain " << mk_pp(haystack.get(), m) << std::endl;);
-                    app *rootContain = mk_contains(p.get_key1(), needle.get());
-                    enode* keynode = ensure_enode(rootContain);
-                    SASSERT(contain_split_map.contains(keynode));
-                    STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << " trying new assert " << mk_pp(haystack.get(), m) << std::endl;);
-                    assert_axiom(createEqualOP(value.first, contain_split_map[keynode].first->get_owner()));
-                }
-            }
-        }
+        sync_substr_contain_prefix(haystack, needle, value.first);
 
         expr_ref x1(value.first, m);
         expr_ref x2(value.second, m);
@@ -16339,7 +17555,8 @@ namespace smt {
 
         zstring needle_str;
         zstring haystack_0_str;
-        if (u.str.is_string(needle, needle_str) && u.str.is_string(nodes[pos], haystack_0_str) && !haystack_0_str.contains(needle_str)) {
+        if (u.str.is_string(needle, needle_str) && u.str.is_string(nodes[pos], haystack_0_str) && !haystack_0_str.contains(needle_str) &&
+            !overlaps_needle(haystack_0_str, needle_str, true)) {
             expr* tmp = create_concat_from_vector(nodes, pos);
             if (u.str.is_replace(ex)) {
                 expr_ref replace(mk_replace(tmp, needle.get(), a->get_arg(2)), m);
@@ -16366,7 +17583,7 @@ namespace smt {
                 nodes.pop_back();
 
                 if (u.str.is_string(needle, needle_str) && u.str.is_string(last, haystack_0_str) &&
-                    !haystack_0_str.contains(needle_str)) {
+                    !haystack_0_str.contains(needle_str) && !overlaps_needle(haystack_0_str, needle_str, false)) {
                     expr *tmp = create_concat_from_vector(nodes);
                     if (u.str.is_replace(ex)) {
                         expr_ref replace(mk_replace(tmp, needle.get(), a->get_arg(2)), m);
@@ -16391,6 +17608,18 @@ namespace smt {
         return false;
     }
 
+    /*
+     * true if the needle can start inside a leading constant (a suffix of it is a prefix of the needle),
+     * or end inside a trailing one, so the constant cannot be dropped from the haystack
+     */
+    bool theory_trau::overlaps_needle(zstring const& str, zstring const& needle, bool leading){
+        for (unsigned i = 1; i < needle.length() && i <= str.length(); ++i) {
+            if (leading ? needle.extract(0, i).suffixof(str) : needle.extract(needle.length() - i, i).prefixof(str))
+                return true;
+        }
+        return false;
+    }
+
     void theory_trau::instantiate_axiom_regexIn(enode * e) {
         context &ctx = get_context();
         
@@ -16414,6 +17643,13 @@ namespace smt {
             regex_in_var_reg_str_map[ex->get_arg(0)].insert(regexStr);
         }
 
+        if (m_params.m_TrauLengthAbstraction) {
+            // length conflicts are then found by arithmetic before any under-approximation
+            expr_ref len_cond = mk_regex_length_constraint(mk_strlen(ex->get_arg(0)), ex->get_arg(1));
+            if (len_cond)
+                assert_implication(ex, len_cond);
+        }
+
         expr_ref str(ex->get_arg(0), m);
         app *regex = to_app(ex->get_arg(1));
 
@@ -16430,7 +17666,7 @@ namespace smt {
                 m_delayed_assertions_todo.push_back(rewrite_implication(ex, createGreaterEqOP(mk_strlen(ex->get_arg(0)), mk_int(1))));
             }
 
-            expr_ref_vector regexElements = combine_const_str(parse_regex_components(remove_star_in_star(regex)));
+            expr_ref_vector regexElements = regex_elements(regex);
             int boundLen = 100000;
             STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << ":" << regexElements.size() << std::endl;);
             expr_ref_vector ors(m);
@@ -16497,6 +17733,13 @@ namespace smt {
                         expr* tmp = mk_str_var(expr2str(elements[i]));
                         concat = concat == nullptr ? tmp : mk_concat(concat, tmp);
                     }
+                    else {
+                        // intersections and complements are left to the automaton of their own membership
+                        expr* tmp = mk_str_var(expr2str(elements[i]));
+                        expr* tmp_in_re = u.re.mk_in_re(tmp, elements[i]);
+                        m_delayed_assertions_todo.push_back(tmp_in_re);
+                        concat = concat == nullptr ? tmp : mk_concat(concat, tmp);
+                    }
                     ensure_enode(concat);
                     ensure_enode(mk_strlen(concat));
                 }
@@ -16725,7 +17968,13 @@ namespace smt {
         buffer << "!tmp";
         buffer << m_fresh_id;
         m_fresh_id++;
-        return u.mk_skolem(symbol(buffer.c_str()), 0, nullptr, s);
+        app* a = u.mk_skolem(symbol(buffer.c_str()), 0, nullptr, s);
+        // keep a alive so that its id is not reused while it is marked
+        m_trail.push_back(a);
+        mark_var_kind(a, VAR_INTERNAL);
+        if (std::string(name).compare(0, FLATPREFIX.size(), FLATPREFIX) == 0)
+            mark_var_kind(a, VAR_FLAT);
+        return a;
     }
 
     app * theory_trau::mk_str_var(std::string name) {
@@ -16745,6 +17994,7 @@ namespace smt {
 
         variable_set.insert(a);
         internal_variable_set.insert(a);
+        mark_var_kind(a, VAR_STR);
 
         return a;
     }
@@ -16912,6 +18162,7 @@ namespace smt {
         variable_set.insert(a);
         //internal_variable_set.insert(a);
         regex_variable_set.insert(a);
+        mark_var_kind(a, VAR_REGEX);
 
         return a;
     }
@@ -16957,13 +18208,27 @@ namespace smt {
         context & ctx = get_context();
         STRACE("str", tout << __FUNCTION__ << ":" << name << std::endl;);
         sort * int_sort = m.mk_sort(m_autil.get_family_id(), INT_SORT);
-        sort * arr_sort = m_arrayUtil.mk_array_sort(int_sort, int_sort);
+        // with bit-vector characters, the array itself is the backing array for positions beyond the bound
+        bool bv_chars = use_bv_chars();
+        sort * char_sort = bv_chars ? m_bv.mk_sort(BVCHARSIZE) : int_sort;
+        sort * arr_sort = m_arrayUtil.mk_array_sort(int_sort, char_sort);
         app * a = mk_fresh_const(name.encode().c_str(), arr_sort);
         ctx.internalize(a, false);
         ctx.mark_as_relevant(a);
         // I'm assuming that this combination will do the correct thing in the integer theory.
 
         m_trail.push_back(a);
+        mark_var_kind(a, VAR_ARR);
+
+        if (bv_chars) {
+            bv_chars_used = true;
+            bv_flat_array* flat = alloc(bv_flat_array, m);
+            for (int i = 0; i < connectingSize; ++i)
+                flat->m_chars.push_back(mk_fresh_const(name.encode().c_str(), char_sort));
+            flat->m_rest = a;
+            bv_flat_store.push_back(flat);
+            bv_flat_arrays.insert(a, flat);
+        }
 
         return a;
     }
@@ -17328,20 +18593,20 @@ namespace smt {
         }
     }
 
-    eautomaton* theory_trau::get_automaton(expr* re) {
-        eautomaton* result = nullptr;
-        
-        if (m_re2aut.find(re, result)) {
-            return result;
-        }
-        if (!m_mk_aut.has_solver()) {
-            m_mk_aut.set_solver(alloc(seq_expr_solver, m, get_context().get_fparams()));
-        }
-        result = m_mk_aut(re);
-        m_automata.push_back(result);
-        m_re2aut.insert(re, result);
-        m_res.push_back(re);
-        return result;
+    bool theory_trau::is_regex_empty(expr* re) {
+        return m_aut_cache->is_empty(re);
+    }
+
+    /*
+     * Explore the product of the cached automata of a and b lazily,
+     * and build the automaton of their intersection only if a guard cannot be compared directly.
+     */
+    bool theory_trau::is_regex_intersection_empty(expr* a, expr* b) {
+        lbool r = m_aut_cache->is_intersection_empty(a, b);
+        if (r != l_undef)
+            return r == l_true;
+        expr_ref intersection(u.re.mk_inter(a, b), m);
+        return is_regex_empty(intersection);
     }
 
     /*
@@ -17416,45 +18681,55 @@ namespace smt {
     expr* theory_trau::query_theory_arith_core(expr* n, model_generator& mg){
         context& ctx = get_context();
         family_id afid = m_autil.get_family_id();
+        // the arithmetic solver can only build values for terms it owns
+        if (!ctx.e_internalized(n) || ctx.get_enode(n)->get_th_var(afid) == null_theory_var)
+            return nullptr;
+        enode* e = ctx.get_enode(n);
         expr_ref_vector values(m);
-        app* value = nullptr;
+        model_value_proc* tmp = nullptr;
         do {
             theory_mi_arith* tha = get_th_arith<theory_mi_arith>(ctx, afid, n);
             if (tha) {
                 STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << " " << mk_pp(n, m) << std::endl;);
-                model_value_proc* tmp = tha->mk_value(ctx.get_enode(n), mg);
-                value = tmp->mk_value(mg, values);
+                tmp = tha->mk_value(e, mg);
                 break;
             }
             theory_i_arith* thi = get_th_arith<theory_i_arith>(ctx, afid, n);
             if (thi) {
                 STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << " " << mk_pp(n, m) << std::endl;);
-                model_value_proc* tmp = tha->mk_value(ctx.get_enode(n), mg);
-                value = tmp->mk_value(mg, values);
+                tmp = thi->mk_value(e, mg);
                 break;
             }
             theory_lra* thr = get_th_arith<theory_lra>(ctx, afid, n);
             if (thr) {
                 STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << " " << mk_pp(n, m) << std::endl;);
-                model_value_proc* tmp = tha->mk_value(ctx.get_enode(n), mg);
-                value = tmp->mk_value(mg, values);
+                tmp = thr->mk_value(e, mg);
                 break;
             }
-            break;
         }
         while (false);
 
+        if (!tmp)
+            return nullptr;
+        app* value = tmp->mk_value(mg, values);
+        dealloc(tmp);
         return value;
     }
 
     void theory_trau::init_model(model_generator& mg) {
-        
+        m_stats.m_models++;
+        scoped_watch _sw(m_model_watch);
         context& ctx = get_context();
         STRACE("str", tout << "initializing model..." << std::endl;);
         expr_ref_vector included_nodes(m);
 
         // prepare dependency_graph
-        for (const auto& n : uState.eq_combination) {
+        dependency_graph.reset();
+        expr_array_linkers.reset();
+        model_lens.reset();
+        model_indexed_concats.reset();
+        model_offsets.reset();
+        for (const auto& n : uState.eq_combination()) {
             if (!ctx.is_relevant(n.m_key))
                 continue;
 
@@ -17574,6 +18849,32 @@ namespace smt {
 
     void theory_trau::finalize_model(model_generator& mg) {
         STRACE("str", tout << "finalizing model..." << std::endl;);
+        model_lens.reset();
+        model_indexed_concats.reset();
+        model_offsets.reset();
+        if (m_params.m_TrauWarmStart)
+            save_warm_start(mg);
+    }
+
+    /*
+     * Remember the lengths of the input string variables in the model, for the next check.
+     */
+    void theory_trau::save_warm_start(model_generator& mg){
+        context& ctx = get_context();
+        sort* str_sort = u.str.mk_string_sort();
+        m_warm_vars.reset();
+        m_warm_lens.reset();
+        for (enode* n : ctx.enodes()) {
+            app* v = n->get_owner();
+            if (!is_uninterp_const(v) || m.get_sort(v) != str_sort || has_var_kind(v, VAR_INTERNAL | VAR_STR | VAR_REGEX))
+                continue;
+            expr* val = mg.get_model().get_const_interp(v->get_decl());
+            zstring str;
+            if (val == nullptr || !u.str.is_string(val, str))
+                continue;
+            m_warm_vars.push_back(v);
+            m_warm_lens.push_back(str.length());
+        }
     }
 
     void theory_trau::assert_axiom(expr *const e) {
@@ -17681,18 +18982,25 @@ namespace smt {
         expr_ref_vector all_vars = collect_all_vars_in_eq_combination(eq_combination);
         expr_ref_vector ret(m);
         add_equalities_to_core(guessed_exprs, all_vars, ret);
-        add_assignments_to_core(all_vars, ret);
-        add_disequalities_to_core(diseq_exprs, ret);
+        add_context_to_core(all_vars, diseq_exprs, bound, ret);
+
+        guessed_exprs.reset();
+        guessed_exprs.append(ret);
+    }
+
+    /*
+     * the parts of a core that depend on the current context, after its equalities
+     */
+    void theory_trau::add_context_to_core(expr_ref_vector const& all_vars, expr_ref_vector const& diseq_exprs, rational bound, expr_ref_vector &core){
+        add_assignments_to_core(all_vars, core);
+        add_disequalities_to_core(diseq_exprs, core);
 
         if (get_bound_str_int_control_var() != nullptr) {
             if (bound == rational(0))
-                ret.push_back(createEqualOP(get_bound_str_int_control_var(), mk_int(str_int_bound)));
+                core.push_back(createEqualOP(get_bound_str_int_control_var(), mk_int(str_int_bound)));
             else
-                ret.push_back(createEqualOP(get_bound_str_int_control_var(), mk_int(bound)));
+                core.push_back(createEqualOP(get_bound_str_int_control_var(), mk_int(bound)));
         }
-
-        guessed_exprs.reset();
-        guessed_exprs.append(ret);
     }
 
     void theory_trau::add_equalities_to_core(expr_ref_vector guessed_exprs, expr_ref_vector &all_vars, expr_ref_vector &core){
@@ -17986,8 +19294,17 @@ namespace smt {
     }
 
     void theory_trau::fetch_guessed_exprs_from_cache(UnderApproxState const& state, expr_ref_vector &guessed_exprs) {
-        guessed_exprs.append(state.equalities);
-        fetch_guessed_core_exprs(state.eq_combination, guessed_exprs, state.disequalities, state.str_int_bound);
+        guessed_exprs.append(state.equalities());
+        fetch_guessed_core_exprs(state.eq_combination(), guessed_exprs, state.disequalities(), state.str_int_bound);
+    }
+
+    void theory_trau::fetch_guessed_exprs_from_cache(unsigned branch, expr_ref_vector &guessed_exprs) {
+        UnderApproxState const& state = completed_branches[branch];
+        completed_branch_core const& c = *completed_branch_cores[branch];
+        expr_ref_vector ret(c.m_eqs);
+        add_context_to_core(c.m_vars, state.disequalities(), state.str_int_bound, ret);
+        guessed_exprs.reset();
+        guessed_exprs.append(ret);
     }
 
     void theory_trau::fetch_guessed_exprs_with_scopes(expr_ref_vector &guessed_eqs) {
@@ -18086,9 +19403,10 @@ namespace smt {
     }
 
     app * theory_trau::string_value_proc::mk_value(model_generator & mg, expr_ref_vector const &  values) {
+        scoped_watch _sw(th.m_model_watch);
         clock_t start_clock = clock();
         ast_manager & m = mg.get_manager();
-        obj_map<enode, app *> m_root2value = mg.get_root2value();
+        obj_map<enode, app *> const& m_root2value = mg.get_root2value();
         STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << ":"  << mk_pp(node, m) << std::endl;);
         clock_t t = clock();
         for (int i = 0; i < (int)m_dependencies.size(); ++i){
@@ -18225,42 +19543,7 @@ namespace smt {
     }
 
     void theory_trau::string_value_proc::collect_alternative_components(expr* v, vector<zstring>& ret){
-        expr *arg0 = nullptr, * arg1 = nullptr;
-        if (th.u.re.is_to_re(v, arg0)){
-            zstring tmpStr;
-            th.u.str.is_string(arg0, tmpStr);
-            ret.push_back(tmpStr);
-        }
-        else if (th.u.re.is_union(v, arg0, arg1)){
-            collect_alternative_components(arg0, ret);
-            collect_alternative_components(arg1, ret);
-        }
-        else if (th.u.re.is_star(v, arg0) || th.u.re.is_plus(v, arg0)) {
-            collect_alternative_components(arg0, ret);
-        }
-        else if (th.u.re.is_range(v, arg0, arg1)){
-            zstring start, finish;
-            th.u.str.is_string(arg0, start);
-            th.u.str.is_string(arg1, finish);
-            SASSERT(start.length() == 1);
-            SASSERT(finish.length() == 1);
-
-            for (int i = start[0]; i <= (int)finish[0]; ++i){
-                zstring tmp(i);
-                ret.push_back(tmp);
-            }
-        }
-        else if (th.u.re.is_concat(v)) {
-            expr* tmp = is_regex_plus_breakdown(v);
-            if (tmp != nullptr){
-                return collect_alternative_components(tmp, ret);
-            }
-            else
-                NOT_IMPLEMENTED_YET();
-        }
-        else {
-            NOT_IMPLEMENTED_YET();
-        }
+        th.collect_alternative_components(v, ret);
     }
 
     expr* theory_trau::string_value_proc::is_regex_plus_breakdown(expr* e){
@@ -18285,7 +19568,7 @@ namespace smt {
         STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << " " << mk_pp(node, mg.get_manager())  << ": NOT important" << std::endl;);
         if (len_int != -1) {
             // non root var
-            bool constraint01 = !th.uState.eq_combination.contains(node);
+            bool constraint01 = !th.uState.eq_combination().contains(node);
             if (!th.dependency_graph.contains(node))
                 th.dependency_graph.insert(node, {});
             bool constraint02 = th.dependency_graph[node].size() > 0;
@@ -18322,8 +19605,8 @@ namespace smt {
 
             if (th.u.str.is_concat(node))
                 construct_string(mg, node, m_root2value, val);
-            if (th.uState.eq_combination.contains(node))
-                for (const auto &eq : th.uState.eq_combination[node]) {
+            if (th.uState.eq_combination().contains(node))
+                for (const auto &eq : th.uState.eq_combination()[node]) {
                     construct_string(mg, eq, m_root2value, val);
                 }
             std::string ret = "";
@@ -18344,91 +19627,178 @@ namespace smt {
         return false;
     }
 
-    bool theory_trau::string_value_proc::construct_string_from_array(model_generator mg, obj_map<enode, app *> const& m_root2value, enode *arr, int len_int, zstring &val){
+    /*
+     * characters of a bit-vector flat array fixed by the model
+     */
+    bool theory_trau::string_value_proc::get_bv_flat_chars(obj_map<enode, app *> const& m_root2value, expr *arr, int_vector &vValue){
+        bv_flat_array* flat = nullptr;
+        if (!th.bv_flat_arrays.find(arr, flat))
+            return false;
+        context& ctx = th.get_context();
+        for (unsigned i = 0; i < vValue.size() && i < flat->m_chars.size(); ++i) {
+            expr* c = flat->m_chars.get(i);
+            app* val = nullptr;
+            rational v;
+            unsigned sz;
+            if (ctx.e_internalized(c) && m_root2value.find(ctx.get_enode(c)->get_root(), val) && th.m_bv.is_numeral(val, v, sz))
+                vValue[i] = v.get_int32();
+        }
+        return true;
+    }
+
+    bool theory_trau::string_value_proc::construct_string_from_array(model_generator &mg, obj_map<enode, app *> const& m_root2value, enode *arr, int len_int, zstring &val){
         SASSERT(arr->get_owner() != nullptr);
         STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << " " << mk_pp(arr->get_owner(), mg.get_manager()) << " " << len_int << std::endl;);
 
         app* arr_val = nullptr;
         if (m_root2value.find(arr, arr_val)) {
             int_vector vValue (len_int, -1);
-
-            func_decl * fd = to_func_decl(arr_val->get_parameter(0).get_ast());
-            func_interp* fi = mg.get_model().get_func_interp(fd);
-
-            unsigned num_entries = fi->num_entries();
-            for (unsigned i = 0; i < num_entries; i++){
-                func_entry const* fe = fi->get_entry(i);
-                expr* k =  fe->get_arg(0);
-                rational key;
-                if (th.m_autil.is_numeral(k, key) && key.get_int32() >=0 ) {
-                    expr* v =  fe->get_result();
-
-                    rational value;
-                    if (th.m_autil.is_numeral(v, value)) {
-                        if (key.get_int32() < (int)vValue.size())
-                            vValue[key.get_int32()] = value.get_int32();
-                    }
-                }
-            }
+            // with bit-vector characters the array only holds the positions beyond the bound
+            decode_array(mg, arr_val, vValue);
+            get_bv_flat_chars(m_root2value, arr->get_owner(), vValue);
+            for (auto& v : vValue)
+                v = th.decode_char(v);
 
             STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << std::endl;);
 
             bool completed = true;
-            zstring value;
-
             unsigned_set char_set;
             get_char_range(char_set);
-            value = fill_chars(vValue, char_set, completed);
- ;
-            val = value;
+            val = fill_chars(vValue, char_set, completed);
 
             // revise string basing on regex
-            if (char_set.size() == 0) {
-                if (regex != nullptr) {
+            if (char_set.size() == 0 && regex != nullptr) {
+                vector<zstring> elements = collect_alternative_components(regex);
+                if (elements.size() == 1 && elements[0].length() > 0 && len_int % elements[0].length() == 0){
                     if (!match_regex(regex, val)) {
-                        vector<zstring> elements = collect_alternative_components(regex);
-                        if (elements.size() == 1 && len_int % elements[0].length() == 0){
-                            zstring new_str("");
-                            create_string_with_length(elements, new_str, len_int);
-                            val = new_str;
-                            return true;
-                        }
-                        for (int i = 0; i < (int)value.length(); ++i) {
-                            zstring tmp = val.extract(0, i);
-                            if (!match_regex(regex, tmp)) {
-                                int err_pos = i;
-                                for (err_pos = i + 1; err_pos < (int)value.length(); ++err_pos)
-                                    if (value[err_pos] != value[i]) {
-                                        break;
-                                    }
-
-                                zstring working_str("");
-                                if (i > 0)
-                                    working_str = val.extract(0, i - 1);
-
-                                zstring new_str("");
-                                if (create_string_with_length(elements, new_str, err_pos - i + 1)) {
-                                    val = working_str + new_str + value.extract(i + new_str.length() - 1, value.length() - (i + new_str.length() - 1));
-                                }
-                                else
-                                    NOT_IMPLEMENTED_YET();
-                                i = i + new_str.length() - 1;
-                            }
-                        }
+                        zstring new_str("");
+                        create_string_with_length(elements, new_str, len_int);
+                        val = new_str;
+                        return true;
                     }
                 }
+                else
+                    repair_by_regex(elements, val);
             }
 
-            if (completed == false) {
-                return false;
-            }
-
-            return true;
+            return completed;
         }
 
         return false;
     }
 
+    /*
+     * Read the entries of the array interpretation of arr_val into vValue in one pass.
+     * Keys outside [0, vValue.size()) and values that are not small integer or bit-vector numerals are skipped.
+     */
+    void theory_trau::string_value_proc::decode_array(model_generator &mg, app *arr_val, int_vector &vValue){
+        func_decl * fd = to_func_decl(arr_val->get_parameter(0).get_ast());
+        func_interp* fi = mg.get_model().get_func_interp(fd);
+        if (fi == nullptr)
+            return;
+        rational key, value;
+        bool is_int;
+        for (unsigned i = 0; i < fi->num_entries(); i++){
+            func_entry const* fe = fi->get_entry(i);
+            if (!th.m_autil.is_numeral(fe->get_arg(0), key, is_int) || !key.is_unsigned() || key.get_unsigned() >= vValue.size())
+                continue;
+            unsigned sz;
+            if ((th.m_autil.is_numeral(fe->get_result(), value, is_int) || th.m_bv.is_numeral(fe->get_result(), value, sz)) && value.is_int32())
+                vValue[key.get_unsigned()] = value.get_int32();
+        }
+    }
+
+    /*
+     * Whether character c satisfies guard t; l_undef for guards that are not ground characters or ranges.
+     */
+    static lbool char_in_guard(seq_util& u, sym_expr* t, unsigned c) {
+        unsigned lo, hi;
+        if (t->is_char())
+            return u.is_const_char(t->get_char(), lo) ? to_lbool(lo == c) : l_undef;
+        if (t->is_range()) {
+            if (!u.is_const_char(t->get_lo(), lo) || !u.is_const_char(t->get_hi(), hi))
+                return l_undef;
+            return to_lbool(lo <= c && c <= hi);
+        }
+        if (t->is_not())
+            return ~char_in_guard(u, t->get_arg(), c);
+        return l_undef;
+    }
+
+    /*
+     * Walk the automaton of the regex over val once, keeping the set of reachable states.
+     * When a character leaves no state, the text from the last accepted prefix to the end of
+     * the run of that character is replaced by components of the regex of the same length.
+     * Guards that cannot be evaluated are taken as satisfied.
+     */
+    void theory_trau::string_value_proc::repair_by_regex(vector<zstring> const& elements, zstring &val){
+        scoped_ptr<eautomaton> owned;
+        eautomaton* aut = th.m_aut_cache->get(regex, owned);
+        if (!aut)
+            return;
+        svector<bool> in_set(aut->num_states(), false);
+        unsigned_vector curr, next, closure, anchor_set;
+
+        auto add = [&](unsigned s, unsigned_vector& set) {
+            closure.reset();
+            aut->get_epsilon_closure(s, closure);
+            for (unsigned t : closure)
+                if (!in_set[t]) {
+                    in_set[t] = true;
+                    set.push_back(t);
+                }
+        };
+        auto clear = [&](unsigned_vector const& set) {
+            for (unsigned t : set)
+                in_set[t] = false;
+        };
+        auto step = [&](unsigned c) {
+            next.reset();
+            for (unsigned s : curr)
+                for (auto const& mv : aut->get_moves_from(s))
+                    if (!mv.is_epsilon() && char_in_guard(th.u, mv.t(), c) != l_false)
+                        add(mv.dst(), next);
+            clear(next);
+            curr.swap(next);
+            return !curr.empty();
+        };
+        auto accepting = [&]() {
+            for (unsigned s : curr)
+                if (aut->is_final_state(s))
+                    return true;
+            return false;
+        };
+
+        add(aut->init(), curr);
+        clear(curr);
+        anchor_set = curr;
+        unsigned anchor = 0;
+        unsigned i = 0;
+        while (i < val.length()) {
+            if (!step(val[i])) {
+                unsigned run_end = i + 1;
+                while (run_end < val.length() && val[run_end] == val[i])
+                    ++run_end;
+                zstring piece("");
+                if (!create_string_with_length(elements, piece, run_end - anchor))
+                    return;
+                STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << " @" << i << ": " << val << " -> " << piece << std::endl;);
+                val = val.extract(0, anchor) + piece + val.extract(run_end, val.length() - run_end);
+                curr = anchor_set;
+                for (unsigned j = 0; j < piece.length(); ++j)
+                    if (!step(piece[j]))
+                        return;
+                i = run_end;
+            }
+            else
+                ++i;
+            if (accepting()) {
+                anchor = i;
+                anchor_set = curr;
+            }
+        }
+    }
+
     bool theory_trau::string_value_proc::get_char_range(unsigned_set & char_set){
         if (regex != nullptr) {
             // special case for numbers
@@ -18500,8 +19870,7 @@ namespace smt {
                 }
                 else {
                     int len_int = -1;
-                    if (get_int_value(mg, th.get_context().get_enode(th.mk_strlen(leafNodes[i])), m_root2value,
-                                      len_int)){
+                    if (get_len_value(mg, leafNodes[i], m_root2value, len_int)){
                         sum += len_int;
                         STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << ": sum = "  << sum << std::endl;);
                     }
@@ -18526,8 +19895,8 @@ namespace smt {
                 }
 
                 // find in its eq
-                if (th.uState.eq_combination.contains(ancestor)) {
-                    for (const auto &ancestor_i : th.uState.eq_combination[ancestor]) {
+                if (th.uState.eq_combination().contains(ancestor)) {
+                    for (const auto &ancestor_i : th.uState.eq_combination()[ancestor]) {
                         if (th.u.str.is_concat(ancestor_i)) {
                             if (fetch_value_belong_to_concat(mg, ancestor_i, ancestorValue, m_root2value, len, value)) {
                                 STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << ": value = " << value << std::endl;);
@@ -18542,71 +19911,66 @@ namespace smt {
         return false;
     }
 
-    bool theory_trau::string_value_proc::fetch_value_belong_to_concat(model_generator &mg, expr *concat, zstring concatValue, obj_map<enode, app *> const& m_root2value, int len, zstring &value){
-        if (th.u.str.is_concat(concat)){
-
-            ptr_vector<expr> leafNodes;
-            th.get_all_nodes_in_concat(concat, leafNodes);
-
-            if (leafNodes.contains(node) || (linker != nullptr && leafNodes.contains(linker))) {
-                STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << ": found in "  << mk_pp(concat, th.get_manager()) << std::endl;);
-                expr* tmp = nullptr;
-                if (leafNodes.contains(node))
-                    tmp = node;
-                else
-                    tmp = linker;
-                STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << ": found in "  << mk_pp(concat, th.get_manager()) << std::endl;);
-                int prefix = find_prefix_len(mg, concat, tmp, m_root2value);
-                STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << ": prefix = "  << prefix << std::endl;);
-                value = concatValue.extract(prefix, len);
-                return true;
-            }
+    bool theory_trau::string_value_proc::fetch_value_belong_to_concat(model_generator &mg, expr *concat, zstring const& concatValue, obj_map<enode, app *> const& m_root2value, int len, zstring &value){
+        if (!th.u.str.is_concat(concat))
             return false;
-        }
-        return false;
+        index_concat(mg, concat, m_root2value);
+        int prefix = 0;
+        if (!th.model_offsets.find(concat, node, prefix) && (linker == nullptr || !th.model_offsets.find(concat, linker, prefix)))
+            return false;
+        STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << ": found in "  << mk_pp(concat, th.get_manager()) << " prefix = " << prefix << std::endl;);
+        value = concatValue.extract(prefix, len);
+        return true;
     }
 
-    int theory_trau::string_value_proc::find_prefix_len(model_generator &mg, expr *concat, expr *subNode, obj_map<enode, app *> const& m_root2value){
-
-        if (th.u.str.is_concat(concat)){
-            int prefix = 0;
-            find_prefix_len(mg, concat, subNode, m_root2value, prefix);
-            return prefix;
+    /*
+     * Record the offset of every subterm of concat in the model being built, in one pre-order pass.
+     * A subterm that occurs more than once keeps the offset of its first occurrence.
+     */
+    void theory_trau::string_value_proc::index_concat(model_generator &mg, expr *concat, obj_map<enode, app *> const& m_root2value){
+        if (th.model_indexed_concats.contains(concat))
+            return;
+        th.model_indexed_concats.insert(concat);
+        int offset = 0;
+        ptr_vector<expr> todo;
+        todo.push_back(concat);
+        while (!todo.empty()) {
+            expr* curr = todo.back();
+            todo.pop_back();
+            if (!th.model_offsets.contains(concat, curr))
+                th.model_offsets.insert(concat, curr, offset);
+            expr* e1 = nullptr, *e2 = nullptr;
+            if (th.u.str.is_concat(curr, e1, e2)) {
+                todo.push_back(e2);
+                todo.push_back(e1);
+            }
+            else {
+                int sub_len = 0;
+                if (get_len_value(mg, curr, m_root2value, sub_len))
+                    offset += sub_len;
+                else
+                    SASSERT(false);
+            }
         }
-        else
-            SASSERT(false);
-
-        return -1;
     }
 
-    bool theory_trau::string_value_proc::find_prefix_len(model_generator &mg, expr *concat, expr *subNode, obj_map<enode, app *> const& m_root2value, int &prefix){
-        if (concat == subNode)
+    /*
+     * Length of a concat leaf in the model being built, memoised until the model is finalized.
+     */
+    bool theory_trau::string_value_proc::get_len_value(model_generator &mg, expr *e, obj_map<enode, app *> const& m_root2value, int &len){
+        if (th.model_lens.find(e, len))
             return true;
-        expr* e1 = nullptr, *e2 = nullptr;
-        if (th.u.str.is_concat(concat, e1, e2)){
-            if (!find_prefix_len(mg, e1, subNode, m_root2value, prefix)) {
-                if (!find_prefix_len(mg, e2, subNode, m_root2value, prefix))
-                    return false;
-                else
-                    return true;
-            }
-            else
-                return true;
-        }
+        zstring val_str;
+        if (th.u.str.is_string(e, val_str))
+            len = val_str.length();
         else {
-            int subLen = -1;
-            zstring val_str;
-            if (th.u.str.is_string(concat, val_str)){
-                prefix += val_str.length();
-            }
-            else if (get_int_value(mg, th.get_context().get_enode(th.mk_strlen(concat)), m_root2value, subLen)) {
-                prefix += subLen;
-            }
-            else {
-                SASSERT(false);
-            }
+            context& ctx = th.get_context();
+            expr* len_e = th.mk_strlen(e);
+            if (!ctx.e_internalized(len_e) || !get_int_value(mg, ctx.get_enode(len_e), m_root2value, len))
+                return false;
         }
-        return false;
+        th.model_lens.insert(e, len);
+        return true;
     }
 
     bool theory_trau::string_value_proc::get_int_value(model_generator &mg, enode *n, obj_map<enode, app *> const& m_root2value, int &value){
@@ -18668,22 +20032,7 @@ namespace smt {
     }
 
     bool theory_trau::string_value_proc::match_regex(expr *a, expr *b) {
-        expr* intersection = th.u.re.mk_inter(a, b);
-        eautomaton *au01 = get_automaton(intersection);
-        return !au01->is_empty();
-    }
-
-    eautomaton* theory_trau::string_value_proc::get_automaton(expr* re) {
-        eautomaton* result = nullptr;
-        if (th.m_re2aut.find(re, result)) {
-            return result;
-        }
-
-        result = th.m_mk_aut(re);
-        th.m_automata.push_back(result);
-        th.m_re2aut.insert(re, result);
-        th.m_res.push_back(re);
-        return result;
+        return !th.is_regex_intersection_empty(a, b);
     }
 
     bool can_split(int boundedFlat, int boundSize, int pos, std::string frame, vector<std::string> &flats) {
@@ -8,6 +8,7 @@
 #include <vector> 
 #include "ast/arith_decl_plugin.h"
 #include "ast/array_decl_plugin.h"
+#include "ast/bv_decl_plugin.h"
 #include "ast/ast_pp.h"
 #include "smt/params/theory_str_params.h"
 #include "smt/proto_model/value_factory.h"
@@ -17,11 +18,15 @@
 #include "smt/smt_model_generator.h"
 #include "smt/smt_theory.h"
 #include "util/hashtable.h"
+#include "util/ref.h"
 #include "util/scoped_vector.h"
 #include "util/scoped_ptr_vector.h"
+#include "util/stopwatch.h"
 #include "util/trail.h"
 #include "util/union_find.h"
 #include "smt/smt_arith_value.h"
+#include "smt/trau_arrangements.h"
+#include "smt/trau_automata_cache.h"
 
 #define LOCALSPLITMAX 20
 #define SUMFLAT 100000000
@@ -35,6 +40,7 @@
 #define ITERSUFFIX "__iter"
 #define ZERO "0"
 #define REGEXSUFFIX "_10000"
+#define BVCHARSIZE 8
 
 namespace smt {
 
@@ -68,6 +74,39 @@ namespace smt {
         typedef std::pair<expr*, int>                                           expr_int;
         typedef old_svector<expr_int>                                           pair_expr_vector;
 
+        /*
+         * Structural key of an equality lhs = rhs:
+         * ids of the lhs elements followed by ids of the rhs elements.
+         * Ids are only unique among live expressions, so the elements of a key stay
+         * pinned in generated_equality_terms as long as the key is in generated_equalities.
+         */
+        struct eq_key {
+            unsigned        m_lhs_size;
+            unsigned        m_hash;
+            unsigned_vector m_ids;
+            eq_key(): m_lhs_size(0), m_hash(0) {}
+            eq_key(pair_expr_vector const& lhs_elements, pair_expr_vector const& rhs_elements): m_lhs_size(lhs_elements.size()) {
+                m_ids.resize(lhs_elements.size() + rhs_elements.size());
+                for (unsigned i = 0; i < lhs_elements.size(); ++i)
+                    m_ids[i] = lhs_elements[i].first->get_id();
+                for (unsigned i = 0; i < rhs_elements.size(); ++i)
+                    m_ids[m_lhs_size + i] = rhs_elements[i].first->get_id();
+                m_hash = string_hash(reinterpret_cast<char const*>(m_ids.c_ptr()), m_ids.size() * sizeof(unsigned), m_lhs_size);
+            }
+            bool operator==(eq_key const& other) const {
+                if (m_hash != other.m_hash || m_lhs_size != other.m_lhs_size || m_ids.size() != other.m_ids.size())
+                    return false;
+                for (unsigned i = 0; i < m_ids.size(); ++i)
+                    if (m_ids[i] != other.m_ids[i])
+                        return false;
+                return true;
+            }
+        };
+        struct eq_key_hash_proc {
+            unsigned operator()(eq_key const& k) const { return k.m_hash; }
+        };
+        typedef hashtable<eq_key, eq_key_hash_proc, default_eq<eq_key> >        eq_key_set;
+
 
         class Arrangment{
         public:
@@ -83,22 +122,49 @@ namespace smt {
             void print(std::string msg = "");
         };
 
-        typedef map<std::pair<int, int>, vector<Arrangment>, pair_hash<int_hash, int_hash>, default_eq<std::pair<int, int>>> arrangment_map;
-        class UnderApproxState{
+        /*
+         * Payload of an UnderApproxState. Copies of a state share it,
+         * and it is copied before being modified while shared.
+         */
+        class UnderApproxData {
+            unsigned m_ref_count = 0;
         public:
             obj_map<expr, ptr_vector<expr>> eq_combination;
             obj_map<expr, int> non_fresh_vars;
             expr_ref_vector equalities;
             expr_ref_vector disequalities;
+            expr_ref_vector asserting_constraints;
+
+            UnderApproxData(ast_manager &m) : equalities(m), disequalities(m), asserting_constraints(m) {}
+
+            UnderApproxData(UnderApproxData const& other) :
+                eq_combination(other.eq_combination),
+                non_fresh_vars(other.non_fresh_vars),
+                equalities(other.equalities),
+                disequalities(other.disequalities),
+                asserting_constraints(other.asserting_constraints) {}
+
+            void inc_ref() { ++m_ref_count; }
+            void dec_ref() { SASSERT(m_ref_count > 0); if (--m_ref_count == 0) dealloc(this); }
+            bool is_shared() const { return m_ref_count > 1; }
+        };
+
+        class UnderApproxState{
+            ref<UnderApproxData> m_data;
+
+            UnderApproxData& data() {
+                if (m_data->is_shared())
+                    m_data = alloc(UnderApproxData, *m_data);
+                return *m_data;
+            }
+        public:
             bool reassertEQ = false;
             bool reassertDisEQ = false;
             int eqLevel = -1;
             int diseqLevel = -1;
-            expr_ref_vector asserting_constraints;
             rational str_int_bound;
 
-            UnderApproxState(ast_manager &m) : equalities(m), disequalities(m), asserting_constraints(m){
-                eq_combination.reset();
+            UnderApproxState(ast_manager &m) : m_data(alloc(UnderApproxData, m)) {
             }
 
             UnderApproxState(ast_manager &m, int _eqLevel, int _diseqLevel,
@@ -107,31 +173,54 @@ namespace smt {
                             expr_ref_vector const& _equalities,
                             expr_ref_vector const& _disequalities,
                             rational _str_int_bound):
-                            eq_combination(_eq_combination),
-                            non_fresh_vars(_non_fresh_vars),
-                            equalities(m),
-                            disequalities(m),
+                            m_data(alloc(UnderApproxData, m)),
                             eqLevel(_eqLevel),
                             diseqLevel(_diseqLevel),
-                            asserting_constraints(m),
                             str_int_bound(_str_int_bound){
-                asserting_constraints.reset();
-                equalities.reset();
-                equalities.append(_equalities);
-                disequalities.reset();
-                disequalities.append(_disequalities);
+                m_data->eq_combination = _eq_combination;
+                m_data->non_fresh_vars = _non_fresh_vars;
+                m_data->equalities.append(_equalities);
+                m_data->disequalities.append(_disequalities);
                 reassertEQ = true;
                 reassertDisEQ = true;
             }
 
             UnderApproxState clone(ast_manager &m){
-                UnderApproxState tmp(m, eqLevel, diseqLevel, eq_combination, non_fresh_vars, equalities, disequalities, str_int_bound);
-                tmp.add_asserting_constraints(asserting_constraints);
+                UnderApproxState tmp(*this);
+                tmp.reassertEQ = true;
+                tmp.reassertDisEQ = true;
                 reassertEQ = true;
                 reassertDisEQ = true;
                 return tmp;
             }
 
+            obj_map<expr, ptr_vector<expr>> const& eq_combination() const { return m_data->eq_combination; }
+            obj_map<expr, int> const& non_fresh_vars() const { return m_data->non_fresh_vars; }
+            expr_ref_vector const& equalities() const { return m_data->equalities; }
+            expr_ref_vector const& disequalities() const { return m_data->disequalities; }
+            expr_ref_vector const& asserting_constraints() const { return m_data->asserting_constraints; }
+
+            /*
+             * true if both states share the same payload
+             */
+            bool same_data(UnderApproxState const& other) const { return m_data.get() == other.m_data.get(); }
+
+            void set_equalities(expr_ref_vector const& _equalities){
+                UnderApproxData& d = data();
+                d.equalities.reset();
+                d.equalities.append(_equalities);
+            }
+
+            void set_disequalities(expr_ref_vector const& _disequalities){
+                UnderApproxData& d = data();
+                d.disequalities.reset();
+                d.disequalities.append(_disequalities);
+            }
+
+            void add_non_fresh_var(expr* v, int val){
+                data().non_fresh_vars.insert(v, val);
+            }
+
             void reset_eq(){
                 STRACE("str", tout << __LINE__ <<  " *** " << __FUNCTION__ <<  ": eqLevel = " << eqLevel << "; diseqLevel = " << diseqLevel << std::endl;);
                 eqLevel = -1;
@@ -147,48 +236,45 @@ namespace smt {
             UnderApproxState&  operator=(const UnderApproxState& other){
                 eqLevel = other.eqLevel;
                 diseqLevel = other.diseqLevel;
-                eq_combination = other.eq_combination;
-                non_fresh_vars = other.non_fresh_vars;
-                equalities.reset();
-                equalities.append(other.equalities);
-                disequalities.reset();
-                disequalities.append(other.disequalities);
-                asserting_constraints.reset();
+                m_data = other.m_data.get();
                 reassertEQ = true;
                 reassertDisEQ = true;
-                for (unsigned i = 0; i < other.asserting_constraints.size(); ++i)
-                    asserting_constraints.push_back(other.asserting_constraints[i]);
 
-                STRACE("str", tout << __LINE__ <<  " *** " << __FUNCTION__ << ":  eq_combination: " << other.eq_combination.size() << " --> " << eq_combination.size() << std::endl;);
+                STRACE("str", tout << __LINE__ <<  " *** " << __FUNCTION__ << ":  eq_combination: " << other.eq_combination().size() << " --> " << eq_combination().size() << std::endl;);
                 return *this;
             }
 
-            void add_asserting_constraints(expr_ref_vector _assertingConstraints){
+            void add_asserting_constraints(expr_ref_vector const& _assertingConstraints){
+                UnderApproxData& d = data();
                 for (unsigned i = 0; i < _assertingConstraints.size(); ++i)
-                    asserting_constraints.push_back(_assertingConstraints.get(i));
+                    d.asserting_constraints.push_back(_assertingConstraints.get(i));
             }
 
-            void add_asserting_constraints(expr_ref assertingConstraint){
-                asserting_constraints.push_back(assertingConstraint);
+            void add_asserting_constraints(expr_ref const& assertingConstraint){
+                data().asserting_constraints.push_back(assertingConstraint);
             }
 
-            bool operator==(const UnderApproxState state){
-                obj_map<expr, ptr_vector<expr>> _eq_combination = state.eq_combination;
-                if (_eq_combination.size() != eq_combination.size()) {
-                    STRACE("str", tout << __LINE__ <<  " *** " << __FUNCTION__ << ": " << _eq_combination.size() << " vs " << eq_combination.size() <<  std::endl;);
+            bool operator==(UnderApproxState const& state) const {
+                if (same_data(state))
+                    return true;
+                obj_map<expr, ptr_vector<expr>> const& eq_combination = this->eq_combination();
+                obj_map<expr, int> const& non_fresh_vars = this->non_fresh_vars();
+                if (state.eq_combination().size() != eq_combination.size()) {
+                    STRACE("str", tout << __LINE__ <<  " *** " << __FUNCTION__ << ": " << state.eq_combination().size() << " vs " << eq_combination.size() <<  std::endl;);
                     return false;
                 }
 
                 for (const auto& v : non_fresh_vars)
-                    if (!state.non_fresh_vars.contains(v.m_key)) {
+                    if (!state.non_fresh_vars().contains(v.m_key)) {
                         return false;
                     }
 
                 for (const auto& n : eq_combination) {
-                    if (_eq_combination.contains(n.m_key)) {
+                    auto const* other = state.eq_combination().find_core(n.m_key);
+                    if (other == nullptr) {
                         return false;
                     }
-                    ptr_vector<expr> tmp = _eq_combination[n.m_key];
+                    ptr_vector<expr> const& tmp = other->get_data().m_value;
                     for (const auto &e : n.get_value()) {
 
                         if (!tmp.contains(e)) {
@@ -204,6 +290,66 @@ namespace smt {
             }
         };
 
+        /*
+         * Equalities of the core of a completed branch, and the variables they reach.
+         */
+        struct completed_branch_core {
+            expr_ref_vector m_eqs;
+            expr_ref_vector m_vars;
+            completed_branch_core(ast_manager& m): m_eqs(m), m_vars(m) {}
+        };
+
+        /*
+         * Content of a flat array under str.trau_bv_flat_arrays: one bit-vector
+         * character per position below the bound, and a backing array with
+         * bit-vector range for the positions beyond it.
+         */
+        struct bv_flat_array {
+            expr_ref_vector m_chars;
+            expr_ref        m_rest;
+            bv_flat_array(ast_manager& m): m_chars(m), m_rest(m) {}
+        };
+
+        /*
+         * Digit terms of a flat array for the string-integer encodings, extended
+         * one position at a time when the string-integer bound grows.
+         */
+        struct str_int_unrolling {
+            expr_ref_vector m_values;   // m_values[l - 1]: number written by positions [0, l)
+            expr_ref_vector m_valid;    // m_valid[l - 1]: positions [0, l) hold digits
+            str_int_unrolling(ast_manager& m): m_values(m), m_valid(m) {}
+        };
+
+        /*
+         * Facts about a regex term, computed once and kept in regex_infos.
+         * The fields below the length bounds are filled on first use, because
+         * the helpers that compute them only accept some shapes of regexes.
+         */
+        struct regex_info {
+            expr*                       m_body = nullptr;   // r for r* and r+
+            bool                        m_is_star = false;
+            bool                        m_is_plus = false;
+            zstring                     m_content;          // see parse_regex_content
+            unsigned                    m_min_len = 0;
+            unsigned                    m_max_len = UINT_MAX;   // UINT_MAX if unbounded
+
+            bool                        m_has_strs = false;
+            bool                        m_strs_ok = false;
+            vector<zstring>             m_strs;             // alternatives as strings
+            bool                        m_has_alts = false;
+            bool                        m_alts_ok = false;
+            ptr_vector<expr>            m_alts;             // alternatives as regexes
+            bool                        m_has_elements = false;
+            ptr_vector<expr>            m_elements;         // star-free components, see regex_elements
+            bool                        m_has_ranges = false;
+            vector<std::pair<int, int>> m_ranges;           // see collect_char_range
+            bool                        m_has_lengths = false;
+            bool                        m_lengths_ok = false;
+            unsigned_vector             m_fixed_lens;       // word lengths below the periodic part
+            unsigned_vector             m_periodic_lens;    // l + k * m_len_period for k >= 0
+            unsigned                    m_len_period = 0;
+        };
+
         class string_value_proc : public model_value_proc {
             theory_trau&                     th;
             sort*                           m_sort;
@@ -217,11 +363,11 @@ namespace smt {
         public:
 
             string_value_proc(theory_trau& th, sort * s, app* node, bool _non_fresh_var, enode* arr_node, expr* regex, int len = -1):
-                    th(th), m_sort(s), node(node), arr_node(arr_node), non_fresh_var(_non_fresh_var), regex(regex), len(len){
+                    th(th), m_sort(s), node(node), arr_node(arr_node), non_fresh_var(_non_fresh_var), regex(regex), linker(nullptr), len(len){
             }
 
             string_value_proc(theory_trau& th, sort * s, app* node, bool _non_fresh_var, expr* regex, int len = -1):
-                    th(th), m_sort(s), node(node), non_fresh_var(_non_fresh_var), regex(regex), len(len){
+                    th(th), m_sort(s), node(node), arr_node(nullptr), non_fresh_var(_non_fresh_var), regex(regex), linker(nullptr), len(len){
             }
 
             ~string_value_proc() override {}
@@ -233,6 +379,9 @@ namespace smt {
                 m_dependencies.push_back(model_value_dependency(value));
             }
             void add_entry(enode * value){
+                // values are only built for relevant classes
+                if (!th.get_context().is_relevant(value))
+                    return;
                 STRACE("str", tout << __LINE__ << " " << __FUNCTION__ << ":"  << mk_pp(node, th.get_manager()) << " --> " << mk_pp(value->get_owner(), th.get_manager()) << std::endl;);
                 m_dependencies.push_back(model_value_dependency(value));
             }
@@ -250,19 +399,21 @@ namespace smt {
             void collect_alternative_components(expr* v, vector<zstring>& ret);
             expr* is_regex_plus_breakdown(expr* e);
             bool construct_normally(model_generator & mg, int len_int, obj_map<enode, app *> const& m_root2value, zstring& strValue);
-            bool construct_string_from_array(model_generator mg, obj_map<enode, app *> const& m_root2value, enode *arr, int len_int, zstring &val);
+            bool construct_string_from_array(model_generator &mg, obj_map<enode, app *> const& m_root2value, enode *arr, int len_int, zstring &val);
+            void decode_array(model_generator &mg, app *arr_val, int_vector &vValue);
+            void repair_by_regex(vector<zstring> const& elements, zstring &val);
+            bool get_bv_flat_chars(obj_map<enode, app *> const& m_root2value, expr *arr, int_vector &vValue);
             bool get_char_range(unsigned_set & char_set);
             zstring fill_chars(int_vector const& vValue, unsigned_set const& char_set, bool &completed);
             void construct_string(model_generator &mg, expr *eq, obj_map<enode, app *> const& m_root2value, int_vector &val);
             bool fetch_value_from_dep_graph(model_generator &mg, obj_map<enode, app *> const& m_root2value, int len, zstring &value);
-            bool fetch_value_belong_to_concat(model_generator &mg, expr *concat, zstring concatValue, obj_map<enode, app *> const& m_root2value, int len, zstring &value);
-            int find_prefix_len(model_generator &mg, expr *concat, expr *subNode, obj_map<enode, app *> const& m_root2value);
-            bool find_prefix_len(model_generator &mg, expr *concat, expr *subNode, obj_map<enode, app *> const& m_root2value, int &prefix);
+            bool fetch_value_belong_to_concat(model_generator &mg, expr *concat, zstring const& concatValue, obj_map<enode, app *> const& m_root2value, int len, zstring &value);
+            void index_concat(model_generator &mg, expr *concat, obj_map<enode, app *> const& m_root2value);
+            bool get_len_value(model_generator &mg, expr *e, obj_map<enode, app *> const& m_root2value, int &len);
             bool get_int_value(model_generator &mg, enode *n, obj_map<enode, app *> const& m_root2value, int &value);
             bool get_str_value(enode *n, obj_map<enode, app *> const& m_root2value, zstring &value);
             bool match_regex(expr *a, zstring b);
             bool match_regex(expr *a, expr *b);
-            eautomaton* get_automaton(expr* re);
         };
 
 
@@ -270,6 +421,7 @@ namespace smt {
         theory_trau(ast_manager& m, const theory_str_params& params);
         ~theory_trau() override;
         void display(std::ostream& os) const override;
+        void collect_statistics(::statistics & st) const override;
         th_trail_stack& get_trail_stack() { return m_trail_stack; }
         void merge_eh(theory_var, theory_var, theory_var v1, theory_var v2) {}
         void after_merge_eh(theory_var r1, theory_var r2, theory_var v1, theory_var v2) { }
@@ -298,6 +450,10 @@ namespace smt {
         bool is_non_fresh(expr *n, int &val);
         bool is_regex_var(expr* n, expr* &regexExpr);
         bool is_regex_var(expr* n);
+        void mark_var_kind(expr* e, unsigned kind);
+        bool has_var_kind(expr* e, unsigned kind) const;
+        expr* get_eqc_root(expr* e);
+        void update_regex_var_index();
         bool is_regex_concat(expr* n);
         expr_ref_vector get_dependencies(expr *n);
 
@@ -328,7 +484,30 @@ namespace smt {
         void pop_scope_eh(unsigned num_scopes) override;
         void reset_eh() override;
         final_check_status final_check_eh() override;
+        final_check_status final_check_core();
+            /*
+             * Incremental final check: inputs of the final check stages carry a version
+             * which is bumped by new_eq_eh, new_diseq_eh and assign_eh and restored on backtracking.
+             * A stage is skipped while none of its inputs changed since it last passed without adding axioms.
+             */
+            void touch_fc_input(unsigned input);
+            void update_fc_len_version();
+            unsigned fc_stage_inputs(unsigned stage) const;
+            bool is_fc_stage_clean(unsigned stage) const;
+            void mark_fc_stage_clean(unsigned stage);
+            void reset_fc_versions();
+            bool cached_init_chain_free(obj_map<expr, int> &non_fresh_vars, obj_map<expr, ptr_vector<expr>> &eq_combination);
+                bool same_eq_combination(obj_map<expr, ptr_vector<expr>> const& lhs, obj_map<expr, ptr_vector<expr>> const& rhs);
+                bool same_non_fresh_vars(obj_map<expr, int> const& lhs, obj_map<expr, int> const& rhs);
             bool eval_str_int();
+            void assert_str_int_bound();
+            bool decide_str_int_bound();
+            bool str_int_bound_refuted();
+            bool str_int_bound_holds();
+            void grow_str_int_bound();
+            void restart_search();
+            unsigned force_decisions(expr_ref_vector const& lits);
+            void save_warm_start(model_generator& mg);
             bool eval_disequal_str_int();
                 bool eq_to_i2s(expr* n, expr* &i2s);
 
@@ -352,6 +531,10 @@ namespace smt {
                 bool can_omit(expr* lhs, expr* rhs, zstring needle);
                 bool appear_in_other_eq(expr* root, zstring needle, obj_map<expr, ptr_vector<expr>> const& eq_combination);
             bool is_completed_branch(bool &addAxiom, expr_ref_vector &diff);
+                void add_completed_branch(UnderApproxState const& state);
+                bool is_same_completed_branch(unsigned i, expr_ref_vector const& guessed_eqs, expr_ref_vector const& guessed_diseqs, expr_ref_vector &diff);
+                unsigned eq_state_hash(expr_ref_vector const& guessed_eqs, expr_ref_vector const& guessed_diseqs);
+                expr* eq_class_min(expr* e);
             void update_state();
             bool propagate_eq_combination(obj_map<expr, ptr_vector<expr>> const& eq_combination);
             bool is_notContain_consistent(obj_map<expr, ptr_vector<expr>> const& eq_combination);
@@ -374,13 +557,14 @@ namespace smt {
 
             int get_actual_trau_lvl();
                 bool at_same_eq_state(UnderApproxState const& state, expr_ref_vector &diff);
+                bool at_same_eq_state(UnderApproxState const& state, expr_ref_vector const& prev_guessed_eqs, expr_ref_vector &diff);
                 bool at_same_diseq_state(expr_ref_vector const& curr_eq, expr_ref_vector const& curr_diseq, expr_ref_vector const& prev_diseq);
                 bool is_empty_comparison(expr* e);
         bool review_starting_ending_combination(obj_map<expr, ptr_vector<expr>> const& eq_combination);
             unsigned_set collect_char_domain_from_concat();
             unsigned_set collect_char_domain_from_eqmap(obj_map<expr, ptr_vector<expr>> const& eq_combination);
             bool handle_contain_family(obj_map<expr, ptr_vector<expr>> const& eq_combination);
-                expr* create_equations_over_contain_vars(expr* x, expr* y);
+                expr* create_equations_over_contain_vars(expr* x, expr* y, ptr_vector<expr> const& nodes_x, ptr_vector<expr> const& nodes_y);
             bool handle_charAt_family(obj_map<expr, ptr_vector<expr>> const& eq_combination);
                 bool are_equal_exprs(expr* x, expr* y);
             obj_hashtable<expr> get_eqc_roots();
@@ -406,6 +590,8 @@ namespace smt {
                         bool quickpath_int2str(expr* num, expr* str, bool cached = true);
                         expr* unroll_str2int(expr* n);
                         expr* unroll_str_int(expr* num, expr* str);
+                        str_int_unrolling& get_str_int_unrolling(expr* arr, unsigned len);
+                        void assert_str_int_exact_lens(expr* conversion, expr* num, expr* str);
                         expr* valid_str_int(expr* str);
                         expr* lower_bound_str_int(expr* num, expr* str);
                         expr* lower_bound_int_str(expr* num, expr* str);
@@ -457,7 +643,15 @@ namespace smt {
                     void static_analysis(obj_map<expr, ptr_vector<expr>> const& eq_combination);
             bool convert_equalities(obj_map<expr, ptr_vector<expr>> const& eq_combination,
                                            obj_map<expr, int> & non_fresh_vars,
-                                           expr* premise);
+                                           expr_ref_vector const& guessed_eqs);
+                void split_eq_combination(obj_map<expr, ptr_vector<expr>> const& eq_combination,
+                                          expr_ref_vector const& guessed_eqs,
+                                          vector<ptr_vector<expr>> &keys,
+                                          vector<ptr_vector<expr>> &premises,
+                                          vector<ptr_vector<expr>> &vars);
+                bool is_local_component(ptr_vector<expr> const& keys, ptr_vector<expr> const& vars,
+                                        obj_map<expr, ptr_vector<expr>> const& eq_combination,
+                                        obj_map<expr, int> const& non_fresh_vars);
                 bool is_long_equality(ptr_vector<expr> const& eqs);
                 expr* convert_other_equalities(ptr_vector<expr> const& eqs, obj_map<expr, int> const& non_fresh_vars);
                 expr* convert_long_equalities(expr* var, ptr_vector<expr> const& eqs, obj_map<expr, int> &non_fresh_vars);
@@ -470,6 +664,7 @@ namespace smt {
                 void negate_equalities();
                 void negate_context(expr* e);
                 void negate_context(expr_ref_vector const& v);
+                void minimize_conflict(expr_ref_vector &core);
                 expr* find_equivalent_variable(expr* e);
                 bool is_internal_var(expr* e);
                 bool is_internal_regex_var(expr* e, expr* &regex);
@@ -480,6 +675,11 @@ namespace smt {
                 */
                 zstring parse_regex_content(zstring str);
                 zstring parse_regex_content(expr* str);
+                regex_info& get_regex_info(expr* re);
+                void regex_length_bounds(expr* re, unsigned& lo, unsigned& hi);
+                bool regex_length_set(expr* re, regex_info& info);
+                expr_ref mk_regex_length_constraint(expr* len, expr* re);
+                expr_ref_vector regex_elements(expr* re);
                 expr_ref_vector combine_const_str(expr_ref_vector const& v);
                     bool isRegexStr(zstring str);
                     bool isUnionStr(zstring str);
@@ -493,6 +693,8 @@ namespace smt {
                     expr_ref_vector collect_alternative_components(expr* v);
                     bool collect_alternative_components(expr* v, expr_ref_vector& ret);
                     bool collect_alternative_components(expr* v, vector<zstring>& ret);
+                    bool compile_alternatives(expr* v, expr_ref_vector& ret);
+                    bool compile_alternatives(expr* v, vector<zstring>& ret);
                     int find_correspond_right_parentheses(int leftParentheses, zstring str);
 
                 string_set collect_strs_in_membership(expr* v);
@@ -506,7 +708,6 @@ namespace smt {
              */
             expr* equality_to_arith(pair_expr_vector const& lhs_elements, pair_expr_vector const& rhs_elements, obj_map<expr, int> const& non_fresh_variables, int p = PMAX);
                 expr* equality_to_arith_ordered(pair_expr_vector const& lhs_elements, pair_expr_vector const& rhs_elements, obj_map<expr, int> const& non_fresh_variables, int p);
-                zstring create_string_representation(pair_expr_vector const& lhs_elements, pair_expr_vector const& rhs_elements);
             /*
              * lhs: size of the lhs
              * rhs: size of the rhs
@@ -518,7 +719,7 @@ namespace smt {
              */
             expr_ref_vector arrange(pair_expr_vector const& lhs_elements, pair_expr_vector const& rhs_elements, obj_map<expr, int> const& non_fresh_variables, int p = PMAX);
             void get_arrangements(pair_expr_vector const& lhs_elements, pair_expr_vector const& rhs_elements, obj_map<expr, int> const& non_fresh_variables, vector<Arrangment> &possibleCases);
-            void update_possible_arrangements(pair_expr_vector const& lhs_elements, pair_expr_vector const& rhs_elements, vector<Arrangment> const& tmp, vector<Arrangment> &possibleCases);
+            void update_possible_arrangements(pair_expr_vector const& lhs_elements, pair_expr_vector const& rhs_elements, trau_arrangements::entry const& tmp, vector<Arrangment> &possibleCases);
 
             /*
              *
@@ -913,6 +1114,17 @@ namespace smt {
             app* createAndOP(expr_ref_vector ands);
             app* createOrOP(expr_ref_vector ors);
             app* createSelectOP(expr* x, expr* y);
+            bool is_bv_char(expr* e, expr*& c) const;
+            bool use_bv_chars() const;
+            expr* mk_bv_char(expr* e);
+            expr* mk_bv_char_select(bv_flat_array const& a, expr* idx);
+            void add_bv_flat_entries(string_value_proc* proc, expr* arr);
+            void setup_char_classes();
+            void record_char_select(expr* sel);
+            bool bound_char_selects();
+            unsigned char_code(unsigned ch) const;
+            app* mk_char(unsigned ch);
+            int decode_char(int code) const;
 
             int optimized_lhs(
                     int i, int startPos, int j,
@@ -939,22 +1151,6 @@ namespace smt {
             expr* get_bound_q_control_var();
 
             app* createITEOP(expr* c, expr* t, expr* e);
-            /*
-            * First base case
-            */
-            void setup_0_0_general();
-            /*
-             * 2nd base case [0] = (sum rhs...)
-             */
-            void setup_0_n_general(int lhs, int rhs);
-            /*
-             * 2nd base case (sum lhs...) = [0]
-             */
-            void setup_n_0_general(int lhs, int rhs);
-            /*
-             * general case
-             */
-            void setup_n_n_general(int lhs, int rhs);
             vector<std::pair<std::string, int>> vectorExpr2vectorStr(pair_expr_vector const& v);
             std::string expr2str(expr* node);
 
@@ -1114,6 +1310,8 @@ namespace smt {
         void check_contain_by_eqc_val(expr * varNode, expr * constNode);
         void check_contain_by_substr(expr * varNode, expr_ref_vector & willEqClass);
         bool in_contain_idx_map(expr * n);
+        void collect_contain_eq_nodes(expr * n, expr_ref_vector & eqcSet);
+        void sync_substr_contain_prefix(expr* haystack, expr* needle, expr* prefix);
         void check_contain_by_eq_nodes(expr * n1, expr * n2);
         /*
         * Decide whether n1 and n2 are already in the same equivalence class.
@@ -1151,6 +1349,7 @@ namespace smt {
 
         bool can_solve_contain_family(enode * e);
         bool can_reduce_contain_family(expr* ex);
+        bool overlaps_needle(zstring const& str, zstring const& needle, bool leading);
         app* mk_replace(expr* a, expr* b, expr* c) const;
         app* mk_at(expr* a, expr* b) const;
         expr* is_regex_plus_breakdown(expr* e);
@@ -1209,7 +1408,8 @@ namespace smt {
          * Collect important vars in AST node
          */
         void get_important_asts_in_node(expr * node, obj_map<expr, int> const& non_fresh_vars, expr_ref_vector & astList, bool consider_itself = false);
-        eautomaton* get_automaton(expr* re);
+        bool is_regex_empty(expr* re);
+        bool is_regex_intersection_empty(expr* a, expr* b);
 
         expr * rewrite_implication(expr * premise, expr * conclusion);
         void assert_implication(expr * premise, expr * conclusion);
@@ -1220,6 +1420,7 @@ namespace smt {
         seq_rewriter                                        m_seq_rewrite;
         arith_util                                          m_autil;
         array_util                                          m_arrayUtil;
+        bv_util                                             m_bv;
         seq_util                                            u;
         expr_ref_vector                                     m_trail; // trail for generated terms
         th_union_find                                       m_find;
@@ -1230,7 +1431,6 @@ namespace smt {
         obj_map<expr, expr*>                                 regex_in_bool_map;
         obj_map<expr, string_set >                          regex_in_var_reg_str_map;
 
-        scoped_ptr_vector<eautomaton>                       m_automata;
         ptr_vector<eautomaton>                              regex_automata;
         obj_hashtable<expr>                                 regex_terms;
         obj_map<expr, ptr_vector<expr> >                    regex_terms_by_string; // S --> [ (str.in.re S *) ]
@@ -1273,20 +1473,47 @@ namespace smt {
         string_map                                          stringConstantCache;
         unsigned long                                       totalCacheAccessCount;
 
-        obj_map<expr, eautomaton*>                          m_re2aut;
-        re2automaton                                        m_mk_aut;
-        expr_ref_vector                                     m_res;
+        trau_automata_cache*                                m_aut_cache;
         rational                                            p_bound = rational(2);
         rational                                            q_bound = rational(10);
         rational                                            str_int_bound;
         rational                                            max_str_int_bound = rational(10);
+        rational                                            str_int_start_bound = rational(10);    // first bound of a check; the one reached before under warm start
+        expr_ref                                            str_int_bound_lit;                      // StrIntBound = str_int_bound, decided true below the maximum
+        unsigned                                            str_int_bound_conflicts = 0;            // conflicts of the context when the bound was set
+        // input string variables of the last model and their lengths, for warm start
+        expr_ref_vector                                     m_warm_vars;
+        unsigned_vector                                     m_warm_lens;
+
+        struct stats {
+            unsigned m_final_checks;
+            unsigned m_underapprox_rounds;
+            unsigned m_arrangements;            // arrangements kept by arrange()
+            unsigned m_completed_branch_hits;
+            unsigned m_generated_eq_hits;
+            unsigned m_models;
+            unsigned m_eq_components;
+            unsigned m_char_class_refinements;
+            unsigned m_warm_start_hints;        // length decisions seeded from the last model
+            unsigned m_str_int_bound_refutations;
+            stats() { reset(); }
+            void reset() { memset(this, 0, sizeof(*this)); }
+        };
+        stats                                               m_stats;
+        /* cumulative time per final-check stage */
+        stopwatch                                           m_final_check_watch;
+        stopwatch                                           m_chain_free_watch;
+        stopwatch                                           m_parikh_watch;
+        stopwatch                                           m_underapprox_watch;
+        stopwatch                                           m_convert_watch;
+        stopwatch                                           m_arrange_watch;
+        stopwatch                                           m_model_watch;
         rational                                            max_p_bound = rational(3);
         rational                                            max_q_bound = rational(20);
         expr*                                               str_int_bound_expr = nullptr;
         expr*                                               p_bound_expr = nullptr;
         expr*                                               q_bound_expr = nullptr;
         bool                                                flat_enabled = false;
-        bool                                                need_change = false;
         /*
          * If DisableIntegerTheoryIntegration is set to true,
          * ALL calls to the integer theory integration methods
@@ -1320,8 +1547,8 @@ namespace smt {
 
         obj_map<expr, int>                                  var_pieces_counter;
         obj_map<expr, int>                                  curr_var_pieces_counter;
-        string_set                                          generated_equalities;
-        arrangment_map                                      arrangements; 
+        eq_key_set                                          generated_equalities;
+        expr_ref_vector                                     generated_equality_terms;   // elements of the keys in generated_equalities
         string_set                                          const_set;
         unsigned_set                                        sigma_domain;
         obj_map<expr, ptr_vector <expr>>                    length_map;
@@ -1330,15 +1557,94 @@ namespace smt {
         obj_map<expr, expr_set>                             not_contain_map;
         obj_map<expr, expr_set>                             dependency_graph;
         obj_map<expr, expr*>                                expr_array_linkers;
+        obj_map<expr, int>                                  model_lens;             // concat leaf -> length in the model being built
+        expr_set                                            model_indexed_concats;
+        obj_pair_map<expr, expr, int>                       model_offsets;          // (concat, subterm) -> offset of its first occurrence
         obj_map<expr, expr*>                                array_map;
         string_map                                          array_map_reverse;
+        obj_map<expr, bv_flat_array*>                       bv_flat_arrays;     // array handle -> per-position characters
+        obj_map<expr, regex_info*>                          regex_infos;
+        obj_map<expr, str_int_unrolling*>                   str_int_unrollings;     // flat array -> digit terms
+        scoped_ptr_vector<str_int_unrolling>                str_int_unrolling_store;
+        obj_pair_map<expr, expr, unsigned>                  str_int_exact_lens;     // (conversion, flat array) -> lengths asserted so far
+        scoped_ptr_vector<regex_info>                       regex_info_store;
+        scoped_ptr_vector<bv_flat_array>                    bv_flat_store;
+        obj_pair_map<expr, expr, expr*>                     bv_select_cache;    // (backing array, symbolic index) -> character
         obj_map<expr, expr*>                                arr_linker;
-        int                                                 connectingSize;
+        int                                                 connectingSize = 0;
         char                                                default_char = 'a';
+        unsigned_vector                                     char_class_lo;      // class k is [char_class_lo[k], char_class_lo[k + 1])
+        unsigned_vector                                     char_class_rep;     // character a class decodes to
+        bool                                                char_classes_used = false;
+        unsigned                                            max_input_char = 0;     // largest character of the input, without classes
+        bool                                                bv_chars_used = false;  // some flat array has bit-vector characters
+        obj_hashtable<expr>                                 char_selects;       // flat-array characters, bounded lazily
         UnderApproxState                                    uState;
         vector<UnderApproxState>                            completed_branches;
+        scoped_ptr_vector<completed_branch_core>            completed_branch_cores;     // equality part of the core of each completed branch
+        u_map<unsigned_vector>                              completed_branch_index;     // eq_state_hash at completion -> completed branches
 
         expr_ref_vector                                     implied_facts;
+
+        // incremental final check
+        enum {
+            FC_IN_EQ = 0,       // new_eq_eh
+            FC_IN_DISEQ = 1,    // new_diseq_eh
+            FC_IN_ASSIGN = 2,   // assign_eh
+            FC_IN_LEN = 3,      // length values and new enodes, recomputed in final_check_eh
+            FC_IN_COMB = 4,     // output of init_chain_free
+            FC_IN_NUM = 5
+        };
+
+        enum {
+            FC_INIT_CHAIN_FREE = 0,
+            FC_STARTING_ENDING = 1,
+            FC_DISEQ_NOT_CONTAIN = 2,
+            FC_NOT_CONTAIN_CONSISTENT = 3,
+            FC_CONTAIN_FAMILY = 4,
+            FC_CHARAT_FAMILY = 5,
+            FC_EQ_COMBINATION = 6,
+            FC_PARIKH = 7,
+            FC_NUM_STAGES = 8
+        };
+
+        unsigned                                            m_fc_stamp = 0;
+        unsigned                                            m_fc_version[FC_IN_NUM];
+        unsigned                                            m_fc_clean[FC_NUM_STAGES][FC_IN_NUM];
+        unsigned_vector                                     m_fc_len_ids;       // owner id, root id per snapshot entry
+        vector<rational>                                    m_fc_len_values;
+        obj_map<expr, int>                                  m_fc_non_fresh_vars;
+        obj_map<expr, ptr_vector<expr>>                     m_fc_eq_combination;
+        unsigned_set                                        m_fc_sigma_domain;
+        expr_ref_vector                                     m_fc_trail;
+
+        // kinds of the variables made by Trau, indexed by expr id
+        enum {
+            VAR_INTERNAL = 1,   // mk_fresh_const
+            VAR_STR = 2,        // mk_str_var
+            VAR_REGEX = 4,      // mk_regex_rep_var
+            VAR_ARR = 8,        // mk_arr_var
+            VAR_FLAT = 16,      // named with FLATPREFIX
+            VAR_CONTAIN = 32    // prefix split off by contains, indexof or replace
+        };
+        svector<unsigned char>                              m_var_kinds;
+
+        /*
+         * The memberships of an eq-class, for is_internal_regex_var.
+         */
+        struct regex_var_entry {
+            unsigned m_first_non_concat = UINT_MAX;     // first membership whose regex is not a concatenation
+            unsigned m_last = UINT_MAX;                 // last membership
+            bool     m_has_internal = false;            // some non-concat member is internal
+        };
+        obj_map<expr, regex_var_entry>                      m_regex_var_index;      // eq-class root -> memberships
+        obj_map<expr, unsigned>                             m_regex_var_first;      // string -> its first membership
+        unsigned                                            m_regex_var_index_key[3];   // eq version, assign version, memo size
+
+        /*
+         * Sub-solver used to drop guessed literals from blocking clauses.
+         */
+        scoped_ptr<expr_solver>                             m_core_solver;
     private:
         clock_t                                             startClock;
         bool                                                newConstraintTriggered = false;
@@ -1353,6 +1659,7 @@ namespace smt {
                 rational bound = rational(0));
         void add_equalities_to_core(expr_ref_vector guessed_exprs, expr_ref_vector &all_vars, expr_ref_vector &core);
         void add_disequalities_to_core(expr_ref_vector const& diseq_exprs, expr_ref_vector &core);
+        void add_context_to_core(expr_ref_vector const& all_vars, expr_ref_vector const& diseq_exprs, rational bound, expr_ref_vector &core);
         void add_assignments_to_core(expr_ref_vector const& all_vars, expr_ref_vector &core);
         unsigned get_assign_lvl(expr* a, expr* b);
         void fetch_related_exprs(expr_ref_vector const& all_vars, expr_ref_vector &guessed_eqs);
@@ -1362,6 +1669,7 @@ namespace smt {
         bool check_intersection_not_empty(ptr_vector<expr> const& v, obj_hashtable<expr> const& allvars);
         bool check_intersection_not_empty(ptr_vector<expr> const& v, expr_ref_vector const& allvars);
         void fetch_guessed_exprs_from_cache(UnderApproxState const& state, expr_ref_vector &guessed_exprs);
+        void fetch_guessed_exprs_from_cache(unsigned branch, expr_ref_vector &guessed_exprs);
         void fetch_guessed_exprs_with_scopes(expr_ref_vector &guessedEqs);
         void fetch_guessed_exprs_with_scopes(expr_ref_vector &guessedEqs, expr_ref_vector &guessedDisEqs);
         void fetch_guessed_literals_with_scopes(literal_vector &guessedLiterals);
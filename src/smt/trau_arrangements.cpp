@@ -0,0 +1,398 @@
+/*++
+Module Name:
+
+    trau_arrangements.cpp
+
+Abstract:
+
+    Process-wide table of flattening arrangements used by theory_trau.
+
+--*/
+#include <cstdio>
+#include <string>
+#include "util/mutex.h"
+#include "util/trace.h"
+#include "smt/trau_arrangements.h"
+
+#ifndef _WINDOWS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace smt {
+
+    typedef ptr_vector<trau_arrangements::entry> entry_row;
+
+    static DECLARE_MUTEX(g_trau_arr_mux);
+    static vector<entry_row> *         g_trau_arr_rows = nullptr;
+
+    // mapped table
+    static void *                      g_trau_arr_map = nullptr;
+    static size_t                      g_trau_arr_map_size = 0;
+    static svector<uint64_t> *         g_trau_arr_buffer = nullptr;
+    static std::string *               g_trau_arr_file = nullptr;     // name of the mapped table
+
+    static const unsigned              TRAU_ARR_MAGIC = 0x55415254; // "TRAU"
+    static const unsigned              TRAU_ARR_VERSION = 1;
+
+    static unsigned bits_for(unsigned v) {
+        unsigned r = 1;
+        while ((v >> r) != 0)
+            ++r;
+        return r;
+    }
+
+    trau_arrangements::entry::entry(unsigned lhs, unsigned rhs):
+        m_lhs(lhs), m_rhs(rhs), m_width(bits_for(std::max(lhs, rhs) + 1)), m_num(0), m_bits(nullptr) {
+    }
+
+    trau_arrangements::entry::entry(unsigned lhs, unsigned rhs, unsigned width, unsigned num, uint64_t const* bits):
+        m_lhs(lhs), m_rhs(rhs), m_width(width), m_num(num), m_bits(bits) {
+    }
+
+    unsigned trau_arrangements::entry::encode(int v) {
+        if (v == empty_flat)
+            return 0;
+        if (v == sum_flat)
+            return 1;
+        SASSERT(v >= 0);
+        return static_cast<unsigned>(v) + 2;
+    }
+
+    int trau_arrangements::entry::decode(unsigned code) {
+        if (code == 0)
+            return empty_flat;
+        if (code == 1)
+            return sum_flat;
+        return static_cast<int>(code) - 2;
+    }
+
+    unsigned trau_arrangements::entry::get_cell(unsigned pos) const {
+        uint64_t bit = static_cast<uint64_t>(pos) * m_width;
+        unsigned word = static_cast<unsigned>(bit / 64);
+        unsigned off = static_cast<unsigned>(bit % 64);
+        uint64_t mask = (static_cast<uint64_t>(1) << m_width) - 1;
+        uint64_t v = m_bits[word] >> off;
+        if (off + m_width > 64)
+            v |= m_bits[word + 1] << (64 - off);
+        return static_cast<unsigned>(v & mask);
+    }
+
+    void trau_arrangements::entry::set_cell(unsigned pos, unsigned code) {
+        uint64_t bit = static_cast<uint64_t>(pos) * m_width;
+        unsigned word = static_cast<unsigned>(bit / 64);
+        unsigned off = static_cast<unsigned>(bit % 64);
+        while (m_own.size() <= word + 1)
+            m_own.push_back(0);
+        m_own[word] |= static_cast<uint64_t>(code) << off;
+        if (off + m_width > 64)
+            m_own[word + 1] |= static_cast<uint64_t>(code) >> (64 - off);
+        m_bits = m_own.c_ptr();
+    }
+
+    /*
+     * every cell is a flat kind or a position on the other side
+     */
+    bool trau_arrangements::entry::valid() const {
+        for (unsigned idx = 0; idx < m_num; ++idx)
+            for (unsigned pos = 0; pos < m_lhs + m_rhs; ++pos) {
+                unsigned code = get_cell(idx * (m_lhs + m_rhs) + pos);
+                unsigned other = pos < m_lhs ? m_rhs : m_lhs;
+                if (code >= 2 && code - 2 >= other)
+                    return false;
+            }
+        return true;
+    }
+
+    void trau_arrangements::entry::get(unsigned idx, int_vector& left_arr, int_vector& right_arr) const {
+        SASSERT(idx < m_num);
+        left_arr.reset();
+        right_arr.reset();
+        for (unsigned i = 0; i < m_lhs; ++i)
+            left_arr.push_back(left(idx, i));
+        for (unsigned i = 0; i < m_rhs; ++i)
+            right_arr.push_back(right(idx, i));
+    }
+
+    void trau_arrangements::push(entry & e, int_vector const& left_arr, int_vector const& right_arr) {
+        SASSERT(left_arr.size() == e.m_lhs);
+        SASSERT(right_arr.size() == e.m_rhs);
+        unsigned base = e.m_num * (e.m_lhs + e.m_rhs);
+        for (unsigned i = 0; i < left_arr.size(); ++i)
+            e.set_cell(base + i, entry::encode(left_arr[i]));
+        for (unsigned i = 0; i < right_arr.size(); ++i)
+            e.set_cell(base + e.m_lhs + i, entry::encode(right_arr[i]));
+        e.m_num++;
+    }
+
+    /*
+     * Same case split as the former setup_*_general functions:
+     *   [i] = sum(k..j), sum(k..i) = [j], and [i] = [j].
+     */
+    trau_arrangements::entry * trau_arrangements::build(unsigned lhs, unsigned rhs) {
+        entry * e = alloc(entry, lhs + 1, rhs + 1);
+        int_vector tmpLeft, tmpRight;
+        int i = lhs, j = rhs;
+
+        if (i == 0 && j == 0) {
+            /* left = right */
+            tmpLeft.push_back(0);
+            tmpRight.push_back(0);
+            push(*e, tmpLeft, tmpRight);
+            return e;
+        }
+
+        if (i == 0 || j == 0) {
+            /* [0] = sum (rhs...) or sum (lhs...) = [0] */
+            for (int k = 0; k <= i; ++k)
+                tmpLeft.push_back(i == 0 ? sum_flat : 0);
+            for (int k = 0; k <= j; ++k)
+                tmpRight.push_back(j == 0 ? sum_flat : 0);
+            push(*e, tmpLeft, tmpRight);
+            return e;
+        }
+
+        /* [i] = sum (0..j) */
+        for (int k = 0; k < i; ++k)
+            tmpLeft.push_back(empty_flat);
+        tmpLeft.push_back(sum_flat);
+        for (int k = 0; k <= j; ++k)
+            tmpRight.push_back(i);
+        push(*e, tmpLeft, tmpRight);
+
+        /* [i] = sum (k..j) */
+        for (int k = 1; k < j; ++k) {
+            entry const& sub = get_core(i - 1, k - 1);
+            for (unsigned t = 0; t < sub.size(); ++t) {
+                sub.get(t, tmpLeft, tmpRight);
+                tmpLeft.push_back(sum_flat);
+                for (int tt = k; tt <= j; ++tt)
+                    tmpRight.push_back(i);
+                push(*e, tmpLeft, tmpRight);
+            }
+        }
+
+        /* sum (k..i) = [j] */
+        for (int k = 1; k < i; ++k) {
+            entry const& sub = get_core(k - 1, j - 1);
+            for (unsigned t = 0; t < sub.size(); ++t) {
+                sub.get(t, tmpLeft, tmpRight);
+                tmpRight.push_back(sum_flat);
+                for (int tt = k; tt <= i; ++tt)
+                    tmpLeft.push_back(j);
+                push(*e, tmpLeft, tmpRight);
+            }
+        }
+
+        /* sum (0..i) = [j] */
+        tmpLeft.reset();
+        tmpRight.reset();
+        for (int k = 0; k <= i; ++k)
+            tmpLeft.push_back(j);
+        for (int k = 0; k < j; ++k)
+            tmpRight.push_back(empty_flat);
+        tmpRight.push_back(sum_flat);
+        push(*e, tmpLeft, tmpRight);
+
+        /* left = right */
+        entry const& sub = get_core(i - 1, j - 1);
+        for (unsigned t = 0; t < sub.size(); ++t) {
+            sub.get(t, tmpLeft, tmpRight);
+            tmpRight.push_back(i);
+            tmpLeft.push_back(j);
+            push(*e, tmpLeft, tmpRight);
+        }
+        return e;
+    }
+
+    trau_arrangements::entry const& trau_arrangements::get_core(unsigned lhs, unsigned rhs) {
+        vector<entry_row> & rows = *g_trau_arr_rows;
+        while (rows.size() <= lhs)
+            rows.push_back(entry_row());
+        entry_row & row = rows[lhs];
+        while (row.size() <= rhs)
+            row.push_back(nullptr);
+        if (row[rhs] == nullptr) {
+            entry * e = build(lhs, rhs);
+            // build() may grow the table, so index again
+            (*g_trau_arr_rows)[lhs][rhs] = e;
+            TRACE("str", tout << "arrangements (" << lhs << ", " << rhs << "): " << e->size() << "\n";);
+            return *e;
+        }
+        return *row[rhs];
+    }
+
+    trau_arrangements::entry const& trau_arrangements::get(unsigned lhs, unsigned rhs) {
+        lock_guard lock(*g_trau_arr_mux);
+        return get_core(lhs, rhs);
+    }
+
+    static void release_map() {
+        if (g_trau_arr_map != nullptr) {
+#ifndef _WINDOWS
+            munmap(g_trau_arr_map, g_trau_arr_map_size);
+#endif
+            g_trau_arr_map = nullptr;
+            g_trau_arr_map_size = 0;
+        }
+        if (g_trau_arr_buffer != nullptr) {
+            dealloc(g_trau_arr_buffer);
+            g_trau_arr_buffer = nullptr;
+        }
+        if (g_trau_arr_file != nullptr) {
+            dealloc(g_trau_arr_file);
+            g_trau_arr_file = nullptr;
+        }
+    }
+
+    /*
+     * Layout: header (magic, version, max_lhs, max_rhs),
+     * one index record (width, num, offset_lo, offset_hi) per entry in row-major order,
+     * then the packed words of all entries. Offsets are counted in words.
+     */
+    bool trau_arrangements::load(char const* file_name) {
+        lock_guard lock(*g_trau_arr_mux);
+        // one table per process; another file cannot replace it
+        if (g_trau_arr_file != nullptr) {
+            if (*g_trau_arr_file == file_name)
+                return true;
+            TRACE("str", tout << "arrangement table " << *g_trau_arr_file << " already loaded, ignoring " << file_name << "\n";);
+            return false;
+        }
+
+        uint64_t const* words = nullptr;
+        size_t size = 0;
+#ifndef _WINDOWS
+        int fd = open(file_name, O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < 16) {
+            close(fd);
+            return false;
+        }
+        size = static_cast<size_t>(st.st_size);
+        void * p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED)
+            return false;
+        g_trau_arr_map = p;
+        g_trau_arr_map_size = size;
+        words = static_cast<uint64_t const*>(p);
+#else
+        FILE * f = fopen(file_name, "rb");
+        if (f == nullptr)
+            return false;
+        g_trau_arr_buffer = alloc(svector<uint64_t>);
+        uint64_t w;
+        while (fread(&w, sizeof(w), 1, f) == 1)
+            g_trau_arr_buffer->push_back(w);
+        fclose(f);
+        size = g_trau_arr_buffer->size() * sizeof(uint64_t);
+        words = g_trau_arr_buffer->c_ptr();
+#endif
+        if (size < 16) {
+            release_map();
+            return false;
+        }
+        unsigned const* header = reinterpret_cast<unsigned const*>(words);
+        unsigned max_lhs = header[2], max_rhs = header[3];
+        uint64_t total_words = size / 8;
+        // both sides are capped, so the index size cannot overflow
+        if (header[0] != TRAU_ARR_MAGIC || header[1] != TRAU_ARR_VERSION ||
+            max_lhs > max_table_side || max_rhs > max_table_side) {
+            release_map();
+            return false;
+        }
+        uint64_t num_entries = (static_cast<uint64_t>(max_lhs) + 1) * (static_cast<uint64_t>(max_rhs) + 1);
+        uint64_t data_start = 2 + 2 * num_entries;
+        if (data_start > total_words) {
+            release_map();
+            return false;
+        }
+        unsigned const* index = header + 4;
+        ptr_vector<entry> loaded;
+        for (unsigned i = 0; i <= max_lhs; ++i)
+            for (unsigned j = 0; j <= max_rhs; ++j, index += 4) {
+                uint64_t rel = static_cast<uint64_t>(index[3]) << 32 | index[2];
+                unsigned width = index[0];
+                // the width is the one build() gives the entry; the cells are checked once they are in the file
+                bool ok = width == bits_for(std::max(i, j) + 2) && rel <= total_words - data_start;
+                entry * e = alloc(entry, i + 1, j + 1, width, index[1], ok ? words + data_start + rel : nullptr);
+                if (!ok || e->num_words() > total_words - data_start - rel || !e->valid()) {
+                    dealloc(e);
+                    for (entry * l : loaded)
+                        dealloc(l);
+                    release_map();
+                    return false;
+                }
+                loaded.push_back(e);
+            }
+
+        vector<entry_row> & rows = *g_trau_arr_rows;
+        unsigned idx = 0;
+        for (unsigned i = 0; i <= max_lhs; ++i) {
+            while (rows.size() <= i)
+                rows.push_back(entry_row());
+            for (unsigned j = 0; j <= max_rhs; ++j, ++idx) {
+                while (rows[i].size() <= j)
+                    rows[i].push_back(nullptr);
+                if (rows[i][j] == nullptr)
+                    rows[i][j] = loaded[idx];
+                else
+                    dealloc(loaded[idx]);
+            }
+        }
+        g_trau_arr_file = alloc(std::string, file_name);
+        TRACE("str", tout << "loaded arrangements up to (" << max_lhs << ", " << max_rhs << ") from " << file_name << "\n";);
+        return true;
+    }
+
+    bool trau_arrangements::save(char const* file_name, unsigned max_lhs, unsigned max_rhs) {
+        if (max_lhs > max_table_side || max_rhs > max_table_side)
+            return false;
+        lock_guard lock(*g_trau_arr_mux);
+        ptr_vector<entry const> entries;
+        for (unsigned i = 0; i <= max_lhs; ++i)
+            for (unsigned j = 0; j <= max_rhs; ++j)
+                entries.push_back(&get_core(i, j));
+
+        FILE * f = fopen(file_name, "wb");
+        if (f == nullptr)
+            return false;
+        unsigned header[4] = { TRAU_ARR_MAGIC, TRAU_ARR_VERSION, max_lhs, max_rhs };
+        bool ok = fwrite(header, sizeof(header), 1, f) == 1;
+        uint64_t offset = 0;
+        for (entry const* e : entries) {
+            unsigned rec[4] = { e->m_width, e->m_num, static_cast<unsigned>(offset), static_cast<unsigned>(offset >> 32) };
+            ok = ok && fwrite(rec, sizeof(rec), 1, f) == 1;
+            offset += e->num_words();
+        }
+        for (entry const* e : entries) {
+            size_t n = static_cast<size_t>(e->num_words());
+            ok = ok && (n == 0 || fwrite(e->m_bits, sizeof(uint64_t), n, f) == n);
+        }
+        ok = fclose(f) == 0 && ok;
+        return ok;
+    }
+
+    void trau_arrangements::initialize() {
+        ALLOC_MUTEX(g_trau_arr_mux);
+        g_trau_arr_rows = alloc(vector<entry_row>);
+    }
+
+    void trau_arrangements::finalize() {
+        if (g_trau_arr_rows != nullptr) {
+            for (entry_row & row : *g_trau_arr_rows)
+                for (entry * e : row)
+                    if (e != nullptr)
+                        dealloc(e);
+            dealloc(g_trau_arr_rows);
+            g_trau_arr_rows = nullptr;
+        }
+        release_map();
+        DEALLOC_MUTEX(g_trau_arr_mux);
+    }
+}
@@ -0,0 +1,98 @@
+/*++
+Module Name:
+
+    trau_arrangements.h
+
+Abstract:
+
+    Process-wide table of flattening arrangements used by theory_trau.
+
+    Entry (i, j) holds every arrangement of an equation with i + 1 flats
+    on the left and j + 1 flats on the right. Entries are built lazily,
+    never modified once published and shared by all solver instances.
+
+    Each cell of an arrangement is bit-packed with the width of the entry:
+        0     -> EMPTYFLAT
+        1     -> SUMFLAT
+        k + 2 -> position k on the other side
+
+    A precomputed table can be written with save(), from the SMT2 command
+    trau-save-arrangements, and mapped back with load() through the
+    parameter smt.str.trau_arrangement_table; mapped entries are used in
+    place of building them.
+
+--*/
+#ifndef TRAU_ARRANGEMENTS_H_
+#define TRAU_ARRANGEMENTS_H_
+
+#include "util/vector.h"
+
+namespace smt {
+
+    class trau_arrangements {
+    public:
+        class entry;
+    private:
+        static entry const& get_core(unsigned lhs, unsigned rhs);
+        static entry * build(unsigned lhs, unsigned rhs);
+        static void push(entry & e, int_vector const& left_arr, int_vector const& right_arr);
+    public:
+        static const int sum_flat = 100000000;
+        static const int empty_flat = 9999999;
+        // largest max_lhs and max_rhs of a stored table
+        static const unsigned max_table_side = 64;
+
+        class entry {
+            unsigned         m_lhs;      // number of lhs flats
+            unsigned         m_rhs;      // number of rhs flats
+            unsigned         m_width;    // bits per cell
+            unsigned         m_num;      // number of arrangements
+            uint64_t const*  m_bits;     // either m_own or mapped memory
+            svector<uint64_t> m_own;
+
+            unsigned get_cell(unsigned pos) const;
+            bool valid() const;
+            void set_cell(unsigned pos, unsigned code);
+            static unsigned encode(int v);
+            static int decode(unsigned code);
+            friend class trau_arrangements;
+        public:
+            entry(unsigned lhs, unsigned rhs);
+            entry(unsigned lhs, unsigned rhs, unsigned width, unsigned num, uint64_t const* bits);
+
+            unsigned size() const { return m_num; }
+            unsigned lhs_size() const { return m_lhs; }
+            unsigned rhs_size() const { return m_rhs; }
+            uint64_t num_words() const { return (static_cast<uint64_t>(m_num) * (m_lhs + m_rhs) * m_width + 63) / 64; }
+            int left(unsigned idx, unsigned pos) const { return decode(get_cell(idx * (m_lhs + m_rhs) + pos)); }
+            int right(unsigned idx, unsigned pos) const { return decode(get_cell(idx * (m_lhs + m_rhs) + m_lhs + pos)); }
+            void get(unsigned idx, int_vector& left_arr, int_vector& right_arr) const;
+        };
+
+        /*
+         * Arrangements of (lhs + 1) flats against (rhs + 1) flats.
+         * The returned entry stays valid until finalize().
+         */
+        static entry const& get(unsigned lhs, unsigned rhs);
+
+        /*
+         * Map a table written by save(). Returns false if the file is missing or malformed.
+         */
+        static bool load(char const* file_name);
+
+        /*
+         * Write all entries up to (max_lhs, max_rhs), both at most max_table_side.
+         */
+        static bool save(char const* file_name, unsigned max_lhs, unsigned max_rhs);
+
+        static void initialize();
+        static void finalize();
+        /*
+          ADD_INITIALIZER('smt::trau_arrangements::initialize();')
+          ADD_FINALIZER('smt::trau_arrangements::finalize();')
+        */
+    };
+
+}
+
+#endif /* TRAU_ARRANGEMENTS_H_ */
@@ -0,0 +1,389 @@
+/*++
+Module Name:
+
+    trau_automata_cache.cpp
+
+Abstract:
+
+    Regex automata cache shared by the theory_trau instances of an ast_manager.
+
+--*/
+#include "ast/bv_decl_plugin.h"
+#include "util/trace.h"
+#include "smt/smt_kernel.h"
+#include "smt/trau_automata_cache.h"
+
+namespace smt {
+
+    typedef svector<std::pair<unsigned, unsigned>> char_ranges;
+
+    struct state_pair_hash {
+        unsigned operator()(uint64_t x) const { return hash_u_u(static_cast<unsigned>(x >> 32), static_cast<unsigned>(x)); }
+    };
+    typedef hashtable<uint64_t, state_pair_hash, default_eq<uint64_t>> state_pair_set;
+
+    /*
+     * Decides the character guards of complements and intersections.
+     * Guards never mention strings, so the kernel runs without a string solver;
+     * it then does not set up a theory_trau that would acquire this cache again.
+     */
+    class guard_solver : public expr_solver {
+        kernel m_kernel;
+    public:
+        guard_solver(ast_manager& m, smt_params& fp):
+                m_kernel(m, fp)
+        {}
+
+        lbool check_sat(expr* e) override {
+            m_kernel.push();
+            m_kernel.assert_expr(e);
+            lbool r = m_kernel.check();
+            m_kernel.pop(1);
+            return r;
+        }
+    };
+
+    static DECLARE_MUTEX(g_trau_aut_mux);
+    static ptr_vector<trau_automata_cache> * g_trau_aut_caches = nullptr;
+
+    trau_automata_cache::trau_automata_cache(ast_manager& m):
+        m(m), m_mk(m), m_ref_count(0), m_max_size(1024), m_dense_enabled(true), m_head(nullptr), m_tail(nullptr) {
+        m_fparams.m_string_solver = symbol("none");
+        m_mk.set_solver(alloc(guard_solver, m, m_fparams));
+    }
+
+    trau_automata_cache::~trau_automata_cache() {
+        reset();
+    }
+
+    trau_automata_cache* trau_automata_cache::acquire(ast_manager& m) {
+        lock_guard lock(*g_trau_aut_mux);
+        for (trau_automata_cache* c : *g_trau_aut_caches)
+            if (&c->m == &m) {
+                c->m_ref_count++;
+                return c;
+            }
+        trau_automata_cache* c = alloc(trau_automata_cache, m);
+        c->m_ref_count = 1;
+        g_trau_aut_caches->push_back(c);
+        return c;
+    }
+
+    void trau_automata_cache::release(trau_automata_cache* c) {
+        if (c == nullptr)
+            return;
+        lock_guard lock(*g_trau_aut_mux);
+        SASSERT(c->m_ref_count > 0);
+        if (--c->m_ref_count > 0)
+            return;
+        g_trau_aut_caches->erase(c);
+        dealloc(c);
+    }
+
+    void trau_automata_cache::set_max_size(unsigned n) {
+        lock_guard lock(m_mux);
+        m_max_size = n;
+        while (m_table.size() > m_max_size && m_tail != nullptr)
+            evict();
+    }
+
+    void trau_automata_cache::unlink(entry* e) {
+        if (e->m_prev)
+            e->m_prev->m_next = e->m_next;
+        else
+            m_head = e->m_next;
+        if (e->m_next)
+            e->m_next->m_prev = e->m_prev;
+        else
+            m_tail = e->m_prev;
+        e->m_prev = e->m_next = nullptr;
+    }
+
+    void trau_automata_cache::push_front(entry* e) {
+        e->m_prev = nullptr;
+        e->m_next = m_head;
+        if (m_head)
+            m_head->m_prev = e;
+        m_head = e;
+        if (m_tail == nullptr)
+            m_tail = e;
+    }
+
+    void trau_automata_cache::del_entry(entry* e) {
+        dealloc(e->m_aut);
+        dealloc(e->m_dense);
+        m.dec_ref(e->m_re);
+        dealloc(e);
+    }
+
+    void trau_automata_cache::evict() {
+        entry* e = m_tail;
+        unlink(e);
+        m_table.remove(e->m_re);
+        del_entry(e);
+        m_stats.m_evictions++;
+    }
+
+    bool trau_automata_cache::is_empty(expr* re) {
+        scoped_ptr<eautomaton> owned;
+        bool empty = false;
+        lookup(re, owned, empty);
+        return empty;
+    }
+
+    eautomaton* trau_automata_cache::get(expr* re, scoped_ptr<eautomaton>& owned) {
+        bool empty = false;
+        return lookup(re, owned, empty);
+    }
+
+    eautomaton* trau_automata_cache::lookup(expr* re, scoped_ptr<eautomaton>& owned, bool& empty) {
+        {
+            lock_guard lock(m_mux);
+            entry* e = nullptr;
+            if (m_table.find(re, e)) {
+                m_stats.m_hits++;
+                unlink(e);
+                push_front(e);
+                empty = e->m_empty;
+                return e->m_aut;
+            }
+            m_stats.m_misses++;
+        }
+
+        // building may query a nested solver that uses this cache
+        eautomaton* aut = m_mk(re);
+        if (aut == nullptr)
+            return nullptr;
+        empty = aut->is_empty();
+        dense_automaton* dense = nullptr;
+        if (!empty && m_dense_enabled)
+            dense = mk_dense(*aut);
+
+        lock_guard lock(m_mux);
+        if (m_max_size == 0 || m_table.contains(re)) {
+            owned = aut;
+            dealloc(dense);
+            return aut;
+        }
+        entry* e = alloc(entry);
+        e->m_re = re;
+        e->m_aut = aut;
+        e->m_dense = dense;
+        if (dense)
+            m_stats.m_dense_built++;
+        e->m_empty = empty;
+        m.inc_ref(re);
+        m_table.insert(re, e);
+        push_front(e);
+        while (m_table.size() > m_max_size)
+            evict();
+        TRACE("str", tout << "automata cache: " << m_table.size() << " entries\n";);
+        return aut;
+    }
+
+    /*
+     * Characters accepted by a guard as sorted, disjoint ranges.
+     * Returns false for guards that are not ground characters or ranges.
+     */
+    static bool get_char_ranges(seq_util& u, sym_expr* t, char_ranges& rs) {
+        rs.reset();
+        unsigned lo, hi;
+        if (t->is_char()) {
+            if (!u.is_const_char(t->get_char(), lo))
+                return false;
+            rs.push_back(std::make_pair(lo, lo));
+            return true;
+        }
+        if (t->is_range()) {
+            if (!u.is_const_char(t->get_lo(), lo) || !u.is_const_char(t->get_hi(), hi))
+                return false;
+            if (lo <= hi)
+                rs.push_back(std::make_pair(lo, hi));
+            return true;
+        }
+        if (t->is_not()) {
+            bv_util bv(u.get_manager());
+            char_ranges inner;
+            if (!bv.is_bv_sort(t->get_sort()) || !get_char_ranges(u, t->get_arg(), inner))
+                return false;
+            unsigned sz = bv.get_bv_size(t->get_sort());
+            unsigned max_char = sz >= 32 ? UINT_MAX : (1u << sz) - 1;
+            unsigned next = 0;
+            bool done = false;
+            for (auto const& r : inner) {
+                if (r.first > next)
+                    rs.push_back(std::make_pair(next, r.first - 1));
+                if (r.second >= max_char) {
+                    done = true;
+                    break;
+                }
+                next = r.second + 1;
+            }
+            if (!done)
+                rs.push_back(std::make_pair(next, max_char));
+            return true;
+        }
+        return false;
+    }
+
+    static bool overlap(char_ranges const& a, char_ranges const& b) {
+        unsigned i = 0, j = 0;
+        while (i < a.size() && j < b.size()) {
+            if (a[i].second < b[j].first)
+                ++i;
+            else if (b[j].second < a[i].first)
+                ++j;
+            else
+                return true;
+        }
+        return false;
+    }
+
+    /*
+     * Minimal dense form of a, if every guard is a range of 8-bit characters
+     * and the subset construction stays small.
+     */
+    dense_automaton* trau_automata_cache::mk_dense(eautomaton const& a) {
+        seq_util u(m);
+        bv_util bv(m);
+        for (unsigned s = 0; s < a.num_states(); ++s)
+            for (auto const& mv : a.get_moves_from(s))
+                if (!mv.is_epsilon() && (!bv.is_bv_sort(mv.t()->get_sort()) || bv.get_bv_size(mv.t()->get_sort()) > 8))
+                    return nullptr;
+        auto get_ranges = [&](sym_expr* t, char_ranges& rs) { return get_char_ranges(u, t, rs); };
+        return dense_automaton::mk(a, get_ranges, 256, 4 * a.num_states() + 64);
+    }
+
+    /*
+     * Breadth-first search over reachable pairs of states, stopping at the first accepting pair.
+     */
+    lbool trau_automata_cache::product_is_empty(eautomaton const& a, eautomaton const& b) {
+        seq_util u(m);
+        state_pair_set visited;
+        svector<std::pair<unsigned, unsigned>> todo;
+        char_ranges ra, rb;
+        bool unknown = false;
+
+        auto add = [&](unsigned p, unsigned q) {
+            uint64_t key = (static_cast<uint64_t>(p) << 32) | q;
+            if (!visited.contains(key)) {
+                visited.insert(key);
+                todo.push_back(std::make_pair(p, q));
+            }
+        };
+
+        add(a.init(), b.init());
+        for (unsigned head = 0; head < todo.size(); ++head) {
+            unsigned p = todo[head].first, q = todo[head].second;
+            if (a.is_final_state(p) && b.is_final_state(q))
+                return l_false;
+            eautomaton::moves const& ma = a.get_moves_from(p);
+            eautomaton::moves const& mb = b.get_moves_from(q);
+            for (auto const& mv : ma)
+                if (mv.is_epsilon())
+                    add(mv.dst(), q);
+            for (auto const& mv : mb)
+                if (mv.is_epsilon())
+                    add(p, mv.dst());
+            for (auto const& mv1 : ma) {
+                if (mv1.is_epsilon())
+                    continue;
+                bool known1 = get_char_ranges(u, mv1.t(), ra);
+                for (auto const& mv2 : mb) {
+                    if (mv2.is_epsilon())
+                        continue;
+                    if (known1 && get_char_ranges(u, mv2.t(), rb)) {
+                        if (overlap(ra, rb))
+                            add(mv1.dst(), mv2.dst());
+                    }
+                    else {
+                        // the pair may be reachable, so emptiness cannot be claimed
+                        unknown = true;
+                    }
+                }
+            }
+        }
+        return unknown ? l_undef : l_true;
+    }
+
+    lbool trau_automata_cache::is_intersection_empty(expr* a, expr* b) {
+        {
+            lock_guard lock(m_mux);
+            bool r;
+            if (m_inter.find(a, b, r)) {
+                m_stats.m_inter_hits++;
+                return r ? l_true : l_false;
+            }
+            m_stats.m_inter_misses++;
+        }
+
+        // make sure both automata are cached
+        if (is_empty(a) || is_empty(b))
+            return l_true;
+
+        lock_guard lock(m_mux);
+        entry *ea = nullptr, *eb = nullptr;
+        if (!m_table.find(a, ea) || !m_table.find(b, eb)) {
+            m_stats.m_inter_fallbacks++;
+            return l_undef;
+        }
+        lbool r = ea->m_dense && eb->m_dense ?
+            to_lbool(dense_automaton::intersection_is_empty(*ea->m_dense, *eb->m_dense)) :
+            product_is_empty(*ea->m_aut, *eb->m_aut);
+        if (r == l_undef) {
+            m_stats.m_inter_fallbacks++;
+            return r;
+        }
+        if (m_inter.size() >= m_max_size)
+            reset_inter();
+        m.inc_ref(a);
+        m.inc_ref(b);
+        m_inter.insert(a, b, r == l_true);
+        return r;
+    }
+
+    void trau_automata_cache::reset_inter() {
+        for (auto const& kv : m_inter) {
+            m.dec_ref(kv.get_key1());
+            m.dec_ref(kv.get_key2());
+        }
+        m_inter.reset();
+    }
+
+    void trau_automata_cache::reset() {
+        lock_guard lock(m_mux);
+        reset_inter();
+        while (m_head != nullptr) {
+            entry* e = m_head;
+            m_head = e->m_next;
+            del_entry(e);
+        }
+        m_tail = nullptr;
+        m_table.reset();
+    }
+
+    void trau_automata_cache::collect_statistics(::statistics& st) const {
+        st.update("trau automata cache hits", m_stats.m_hits);
+        st.update("trau automata cache misses", m_stats.m_misses);
+        st.update("trau automata cache evictions", m_stats.m_evictions);
+        st.update("trau regex intersection hits", m_stats.m_inter_hits);
+        st.update("trau regex intersection misses", m_stats.m_inter_misses);
+        st.update("trau regex intersection fallbacks", m_stats.m_inter_fallbacks);
+        st.update("trau dense automata", m_stats.m_dense_built);
+    }
+
+    void trau_automata_cache::initialize() {
+        ALLOC_MUTEX(g_trau_aut_mux);
+        g_trau_aut_caches = alloc(ptr_vector<trau_automata_cache>);
+    }
+
+    void trau_automata_cache::finalize() {
+        if (g_trau_aut_caches != nullptr) {
+            for (trau_automata_cache* c : *g_trau_aut_caches)
+                dealloc(c);
+            dealloc(g_trau_aut_caches);
+            g_trau_aut_caches = nullptr;
+        }
+        DEALLOC_MUTEX(g_trau_aut_mux);
+    }
+}
@@ -0,0 +1,126 @@
+/*++
+Module Name:
+
+    trau_automata_cache.h
+
+Abstract:
+
+    Regex automata cache shared by the theory_trau instances of an ast_manager.
+
+    Automata refer to expressions of the manager that built them, so one
+    cache exists per manager; contexts on different managers share nothing.
+    It is created by the first acquire() and deleted when the last user
+    releases it. The cache builds every automaton itself, with a builder
+    that has a solver for the guards of complements and intersections, so
+    the automata do not depend on the instance that asked for them. Entries
+    are keyed by the hash-consed regex and evicted in least-recently-used
+    order. Regexes the builder cannot translate are not cached.
+
+    Emptiness of an intersection is decided on the fly over pairs of
+    states of the two cached automata, without building the product,
+    and the answer is memoized per pair of regexes. Automata whose guards
+    are byte ranges also get a minimal dense form, on which the product
+    search is a table walk.
+
+--*/
+#ifndef TRAU_AUTOMATA_CACHE_H_
+#define TRAU_AUTOMATA_CACHE_H_
+
+#include "ast/rewriter/seq_rewriter.h"
+#include "math/automata/dense_automaton.h"
+#include "smt/params/smt_params.h"
+#include "util/mutex.h"
+#include "util/obj_hashtable.h"
+#include "util/obj_pair_hashtable.h"
+#include "util/statistics.h"
+
+namespace smt {
+
+    class trau_automata_cache {
+        struct entry {
+            expr*        m_re;
+            eautomaton*  m_aut;
+            dense_automaton* m_dense;
+            bool         m_empty;
+            entry*       m_prev;
+            entry*       m_next;
+        };
+
+        ast_manager&              m;
+        smt_params                m_fparams;
+        re2automaton              m_mk;
+        unsigned                  m_ref_count;
+        unsigned                  m_max_size;
+        bool                      m_dense_enabled;
+        obj_map<expr, entry*>     m_table;
+        entry*                    m_head;    // most recently used
+        entry*                    m_tail;    // least recently used
+        obj_pair_map<expr, expr, bool> m_inter;  // (a, b) -> a & b is empty
+        mutex                     m_mux;
+
+        struct stats {
+            unsigned m_hits;
+            unsigned m_misses;
+            unsigned m_evictions;
+            unsigned m_inter_hits;
+            unsigned m_inter_misses;
+            unsigned m_inter_fallbacks;
+            unsigned m_dense_built;
+            stats() { reset(); }
+            void reset() { memset(this, 0, sizeof(*this)); }
+        };
+        stats                     m_stats;
+
+        void unlink(entry* e);
+        void push_front(entry* e);
+        void evict();
+        void del_entry(entry* e);
+        void reset_inter();
+        eautomaton* lookup(expr* re, scoped_ptr<eautomaton>& owned, bool& empty);
+        lbool product_is_empty(eautomaton const& a, eautomaton const& b);
+        dense_automaton* mk_dense(eautomaton const& a);
+
+    public:
+        trau_automata_cache(ast_manager& m);
+        ~trau_automata_cache();
+
+        static trau_automata_cache* acquire(ast_manager& m);
+        static void release(trau_automata_cache* c);
+
+        void set_max_size(unsigned n);
+        void set_dense(bool f) { m_dense_enabled = f; }
+
+        /*
+         * true if the language of re is empty.
+         * On a miss, the automaton is built outside the lock.
+         * Regexes that cannot be translated are reported as non-empty.
+         */
+        bool is_empty(expr* re);
+
+        /*
+         * The automaton of re, nullptr if it cannot be translated.
+         * A cached automaton stays valid until the next call that adds to the cache;
+         * when the cache cannot keep it, the automaton is handed over in owned.
+         */
+        eautomaton* get(expr* re, scoped_ptr<eautomaton>& owned);
+
+        /*
+         * l_true if the intersection of a and b is empty, l_false if it is not,
+         * l_undef if some transition guard cannot be compared without a solver.
+         */
+        lbool is_intersection_empty(expr* a, expr* b);
+
+        void reset();
+        void collect_statistics(::statistics& st) const;
+
+        static void initialize();
+        static void finalize();
+        /*
+          ADD_INITIALIZER('smt::trau_automata_cache::initialize();')
+          ADD_FINALIZER('smt::trau_automata_cache::finalize();')
+        */
+    };
+
+}
+
+#endif /* TRAU_AUTOMATA_CACHE_H_ */
@@ -0,0 +1,135 @@
+/*++
+Module Name:
+
+    string_models.cpp
+
+Abstract:
+
+    Enumerate models that differ on the string constants of the assertions.
+
+--*/
+
+#include "ast/arith_decl_plugin.h"
+#include "ast/ast_util.h"
+#include "ast/for_each_expr.h"
+#include "ast/seq_decl_plugin.h"
+#include "model/model.h"
+#include "solver/string_models.h"
+
+string_model_enumerator::string_model_enumerator(solver& s):
+    m_solver(s), m(s.get_manager()), m_vars(m), m_fmls(m), m_blocks(m), m_num_models(0), m_num_dropped(0) {}
+
+namespace {
+    struct collect_string_consts_proc {
+        seq_util         u;
+        app_ref_vector&  m_vars;
+        collect_string_consts_proc(ast_manager& m, app_ref_vector& vars): u(m), m_vars(vars) {}
+        void operator()(var*) {}
+        void operator()(quantifier*) {}
+        void operator()(app* a) {
+            if (is_uninterp_const(a) && u.is_string(a->get_decl()->get_range()))
+                m_vars.push_back(a);
+        }
+    };
+}
+
+void string_model_enumerator::collect_vars() {
+    m_vars.reset();
+    m_fmls.reset();
+    collect_string_consts_proc proc(m, m_vars);
+    expr_mark visited;
+    for (expr* f : m_solver.get_assertions()) {
+        m_fmls.push_back(f);
+        for_each_expr(proc, visited, f);
+    }
+}
+
+/*
+ * A clause that some string constant differs from its value in mdl. The length
+ * disequality is implied by the value one, but lets the arithmetic side move
+ * to another length directly.
+ */
+expr_ref string_model_enumerator::mk_block(model& mdl) {
+    seq_util u(m);
+    arith_util a(m);
+    model::scoped_model_completion _scm(mdl, true);
+    expr_ref_vector diffs(m);
+    for (app* x : m_vars) {
+        expr_ref val = mdl(x);
+        zstring str;
+        if (!u.str.is_string(val, str))
+            continue;
+        diffs.push_back(m.mk_not(m.mk_eq(u.str.mk_length(x), a.mk_int(str.length()))));
+        diffs.push_back(m.mk_not(m.mk_eq(x, val)));
+    }
+    if (diffs.empty())
+        return expr_ref(m);
+    return mk_or(diffs);
+}
+
+lbool string_model_enumerator::operator()(unsigned max_models, on_model_t const& on_model) {
+    m_num_models = 0;
+    m_num_dropped = 0;
+    m_blocks.reset();
+    collect_vars();
+    lbool result = l_true;
+    m_solver.push();
+    try {
+        while (m_num_models < max_models) {
+            result = m_solver.check_sat(0, nullptr);
+            if (result != l_true)
+                break;
+            model_ref mdl;
+            m_solver.get_model(mdl);
+            if (!mdl) {
+                result = l_undef;
+                break;
+            }
+            if (mdl->is_false(m_blocks)) {
+                // the model is not one of the solver's, reporting it again would not terminate
+                m_solver.set_reason_unknown("model repeats an enumerated string assignment");
+                result = l_undef;
+                break;
+            }
+            // the callback may change the model, so the clause is built first
+            expr_ref block = mk_block(*mdl);
+            bool valid;
+            {
+                model::scoped_model_completion _scm(*mdl, true);
+                valid = !mdl->is_false(m_fmls);
+            }
+            if (!valid) {
+                // not reported; its strings are blocked, so another model may be dropped with them
+                ++m_num_dropped;
+                if (!block || m_num_dropped >= max_models) {
+                    m_solver.set_reason_unknown("model falsifies an assertion");
+                    result = l_undef;
+                    break;
+                }
+                m_blocks.push_back(block);
+                m_solver.assert_expr(block);
+                continue;
+            }
+            ++m_num_models;
+            if (!on_model(mdl))
+                break;
+            if (!block) {
+                // only one model can differ on the strings when there are none
+                result = l_false;
+                break;
+            }
+            m_blocks.push_back(block);
+            m_solver.assert_expr(block);
+        }
+        if (result == l_false && m_num_dropped > 0) {
+            m_solver.set_reason_unknown("models falsifying an assertion were dropped");
+            result = l_undef;
+        }
+    }
+    catch (...) {
+        m_solver.pop(1);
+        throw;
+    }
+    m_solver.pop(1);
+    return result;
+}
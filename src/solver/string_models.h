@@ -0,0 +1,60 @@
+/*++
+Module Name:
+
+    string_models.h
+
+Abstract:
+
+    Enumerate models that differ on the string constants of the assertions.
+
+    The assertions are checked repeatedly inside one scope of the solver.
+    After each model a clause is added that makes some string constant take
+    a different length or value, so the solver keeps what it learned between
+    models instead of starting a new search for each one. The scope is popped
+    when the enumeration stops, leaving the assertions as they were.
+
+    A model that falsifies one of the assertions is not reported. Its strings
+    are blocked like those of a reported model, so once a model was dropped
+    the enumeration no longer claims that there are no further models.
+
+--*/
+
+#pragma once
+
+#include <functional>
+#include "solver/solver.h"
+
+class string_model_enumerator {
+public:
+    /*
+     * Receives each model as it is found; returning false stops the enumeration.
+     */
+    typedef std::function<bool(model_ref&)> on_model_t;
+
+private:
+    solver&         m_solver;
+    ast_manager&    m;
+    app_ref_vector  m_vars;
+    expr_ref_vector m_fmls;
+    expr_ref_vector m_blocks;
+    unsigned        m_num_models;
+    unsigned        m_num_dropped;
+
+    void collect_vars();
+    expr_ref mk_block(model& mdl);
+
+public:
+    string_model_enumerator(solver& s);
+
+    /*
+     * Find up to max_models models and pass them to on_model.
+     * Returns l_false when there are no further models, l_true when the limit
+     * was reached or on_model stopped the enumeration, and l_undef when a check
+     * was inconclusive, for example because the resource limit was canceled,
+     * a model falsified one of the clauses blocking the earlier models, or
+     * models falsifying the assertions were dropped.
+     */
+    lbool operator()(unsigned max_models, on_model_t const& on_model);
+
+    unsigned num_models() const { return m_num_models; }
+};
@@ -0,0 +1,90 @@
+/*++
+Module Name:
+
+    dense_automaton.cpp
+
+Abstract:
+
+    Test minimal dense automata.
+
+--*/
+#include "util/debug.h"
+#include "math/automata/dense_automaton.h"
+
+typedef dense_automaton::char_range range;
+typedef automaton<range> range_automaton;
+
+struct get_range {
+    bool operator()(range* t, dense_automaton::char_ranges& rs) {
+        rs.reset();
+        rs.push_back(*t);
+        return true;
+    }
+};
+
+static bool accepts(dense_automaton const& d, char const* s) {
+    unsigned_vector cs;
+    for (; *s; ++s)
+        cs.push_back(static_cast<unsigned char>(*s));
+    return d.accepts(cs.c_ptr(), cs.size());
+}
+
+void tst_dense_automaton() {
+    default_value_manager<range> m;
+    get_range gr;
+    range a('a', 'a'), b('b', 'b'), az('a', 'z');
+
+    // (a|b)*abb
+    range_automaton::moves mvs;
+    mvs.push_back(range_automaton::move(m, 0, 0, &a));
+    mvs.push_back(range_automaton::move(m, 0, 0, &b));
+    mvs.push_back(range_automaton::move(m, 0, 1, &a));
+    mvs.push_back(range_automaton::move(m, 1, 2, &b));
+    mvs.push_back(range_automaton::move(m, 2, 3, &b));
+    unsigned_vector final;
+    final.push_back(3);
+    range_automaton abb(m, 0, final, mvs);
+
+    dense_automaton* d1 = dense_automaton::mk(abb, gr, 256, 100);
+    ENSURE(d1);
+    // four live states and the dead state; a, b and the intervals around them
+    ENSURE(d1->num_states() == 5);
+    ENSURE(d1->num_classes() == 4);
+    ENSURE(accepts(*d1, "abb"));
+    ENSURE(accepts(*d1, "babaabb"));
+    ENSURE(!accepts(*d1, "ab"));
+    ENSURE(!accepts(*d1, "abbc"));
+    ENSURE(!d1->is_empty());
+
+    // a* with an epsilon loop back to the start
+    mvs.reset();
+    mvs.push_back(range_automaton::move(m, 0, 1, &a));
+    mvs.push_back(range_automaton::move(m, 1, 0));
+    final.reset();
+    final.push_back(0);
+    range_automaton astar(m, 0, final, mvs);
+    dense_automaton* d2 = dense_automaton::mk(astar, gr, 256, 100);
+    ENSURE(d2);
+    ENSURE(d2->num_states() == 2);
+    ENSURE(accepts(*d2, ""));
+    ENSURE(accepts(*d2, "aaa"));
+    ENSURE(!accepts(*d2, "ab"));
+
+    // [a-z]*
+    mvs.reset();
+    mvs.push_back(range_automaton::move(m, 0, 0, &az));
+    range_automaton lower(m, 0, final, mvs);
+    dense_automaton* d3 = dense_automaton::mk(lower, gr, 256, 100);
+    ENSURE(d3);
+
+    ENSURE(dense_automaton::intersection_is_empty(*d1, *d2));
+    ENSURE(!dense_automaton::intersection_is_empty(*d1, *d3));
+    ENSURE(!dense_automaton::intersection_is_empty(*d2, *d3));
+
+    // the subset construction gives up beyond max_states
+    ENSURE(dense_automaton::mk(abb, gr, 256, 2) == nullptr);
+
+    dealloc(d1);
+    dealloc(d2);
+    dealloc(d3);
+}
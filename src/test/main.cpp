@@ -254,5 +254,14 @@ int main(int argc, char ** argv) {
     TST_ARGV(cnf_backbones);
     TST(bdd);
     TST(solver_pool);
+    TST(trau_arrangements);
+    TST(trau_regex);
+    TST(trau_char_classes);
+    TST(trau_warm_start);
+    TST(string_models);
+    TST(dense_automaton);
+    TST(zstring);
+    TST_ARGV(zstring_bench);
+    TST_ARGV(trau_regex_bench);
     //TST_ARGV(hs);
 }
@@ -0,0 +1,159 @@
+/*++
+Module Name:
+
+    string_models.cpp
+
+Abstract:
+
+    Test the enumeration of models that differ on their string constants,
+    through Z3_solver_enumerate_string_models and get-string-models.
+
+--*/
+#include <climits>
+#include <string>
+#include <vector>
+#include "util/debug.h"
+#include "api/z3.h"
+
+struct string_models_state {
+    Z3_context               ctx;
+    Z3_ast_vector            fmls;
+    Z3_ast                   x;
+    unsigned                 stop_after;
+    std::vector<std::string> values;
+};
+
+static bool on_model(void* state, Z3_model mdl) {
+    string_models_state& st = *static_cast<string_models_state*>(state);
+    Z3_ast v = nullptr;
+    // every reported model satisfies the assertions
+    for (unsigned i = 0; i < Z3_ast_vector_size(st.ctx, st.fmls); ++i) {
+        ENSURE(Z3_model_eval(st.ctx, mdl, Z3_ast_vector_get(st.ctx, st.fmls, i), true, &v));
+        ENSURE(Z3_get_bool_value(st.ctx, v) == Z3_L_TRUE);
+    }
+    ENSURE(Z3_model_eval(st.ctx, mdl, st.x, true, &v));
+    ENSURE(Z3_is_string(st.ctx, v));
+    st.values.push_back(Z3_get_string(st.ctx, v));
+    return st.values.size() < st.stop_after;
+}
+
+static bool all_distinct(std::vector<std::string> const& values) {
+    for (unsigned i = 0; i < values.size(); ++i)
+        for (unsigned j = i + 1; j < values.size(); ++j)
+            if (values[i] == values[j])
+                return false;
+    return true;
+}
+
+static Z3_lbool enumerate(char const* spec, unsigned max_models, unsigned timeout, unsigned stop_after,
+                          std::vector<std::string>& values) {
+    Z3_config cfg = Z3_mk_config();
+    Z3_context ctx = Z3_mk_context(cfg);
+    Z3_del_config(cfg);
+    Z3_solver s = Z3_mk_solver(ctx);
+    Z3_solver_inc_ref(ctx, s);
+    Z3_ast_vector fmls = Z3_parse_smtlib2_string(ctx, spec, 0, nullptr, nullptr, 0, nullptr, nullptr);
+    Z3_ast_vector_inc_ref(ctx, fmls);
+    for (unsigned i = 0; i < Z3_ast_vector_size(ctx, fmls); ++i)
+        Z3_solver_assert(ctx, s, Z3_ast_vector_get(ctx, fmls, i));
+    string_models_state st;
+    st.ctx = ctx;
+    st.fmls = fmls;
+    st.x = Z3_mk_const(ctx, Z3_mk_string_symbol(ctx, "x"), Z3_mk_string_sort(ctx));
+    st.stop_after = stop_after;
+    Z3_lbool r = Z3_solver_enumerate_string_models(ctx, s, max_models, timeout, &st, on_model);
+    // the enumeration leaves the assertions as they were
+    ENSURE(Z3_solver_check(ctx, s) == Z3_L_TRUE);
+    values = st.values;
+    Z3_ast_vector_dec_ref(ctx, fmls);
+    Z3_solver_dec_ref(ctx, s);
+    Z3_del_context(ctx);
+    return r;
+}
+
+static void tst_api() {
+    char const* three =
+        "(declare-const x String)"
+        "(assert (or (= x \"a\") (= x \"b\") (= x \"cc\")))";
+    char const* infinite =
+        "(declare-const x String)"
+        "(assert (str.prefixof \"a\" x))";
+    std::vector<std::string> values;
+
+    // the limit is reached with distinct models
+    ENSURE(enumerate(three, 2, 0, UINT_MAX, values) == Z3_L_TRUE);
+    ENSURE(values.size() == 2 && all_distinct(values));
+
+    // all models, then there are no further ones
+    ENSURE(enumerate(three, 10, 0, UINT_MAX, values) == Z3_L_FALSE);
+    ENSURE(values.size() == 3 && all_distinct(values));
+
+    // the callback stops the enumeration
+    ENSURE(enumerate(infinite, 10, 0, 1, values) == Z3_L_TRUE);
+    ENSURE(values.size() == 1);
+
+    // the timeout stops an enumeration that does not end on its own
+    ENSURE(enumerate(infinite, UINT_MAX, 200, UINT_MAX, values) == Z3_L_UNDEF);
+    ENSURE(all_distinct(values));
+}
+
+static unsigned count(std::string const& s, std::string const& t) {
+    unsigned n = 0;
+    for (size_t p = s.find(t); p != std::string::npos; p = s.find(t, p + 1))
+        ++n;
+    return n;
+}
+
+static void tst_cmd() {
+    Z3_config cfg = Z3_mk_config();
+    Z3_context ctx = Z3_mk_context(cfg);
+    Z3_del_config(cfg);
+    std::string out = Z3_eval_smtlib2_string(ctx,
+        "(declare-const x String)"
+        "(assert (or (= x \"a\") (= x \"b\") (= x \"cc\")))"
+        "(get-string-models 2)"
+        "(get-string-models 10)");
+    // the first command reaches its limit, the second one runs out of models
+    size_t first = out.find("sat\n");
+    ENSURE(first != std::string::npos && (first == 0 || out[first - 1] != 'n'));
+    size_t second = first + 4;
+    ENSURE(count(out.substr(0, second), "(define-fun x") == 2);
+    ENSURE(count(out.substr(second), "(define-fun x") == 3);
+    ENSURE(out.size() >= 6 && out.compare(out.size() - 6, 6, "unsat\n") == 0);
+    Z3_del_context(ctx);
+}
+
+/*
+ * theory_trau can produce a model that falsifies the assertions; the enumeration
+ * must not report it, nor claim afterwards that there are no further models.
+ */
+static void tst_trau() {
+    char const* overlap =
+        "(declare-const x String)"
+        "(declare-const y String)"
+        "(assert (= (str.++ x \"ab\") (str.++ \"ab\" y)))"
+        "(assert (< (str.len x) 6))";
+    char const* three =
+        "(declare-const x String)"
+        "(assert (or (= x \"a\") (= x \"b\") (= x \"cc\")))";
+    std::vector<std::string> values;
+    Z3_global_param_set("smt.string_solver", "trau");
+
+    // the first model of theory_trau is x = "a", y = "b", which is dropped
+    ENSURE(enumerate(overlap, 10, 0, UINT_MAX, values) != Z3_L_FALSE);
+    ENSURE(!values.empty() && all_distinct(values));
+    for (std::string const& v : values)
+        ENSURE(v.size() < 6);
+
+    Z3_lbool r = enumerate(three, 10, 0, UINT_MAX, values);
+    ENSURE(values.size() <= 3 && all_distinct(values));
+    ENSURE(r != Z3_L_FALSE || values.size() == 3);
+
+    Z3_global_param_set("smt.string_solver", "seq");
+}
+
+void tst_string_models() {
+    tst_api();
+    tst_cmd();
+    tst_trau();
+}
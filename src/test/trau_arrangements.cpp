@@ -0,0 +1,129 @@
+/*++
+Module Name:
+
+    trau_arrangements.cpp
+
+Abstract:
+
+    Test the shared arrangement table of theory_trau.
+
+--*/
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#ifndef _WINDOWS
+#include <unistd.h>
+#endif
+#include "util/debug.h"
+#include "smt/trau_arrangements.h"
+
+using smt::trau_arrangements;
+
+// a fresh file in the temporary directory; the caller removes it
+static std::string temp_table_name() {
+#ifndef _WINDOWS
+    char const* dir = getenv("TMPDIR");
+    std::string name = std::string(dir != nullptr && *dir ? dir : "/tmp") + "/trau_arrangements_XXXXXX";
+    int fd = mkstemp(&name[0]);
+    ENSURE(fd >= 0);
+    close(fd);
+    return name;
+#else
+    char buf[L_tmpnam];
+    ENSURE(tmpnam_s(buf, L_tmpnam) == 0);
+    return buf;
+#endif
+}
+
+static void snapshot(unsigned max_lhs, unsigned max_rhs, vector<int_vector> & cells) {
+    int_vector left_arr, right_arr;
+    for (unsigned i = 0; i <= max_lhs; ++i)
+        for (unsigned j = 0; j <= max_rhs; ++j) {
+            trau_arrangements::entry const& e = trau_arrangements::get(i, j);
+            int_vector c;
+            for (unsigned k = 0; k < e.size(); ++k) {
+                e.get(k, left_arr, right_arr);
+                ENSURE(left_arr.size() == i + 1);
+                ENSURE(right_arr.size() == j + 1);
+                c.append(left_arr);
+                c.append(right_arr);
+            }
+            cells.push_back(c);
+        }
+}
+
+void tst_trau_arrangements() {
+    // [x] = [y]
+    trau_arrangements::entry const& e00 = trau_arrangements::get(0, 0);
+    ENSURE(e00.size() == 1);
+    ENSURE(e00.left(0, 0) == 0 && e00.right(0, 0) == 0);
+
+    // [x] = sum(y1, y2)
+    trau_arrangements::entry const& e01 = trau_arrangements::get(0, 1);
+    ENSURE(e01.size() == 1);
+    ENSURE(e01.left(0, 0) == trau_arrangements::sum_flat);
+
+    // x1 x2 = y1 y2: [x2] = sum, sum = [y2], and x2 = y2
+    ENSURE(trau_arrangements::get(1, 1).size() == 3);
+
+    vector<int_vector> built;
+    snapshot(5, 5, built);
+
+    std::string table = temp_table_name();
+    char const* file_name = table.c_str();
+    ENSURE(trau_arrangements::save(file_name, 5, 5));
+
+    trau_arrangements::finalize();
+    trau_arrangements::initialize();
+    ENSURE(trau_arrangements::load(file_name));
+
+    vector<int_vector> loaded;
+    snapshot(5, 5, loaded);
+    ENSURE(built.size() == loaded.size());
+    for (unsigned i = 0; i < built.size(); ++i) {
+        ENSURE(built[i].size() == loaded[i].size());
+        for (unsigned k = 0; k < built[i].size(); ++k)
+            ENSURE(built[i][k] == loaded[i][k]);
+    }
+
+    // entries beyond the stored table are still built on demand
+    ENSURE(trau_arrangements::get(6, 6).size() > 0);
+
+    // a second table cannot replace the mapped one
+    std::string other = temp_table_name();
+    ENSURE(trau_arrangements::save(other.c_str(), 1, 1));
+    ENSURE(!trau_arrangements::load(other.c_str()));
+    ENSURE(trau_arrangements::load(file_name));
+    trau_arrangements::finalize();
+    trau_arrangements::initialize();
+
+    // a cell pointing past the other side is rejected: entry (0, 0) starts right after the index of 4 entries
+    {
+        FILE * f = fopen(other.c_str(), "r+b");
+        ENSURE(f != nullptr);
+        uint64_t ones = ~static_cast<uint64_t>(0);
+        ENSURE(fseek(f, (2 + 2 * 4) * sizeof(uint64_t), SEEK_SET) == 0);
+        ENSURE(fwrite(&ones, sizeof(ones), 1, f) == 1);
+        fclose(f);
+    }
+    ENSURE(!trau_arrangements::load(other.c_str()));
+    std::remove(other.c_str());
+
+    trau_arrangements::finalize();
+    trau_arrangements::initialize();
+
+    // tables claiming more entries than they hold, or larger than the cap, are rejected
+    ENSURE(!trau_arrangements::save(file_name, trau_arrangements::max_table_side + 1, 0));
+    unsigned const headers[][4] = {
+        { 0x55415254, 1, 0xFFFFFFFFu, 0xFFFFFFFFu },
+        { 0x55415254, 1, trau_arrangements::max_table_side, trau_arrangements::max_table_side },
+    };
+    for (auto const& header : headers) {
+        FILE * f = fopen(file_name, "wb");
+        ENSURE(f != nullptr);
+        ENSURE(fwrite(header, sizeof(header), 1, f) == 1);
+        fclose(f);
+        ENSURE(!trau_arrangements::load(file_name));
+    }
+    std::remove(file_name);
+}
@@ -0,0 +1,38 @@
+/*++
+Module Name:
+
+    trau_char_classes.cpp
+
+Abstract:
+
+    Regression tests for the character classes of theory_trau: flat-array
+    characters that arithmetic leaves unconstrained, and classes that are
+    refined when a later check brings new characters.
+
+--*/
+#include "test/trau_check.h"
+
+void tst_trau_char_classes() {
+    // the characters of x only occur in equalities, so arithmetic gives them no value of its own
+    char const* unbounded[] = {
+        "(declare-const x String) (declare-const y String) (declare-const z String)"
+        "(assert (= (str.++ x \"a\" y) (str.++ z \"b\")))"
+        "(assert (> (str.len x) 1))"
+        "(assert (str.prefixof \"ab\" x))"
+        "(assert (= (str.len y) 2))"
+    };
+    Z3_lbool sat[] = { Z3_L_TRUE, Z3_L_TRUE };
+    check_trau(unbounded, 1, sat);
+
+    // the first check only knows "a"; the second one must tell b, c and d apart
+    char const* refined[] = {
+        "(declare-const xpre String)"
+        "(assert (= (str.++ xpre \"a\") (str.++ \"a\" xpre)))"
+        "(assert (= (str.len xpre) 2))",
+        "(declare-const x String) (declare-const y String)"
+        "(assert (= y (str.replace x \"ab\" \"cd\")))"
+        "(assert (str.contains y \"cdab\"))"
+        "(assert (< (str.len x) 7))"
+    };
+    check_trau(refined, 2, sat);
+}
@@ -0,0 +1,60 @@
+/*++
+Module Name:
+
+    trau_check.h
+
+Abstract:
+
+    Fixture of the theory_trau regression tests: check SMT-LIB2 input with
+    smt.string_solver=trau through the API and validate the models.
+
+--*/
+#pragma once
+
+#include "util/debug.h"
+#include "api/z3.h"
+
+/*
+ * Assert each group in turn and check after it. A sat answer is only accepted
+ * with a model of the assertions so far; the answer of check g must be expected[g]
+ * unless expected is null. Returns the answer of the last check.
+ */
+inline Z3_lbool check_trau(char const* const* groups, unsigned n, Z3_lbool const* expected = nullptr) {
+    Z3_global_param_set("smt.string_solver", "trau");
+    Z3_config cfg = Z3_mk_config();
+    Z3_context ctx = Z3_mk_context(cfg);
+    Z3_del_config(cfg);
+    Z3_solver s = Z3_mk_solver(ctx);
+    Z3_solver_inc_ref(ctx, s);
+    Z3_lbool r = Z3_L_UNDEF;
+    for (unsigned g = 0; g < n; ++g) {
+        Z3_ast_vector fmls = Z3_parse_smtlib2_string(ctx, groups[g], 0, nullptr, nullptr, 0, nullptr, nullptr);
+        Z3_ast_vector_inc_ref(ctx, fmls);
+        for (unsigned i = 0; i < Z3_ast_vector_size(ctx, fmls); ++i)
+            Z3_solver_assert(ctx, s, Z3_ast_vector_get(ctx, fmls, i));
+        Z3_ast_vector_dec_ref(ctx, fmls);
+        r = Z3_solver_check(ctx, s);
+        ENSURE(expected == nullptr || r == expected[g]);
+        if (r != Z3_L_TRUE)
+            continue;
+        Z3_model mdl = Z3_solver_get_model(ctx, s);
+        Z3_model_inc_ref(ctx, mdl);
+        Z3_ast_vector all = Z3_solver_get_assertions(ctx, s);
+        Z3_ast_vector_inc_ref(ctx, all);
+        for (unsigned i = 0; i < Z3_ast_vector_size(ctx, all); ++i) {
+            Z3_ast v = nullptr;
+            ENSURE(Z3_model_eval(ctx, mdl, Z3_ast_vector_get(ctx, all, i), true, &v));
+            ENSURE(Z3_get_bool_value(ctx, v) == Z3_L_TRUE);
+        }
+        Z3_ast_vector_dec_ref(ctx, all);
+        Z3_model_dec_ref(ctx, mdl);
+    }
+    Z3_solver_dec_ref(ctx, s);
+    Z3_del_context(ctx);
+    Z3_global_param_set("smt.string_solver", "seq");
+    return r;
+}
+
+inline Z3_lbool check_trau(char const* spec) {
+    return check_trau(&spec, 1);
+}
@@ -0,0 +1,55 @@
+/*++
+Module Name:
+
+    trau_regex.cpp
+
+Abstract:
+
+    Regression tests for the regex encodings of theory_trau: star and
+    plus memberships over string constants, contains reductions next
+    to constants, and empty intersection and complement memberships.
+    The slow unsat cases are a separate entry, trau_regex_bench, that is
+    not part of the default run.
+
+--*/
+#include "test/trau_check.h"
+
+void tst_trau_regex() {
+    // x = (ab)^n with n >= 2
+    ENSURE(check_trau(
+        "(declare-const x String) (declare-const y String)"
+        "(assert (= (str.++ x \"ab\") y))"
+        "(assert (str.in.re y (re.* (str.to.re \"ab\"))))"
+        "(assert (> (str.len x) 3))") == Z3_L_TRUE);
+    // the needle "bd" straddles x and the constant "d"
+    ENSURE(check_trau(
+        "(declare-const x String) (declare-const y String)"
+        "(assert (str.in.re x (re.* (re.range \"a\" \"c\"))))"
+        "(assert (= (str.++ x \"d\") y))"
+        "(assert (str.contains y \"bd\"))"
+        "(assert (= (str.len y) 5))") == Z3_L_TRUE);
+    // the length abstraction looks up these automata before any emptiness check
+    ENSURE(check_trau(
+        "(declare-const x String)"
+        "(assert (str.in.re x (re.inter (re.+ (str.to.re \"a\")) (re.+ (str.to.re \"b\")))))") == Z3_L_FALSE);
+    ENSURE(check_trau(
+        "(declare-const x String)"
+        "(assert (str.in.re x (re.complement (re.union (re.* (re.range \"a\" \"z\")) (re.complement (re.* (re.range \"a\" \"z\")))))))") == Z3_L_FALSE);
+}
+
+/*
+ * Unsat cases that take Trau tens of seconds, so they are not part of the
+ * default run. Only run on request: test-z3 trau_regex_bench
+ */
+void tst_trau_regex_bench(char** argv, int argc, int& i) {
+    // z is a non-empty run of c's, so neither side can absorb the other's constant
+    ENSURE(check_trau(
+        "(declare-const x String) (declare-const y String) (declare-const z String)"
+        "(assert (= (str.++ x \"ab\" y) (str.++ y \"ba\" z)))"
+        "(assert (str.in.re z (re.+ (str.to.re \"c\"))))") == Z3_L_FALSE);
+    ENSURE(check_trau(
+        "(declare-const x String) (declare-const y String) (declare-const z String)"
+        "(assert (= (str.++ x \"ab\" y) (str.++ y \"ba\" z)))"
+        "(assert (str.in.re z (re.+ (str.to.re \"c\"))))"
+        "(assert (> (str.len x) 2))") == Z3_L_FALSE);
+}
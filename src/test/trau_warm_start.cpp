@@ -0,0 +1,64 @@
+/*++
+Module Name:
+
+    trau_warm_start.cpp
+
+Abstract:
+
+    Regression tests for the warm start of theory_trau: a check after a pop
+    decides the lengths of the last model first, although their atoms went
+    away with the popped scope.
+
+--*/
+#include <cstring>
+#include <string>
+#include "util/debug.h"
+#include "api/z3.h"
+
+static unsigned warm_start_hints(Z3_context ctx, Z3_solver s) {
+    Z3_stats st = Z3_solver_get_statistics(ctx, s);
+    Z3_stats_inc_ref(ctx, st);
+    unsigned hints = 0;
+    for (unsigned i = 0; i < Z3_stats_size(ctx, st); ++i)
+        if (strcmp(Z3_stats_get_key(ctx, st, i), "trau warm start hints") == 0)
+            hints = Z3_stats_get_uint_value(ctx, st, i);
+    Z3_stats_dec_ref(ctx, st);
+    return hints;
+}
+
+static void assert_spec(Z3_context ctx, Z3_solver s, char const* spec) {
+    Z3_ast_vector fmls = Z3_parse_smtlib2_string(ctx, spec, 0, nullptr, nullptr, 0, nullptr, nullptr);
+    Z3_ast_vector_inc_ref(ctx, fmls);
+    for (unsigned i = 0; i < Z3_ast_vector_size(ctx, fmls); ++i)
+        Z3_solver_assert(ctx, s, Z3_ast_vector_get(ctx, fmls, i));
+    Z3_ast_vector_dec_ref(ctx, fmls);
+}
+
+void tst_trau_warm_start() {
+    Z3_global_param_set("smt.string_solver", "trau");
+    Z3_config cfg = Z3_mk_config();
+    Z3_context ctx = Z3_mk_context(cfg);
+    Z3_del_config(cfg);
+    Z3_solver s = Z3_mk_solver(ctx);
+    Z3_solver_inc_ref(ctx, s);
+    char const* decls = "(declare-const x String) (declare-const y String)";
+    assert_spec(ctx, s, (std::string(decls) + "(assert (= (str.++ x \"a\") (str.++ \"a\" y)))").c_str());
+    Z3_solver_push(ctx, s);
+    assert_spec(ctx, s, (std::string(decls) + "(assert (= (str.len x) 3))").c_str());
+    ENSURE(Z3_solver_check(ctx, s) == Z3_L_TRUE);
+    Z3_solver_pop(ctx, s, 1);
+    // the length atoms of the model above were made in the popped scope
+    ENSURE(Z3_solver_check(ctx, s) == Z3_L_TRUE);
+    ENSURE(warm_start_hints(ctx, s) > 0);
+    // the length of x is decided first, and nothing refutes it
+    Z3_model mdl = Z3_solver_get_model(ctx, s);
+    Z3_model_inc_ref(ctx, mdl);
+    Z3_ast x = Z3_mk_const(ctx, Z3_mk_string_symbol(ctx, "x"), Z3_mk_string_sort(ctx));
+    Z3_ast v = nullptr;
+    ENSURE(Z3_model_eval(ctx, mdl, x, true, &v) && Z3_is_string(ctx, v));
+    ENSURE(strlen(Z3_get_string(ctx, v)) == 3);
+    Z3_model_dec_ref(ctx, mdl);
+    Z3_solver_dec_ref(ctx, s);
+    Z3_del_context(ctx);
+    Z3_global_param_set("smt.string_solver", "seq");
+}
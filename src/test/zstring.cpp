@@ -0,0 +1,113 @@
+/*++
+Module Name:
+
+    zstring.cpp
+
+Abstract:
+
+    Test zstring search functions against naive scans. The timing on
+    long strings is a separate entry, zstring_bench, that is not part
+    of the default run.
+
+--*/
+#include <iostream>
+#include "util/debug.h"
+#include "util/stopwatch.h"
+#include "util/vector.h"
+#include "ast/seq_decl_plugin.h"
+
+static int naive_indexof(zstring const& s, zstring const& t, unsigned offset) {
+    for (unsigned i = offset; i + t.length() <= s.length(); ++i) {
+        bool eq = true;
+        for (unsigned j = 0; eq && j < t.length(); ++j)
+            eq = s[i + j] == t[j];
+        if (eq)
+            return i;
+    }
+    return -1;
+}
+
+static int naive_last_indexof(zstring const& s, zstring const& t) {
+    for (unsigned i = s.length() - t.length() + 1; i-- > 0; ) {
+        bool eq = true;
+        for (unsigned j = 0; eq && j < t.length(); ++j)
+            eq = s[i + j] == t[j];
+        if (eq)
+            return i;
+    }
+    return -1;
+}
+
+static zstring random_string(unsigned len, unsigned num_chars) {
+    unsigned_vector cs;
+    for (unsigned i = 0; i < len; ++i)
+        cs.push_back('a' + rand() % num_chars);
+    return zstring(cs.size(), cs.c_ptr());
+}
+
+static void tst_random() {
+    for (unsigned k = 0; k < 20000; ++k) {
+        unsigned num_chars = 1 + rand() % 3;
+        zstring s = random_string(rand() % 40, num_chars);
+        zstring t = random_string(rand() % 6, num_chars);
+        if (rand() % 3 == 0 && s.length() > 0) {
+            unsigned lo = rand() % s.length();
+            t = s.extract(lo, rand() % 8);
+        }
+        ENSURE(s.contains(t) == (naive_indexof(s, t, 0) >= 0));
+        ENSURE(t.prefixof(s) == (t.length() <= s.length() && s.extract(0, t.length()) == t));
+        ENSURE(t.suffixof(s) == (t.length() <= s.length() && s.extract(s.length() - t.length(), t.length()) == t));
+        unsigned offset = rand() % (s.length() + 1);
+        if (t.length() > 0) {
+            ENSURE(s.indexof(t, offset) == naive_indexof(s, t, offset));
+            ENSURE(s.last_indexof(t) == (t.length() <= s.length() ? naive_last_indexof(s, t) : -1));
+        }
+    }
+}
+
+static void tst_edge_cases() {
+    zstring ab("ab"), b("b"), empty;
+    ENSURE(ab.last_indexof(b) == 1);
+    ENSURE(ab.last_indexof(ab) == 0);
+    ENSURE(ab.indexof(empty, 2) == 2);
+    ENSURE(ab.indexof(b, 2) == -1);
+    ENSURE(ab.contains(empty));
+    ENSURE(empty.prefixof(ab) && empty.suffixof(ab));
+    ENSURE(zstring("aabaab").replace(zstring("ab"), zstring("c")) == zstring("acaab"));
+    ENSURE(zstring("aaa").replace(zstring("b"), zstring("c")) == zstring("aaa"));
+}
+
+/*
+ * Periodic haystacks with a late match are the worst case of the
+ * quadratic scan. Only run on request: test-z3 zstring_bench
+ */
+void tst_zstring_bench(char** argv, int argc, int& i) {
+    unsigned n = 1 << 20, m = 1 << 10;
+    unsigned_vector hs(n, 'a'), ns(m, 'a');
+    hs[n - 1] = 'b';
+    ns[m - 1] = 'b';
+    zstring haystack(hs.size(), hs.c_ptr()), needle(ns.size(), ns.c_ptr());
+    stopwatch sw;
+    sw.start();
+    int r = 0;
+    for (unsigned i = 0; i < 10; ++i)
+        r += haystack.indexof(needle, 0) + haystack.last_indexof(needle) + haystack.contains(needle);
+    sw.stop();
+    ENSURE(r == 10 * (2 * static_cast<int>(n - m) + 1));
+    std::cout << "zstring search " << n << "/" << m << ": " << sw.get_seconds() << "s\n";
+
+    zstring copy(haystack);
+    sw.reset();
+    sw.start();
+    bool eq = true;
+    for (unsigned i = 0; i < 100; ++i)
+        eq = eq && copy == haystack && needle.suffixof(haystack) && !needle.prefixof(haystack);
+    sw.stop();
+    ENSURE(eq);
+    std::cout << "zstring compare " << n << ": " << sw.get_seconds() << "s\n";
+}
+
+void tst_zstring() {
+    tst_edge_cases();
+    tst_random();
+}